@@ -1,24 +1,60 @@
 #!/usr/bin/python
 
-import itertools, random
-import utilities
+import ctypes, os, random, sys
+
+# The board lives in fastgo's libfastgo.so, which handles captures, ko and the move history the features need,
+# so each GTP move costs one native call.
+library = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "fastgo", "libfastgo.so"))
+library.fastgo_board_create.restype = ctypes.c_void_p
+library.fastgo_board_create.argtypes = []
+library.fastgo_board_destroy.argtypes = [ctypes.c_void_p]
+library.fastgo_board_play.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+library.fastgo_board_undo.argtypes = [ctypes.c_void_p]
+library.fastgo_board_legal_moves.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_void_p]
+library.fastgo_board_features.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_void_p, ctypes.c_int]
+
+FASTGO_OK = 0
 
 class Engine:
 	def __init__(self, board_size):
+		assert board_size == library.fastgo_board_size(), "libfastgo.so is built for %ix%i" % ((library.fastgo_board_size(),) * 2)
 		self.board_size = board_size
-		self.board = {}
+		self.board = library.fastgo_board_create()
+		self.legal = (ctypes.c_uint8 * (board_size * board_size))()
+		self.features = (ctypes.c_uint8 * (library.fastgo_feature_plane_count() * board_size * board_size))()
+		self.debug_stream = sys.stderr
+
+	def __del__(self):
+		library.fastgo_board_destroy(self.board)
+
+	# Colors are 0 for black and 1 for white, and GTP counts rows up from the bottom while the native board counts down from the top.
+	# Moves return the native status, which is FASTGO_OK unless the board rejected the move and left the position unchanged.
+	def native_play(self, color, x, y):
+		status = library.fastgo_board_play(self.board, color + 1, x, y)
+		if status != FASTGO_OK:
+			print >>self.debug_stream, "Native board rejected move %r for %i: status %i" % ((x, y), color, status)
+		return status
 
 	def player_passes(self, color):
-		pass
+		return self.native_play(color, -1, -1)
 
 	def play(self, color, xy):
-		self.board[xy] = color
+		x, y = xy
+		return self.native_play(color, x, self.board_size - 1 - y)
 
-	def genmove(self, color):
-		spots = [xy for xy in valid_coords if xy not in self.board.viewkeys()]
-		if spots:
-			choice = random.choice(spots)
-			self.board[choice] = color
-			return choice
-		return "pass"
+	def undo(self):
+		return library.fastgo_board_undo(self.board) == FASTGO_OK
+
+	# The input planes for a network, from color's point of view.
+	def feature_planes(self, color):
+		library.fastgo_board_features(self.board, color + 1, self.features, 0)
+		return self.features
 
+	def genmove(self, color):
+		if library.fastgo_board_legal_moves(self.board, color + 1, 1, self.legal) == 0:
+			self.player_passes(color)
+			return "pass"
+		point = random.choice([i for i, legal in enumerate(self.legal) if legal])
+		x, y = point % self.board_size, point // self.board_size
+		self.native_play(color, x, y)
+		return x, self.board_size - 1 - y
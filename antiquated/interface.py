@@ -6,7 +6,7 @@ import engine
 sys.stderr = open("/tmp/snpgo_stderr", "w")
 
 command_list = ["name", "protocol_version", "version", "list_commands", "play", "genmove"]
-command_list.extend(["known_command", "quit", "boardsize", "clear_board", "komi"])
+command_list.extend(["known_command", "quit", "boardsize", "clear_board", "komi", "undo"])
 valid_ranks = "abcdefghjklmnopqrst"
 assert len(valid_ranks) == 19 and sorted(valid_ranks) == list(valid_ranks)
 
@@ -85,15 +85,24 @@ class GTPHandler:
 				exit()
 			elif args[0] == "play":
 				player = color_code_to_player_number(args[1])
+				status = engine.FASTGO_OK
 				if args[2].lower() == "pass":
-					self.engine.player_passes(player)
+					status = self.engine.player_passes(player)
 				elif args[2].lower() == "resign":
 					# Huzzah, we win!
 					print >>self.debug_stream, "We win by resignation!"
 				else:
 					xy = code_to_xy(args[2])
-					self.engine.play(player, xy)
-				self.send("=\n\n")
+					status = self.engine.play(player, xy)
+				if status == engine.FASTGO_OK:
+					self.send("=\n\n")
+				else:
+					self.send("? illegal move\n\n")
+			elif args[0] == "undo":
+				if self.engine.undo():
+					self.send("=\n\n")
+				else:
+					self.send("? cannot undo\n\n")
 			elif args[0] == "genmove":
 				player = color_code_to_player_number(args[1])
 				xy = self.engine.genmove(player)
@@ -0,0 +1,221 @@
+// Load generator for analysis_server: many keep-alive connections posting SGFs to /analyze, with latency percentiles.
+
+#include "go_utils.h"
+#include "sgf.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+struct LoadConfig {
+	int connections = 16;
+	int requests = 1000;
+	int positions = 1000;
+	int max_moves = 250;
+	uint64_t seed = 1;
+	std::string query = "policy=0";
+};
+
+// A game of uniformly random legal moves that don't fill the mover's own eyes, stopping at a length drawn up to max_moves.
+static std::string random_game_sgf(int max_moves, std::mt19937_64& generator) {
+	Game game;
+	GoBoard board;
+	int length = std::uniform_int_distribution<int>(0, max_moves)(generator);
+	Player who = Player::BLACK;
+	std::vector<Coord> moves;
+	for (int i = 0; i < length; i++) {
+		moves.clear();
+		for (int point = 0; point < BOARD_SIZE * BOARD_SIZE; point++) {
+			Coord xy{point % BOARD_SIZE, point / BOARD_SIZE};
+			if (board.is_legal(who, xy) and not pattern_is_eye(board.pattern_at(xy), (Cell)who))
+				moves.push_back(xy);
+		}
+		if (moves.empty()) {
+			board.pass();
+			game.moves.push_back({who, {-1, -1}, true});
+		} else {
+			Coord xy = moves[generator() % moves.size()];
+			board.place_stone(who, xy);
+			game.moves.push_back({who, xy, false});
+		}
+		who = opponent_of(who);
+	}
+	return format_sgf(game);
+}
+
+static int connect_to(const std::string& host, const std::string& port) {
+	addrinfo hints{}, *addresses;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+	if (status != 0) {
+		std::cerr << "Couldn't resolve " << host << ": " << gai_strerror(status) << std::endl;
+		return -1;
+	}
+	int fd = -1;
+	for (addrinfo* address = addresses; address != nullptr and fd < 0; address = address->ai_next) {
+		fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (fd >= 0 and connect(fd, address->ai_addr, address->ai_addrlen) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0) {
+		std::cerr << "Couldn't connect to " << host << ":" << port << ": " << strerror(errno) << std::endl;
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+// Reads one response off the connection, leaving anything after it in buffer. Returns the status, or -1 if the
+// connection failed.
+static int read_response(int fd, std::string& buffer) {
+	char chunk[16 << 10];
+	size_t head_end, body_length = 0;
+	bool have_head = false;
+	while (true) {
+		if (not have_head and (head_end = buffer.find("\r\n\r\n")) != std::string::npos) {
+			have_head = true;
+			std::string head = buffer.substr(0, head_end);
+			for (char& c : head)
+				c = std::tolower((unsigned char)c);
+			size_t length_at = head.find("\r\ncontent-length:");
+			if (length_at != std::string::npos)
+				body_length = std::strtoull(head.c_str() + length_at + 17, nullptr, 10);
+		}
+		if (have_head and buffer.size() >= head_end + 4 + body_length) {
+			int status = buffer.compare(0, 5, "HTTP/") == 0 ? std::atoi(buffer.c_str() + 9) : -1;
+			buffer.erase(0, head_end + 4 + body_length);
+			// The interim reply to Expect: 100-continue, which this never sends; skip it anyway.
+			if (status == 100) {
+				have_head = false;
+				body_length = 0;
+				continue;
+			}
+			return status;
+		}
+		ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+		if (received < 0 and errno == EINTR)
+			continue;
+		if (received <= 0)
+			return -1;
+		buffer.append(chunk, received);
+	}
+}
+
+int main(int argc, char** argv) {
+	LoadConfig config;
+	bool bad_options = argc < 3;
+	for (int i = 3; i < argc; i++) {
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--connections")
+			config.connections = std::stoi(argv[++i]);
+		else if (option == "--requests")
+			config.requests = std::stoi(argv[++i]);
+		else if (option == "--positions")
+			config.positions = std::stoi(argv[++i]);
+		else if (option == "--max-moves")
+			config.max_moves = std::stoi(argv[++i]);
+		else if (option == "--seed")
+			config.seed = std::stoull(argv[++i]);
+		else if (option == "--query")
+			config.query = argv[++i];
+		else
+			bad_options = true;
+	}
+	if (bad_options or config.connections < 1 or config.requests < 1 or config.positions < 1 or config.max_moves < 0) {
+		std::cerr << "Usage: analysis_load host port [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Opens the given number of keep-alive connections to an analysis_server, each posting one SGF to /analyze at a" << std::endl;
+		std::cerr << "time and waiting for the answer, then prints the request rate and latency percentiles seen by the clients." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --connections n  Concurrent connections (default 16)." << std::endl;
+		std::cerr << "  --requests n     Requests per connection (default 1000)." << std::endl;
+		std::cerr << "  --positions n    Distinct random games to draw the requests from (default 1000)." << std::endl;
+		std::cerr << "  --max-moves n    Games are uniformly 0 to n moves long (default 250)." << std::endl;
+		std::cerr << "  --seed n         Seed for the games and the order they're sent in (default 1)." << std::endl;
+		std::cerr << "  --query q        Query string for /analyze (default policy=0, leaving the policy out of replies)." << std::endl;
+		return 1;
+	}
+	std::string host = argv[1], port = argv[2];
+
+	std::mt19937_64 generator(config.seed);
+	std::vector<std::string> requests;
+	for (int i = 0; i < config.positions; i++) {
+		std::string sgf = random_game_sgf(config.max_moves, generator);
+		requests.push_back("POST /analyze?" + config.query + " HTTP/1.1\r\nHost: " + host + "\r\nContent-Type: application/x-go-sgf\r\n"
+			"Content-Length: " + std::to_string(sgf.size()) + "\r\n\r\n" + sgf);
+	}
+
+	std::vector<std::vector<double>> latencies(config.connections);
+	std::atomic<uint64_t> errors{0}, failed_connections{0};
+	auto start = Clock::now();
+	std::vector<std::thread> threads;
+	for (int c = 0; c < config.connections; c++) {
+		threads.emplace_back([&, c] {
+			int fd = connect_to(host, port);
+			if (fd < 0) {
+				failed_connections++;
+				return;
+			}
+			std::mt19937_64 order(config.seed + c + 1);
+			std::string buffer;
+			for (int r = 0; r < config.requests; r++) {
+				const std::string& request = requests[order() % requests.size()];
+				auto sent_at = Clock::now();
+				size_t sent = 0;
+				while (sent < request.size()) {
+					ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+					if (n < 0 and errno == EINTR)
+						continue;
+					if (n <= 0)
+						break;
+					sent += n;
+				}
+				int status = sent == request.size() ? read_response(fd, buffer) : -1;
+				if (status < 0) {
+					failed_connections++;
+					break;
+				}
+				errors += status != 200;
+				latencies[c].push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent_at).count());
+			}
+			close(fd);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::vector<double> all;
+	for (const std::vector<double>& connection : latencies)
+		all.insert(all.end(), connection.begin(), connection.end());
+	std::sort(all.begin(), all.end());
+	auto percentile = [&](double q) { return all.empty() ? 0.0 : all[std::min(all.size() - 1, (size_t)(q * all.size()))]; };
+	printf("Completed %zu requests over %i connections in %.2fs: %.1f requests/s.\n", all.size(), config.connections, seconds, all.size() / seconds);
+	printf("Latency: p50 %.3fms, p90 %.3fms, p99 %.3fms, max %.3fms.\n", percentile(0.5), percentile(0.9), percentile(0.99), all.empty() ? 0.0 : all.back());
+	if (errors > 0 or failed_connections > 0)
+		printf("%llu non-200 responses, %llu connections failed.\n", (unsigned long long)errors.load(), (unsigned long long)failed_connections.load());
+	return errors > 0 or failed_connections > 0;
+}
@@ -0,0 +1,802 @@
+// An HTTP/1.1 analysis service: POST a position or an SGF to /analyze and get the policy and top moves back as JSON.
+
+#include "go_utils.h"
+#include "feature_extraction.h"
+#include "sgf.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+
+typedef std::chrono::steady_clock Clock;
+
+// Anything bigger is refused outright rather than buffered.
+constexpr size_t MAX_HEAD_BYTES = 16 << 10;
+constexpr size_t MAX_BODY_BYTES = 1 << 20;
+constexpr int DEFAULT_TOP_MOVES = 10;
+// Every point, then pass.
+constexpr int POLICY_SIZE = BOARD_SIZE * BOARD_SIZE + 1;
+constexpr int PASS_INDEX = BOARD_SIZE * BOARD_SIZE;
+
+struct ServerConfig {
+	int port = 13697;
+	int max_batch = 64;
+	int max_wait_us = 2000;
+	int evaluator_threads = 1;
+	double report_seconds = 10;
+};
+
+// A position to analyse, with the recent moves its features see.
+struct AnalysisPosition {
+	GoBoard board;
+	FeatureExtractor feature_extractor;
+	Player to_move = Player::BLACK;
+	int move_number = 0;
+};
+
+// The position after the game's last move, replaying every move so captures and ko come out right.
+static bool parse_sgf_position(const std::string& body, AnalysisPosition& position, std::string& error) {
+	Game game;
+	if (not parse_sgf_string(body, game)) {
+		error = "unreadable SGF";
+		return false;
+	}
+	if (game.board_size != BOARD_SIZE) {
+		error = "only " + std::to_string(BOARD_SIZE) + "x" + std::to_string(BOARD_SIZE) + " games can be analysed";
+		return false;
+	}
+	position.board = initial_board<BOARD_SIZE>(game);
+	position.to_move = game.handicap > 1 ? Player::WHITE : Player::BLACK;
+	for (const Move& m : game.moves) {
+		position.move_number++;
+		if (m.pass) {
+			position.board.pass();
+			position.feature_extractor.add_move_to_history({-1, -1});
+		} else {
+			if (not position.board.is_legal(m.who_moved, m.xy)) {
+				error = "illegal move " + std::to_string(position.move_number);
+				return false;
+			}
+			position.board.place_stone(m.who_moved, m.xy);
+			position.feature_extractor.add_move_to_history(m.xy);
+		}
+		position.to_move = opponent_of(m.who_moved);
+	}
+	return true;
+}
+
+// BOARD_SIZE rows of BOARD_SIZE points, top row first: '.' or '+' for empty, 'X' for black and 'O' for white, with
+// spaces ignored. An optional last line "to_move white" (or black, the default) says whose turn it is.
+static bool parse_diagram_position(const std::string& body, AnalysisPosition& position, std::string& error) {
+	std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells = {};
+	std::istringstream in(body);
+	std::string line;
+	int rows = 0;
+	while (std::getline(in, line)) {
+		line.erase(std::remove_if(line.begin(), line.end(), [](char c) { return std::isspace((unsigned char)c); }), line.end());
+		if (line.empty())
+			continue;
+		if (rows == BOARD_SIZE) {
+			if (line == "to_moveblack" or line == "to_movewhite") {
+				position.to_move = line == "to_moveblack" ? Player::BLACK : Player::WHITE;
+				continue;
+			}
+			error = "expected to_move black or to_move white after the board";
+			return false;
+		}
+		if (line.size() != BOARD_SIZE) {
+			error = "row " + std::to_string(rows + 1) + " doesn't have " + std::to_string(BOARD_SIZE) + " points";
+			return false;
+		}
+		for (int x = 0; x < BOARD_SIZE; x++) {
+			char c = line[x];
+			if (c != '.' and c != '+' and c != 'X' and c != 'O') {
+				error = std::string("unexpected '") + c + "' in row " + std::to_string(rows + 1);
+				return false;
+			}
+			cells[x + rows * BOARD_SIZE] = c == 'X' ? (Cell)Player::BLACK : c == 'O' ? (Cell)Player::WHITE : 0;
+		}
+		rows++;
+	}
+	if (rows != BOARD_SIZE) {
+		error = "expected " + std::to_string(BOARD_SIZE) + " rows";
+		return false;
+	}
+	position.board = GoBoard::from_cells(cells);
+	return true;
+}
+
+// Feature extraction assumes every group has a liberty, but a diagram can leave a dead group on the board.
+static bool check_liberties(const AnalysisPosition& position, std::string& error) {
+	BoardAnalysis analysis;
+	analysis.analyse(position.board.cells);
+	if (analysis.has_group_without_liberties()) {
+		error = "position has a group with no liberties";
+		return false;
+	}
+	return true;
+}
+
+// Turns a batch of positions into policies of POLICY_SIZE probabilities each, for the player to move, in one call,
+// as a network would be run.
+class BatchEvaluator {
+public:
+	virtual ~BatchEvaluator() {}
+	virtual void evaluate(const std::vector<AnalysisPosition*>& batch, float* policies) = 0;
+};
+
+// Stands in for a network until one can be served from C++. It builds the batch's input planes just as a network's
+// input would be built, then scores each legal point from a few of those planes, its line, and its distance from the
+// last move, and takes the softmax.
+class FeaturePriorEvaluator : public BatchEvaluator {
+	struct PlaneWeight {
+		FeatureKind kind;
+		float weight;
+	};
+	static constexpr PlaneWeight PLANE_WEIGHTS[] = {
+		{FEAT_P1_PLAY_CAUSES_CAPTURE1, 3.0},
+		{FEAT_P1_PLAY_CAUSES_CAPTURE2PLUS, 4.0},
+		{FEAT_P2_PLAY_CAUSES_CAPTURE1, 2.0},
+		{FEAT_P2_PLAY_CAUSES_CAPTURE2PLUS, 3.0},
+		{FEAT_LADDER_CAPTURE, 2.0},
+		{FEAT_LADDER_ESCAPE, 2.0},
+	};
+	// By distance from the edge: the first line, the second, and so on, the last entry covering the rest.
+	static constexpr float LINE_WEIGHTS[] = {-2.0, -0.5, 0.5, 0.5, 0.0};
+	// Within two points (by the larger of dx and dy) of the last move.
+	static constexpr float LOCAL_WEIGHT = 1.0;
+	static constexpr float PASS_LOGIT = -4.0;
+
+	std::vector<uint8_t> features;
+	std::vector<float> logits;
+
+public:
+	void evaluate(const std::vector<AnalysisPosition*>& batch, float* policies) override {
+		features.resize(batch.size() * TOTAL_FEATURES);
+		for (size_t i = 0; i < batch.size(); i++)
+			batch[i]->feature_extractor.fill_features(&features[i * TOTAL_FEATURES], batch[i]->board, batch[i]->to_move);
+
+		logits.resize(POLICY_SIZE);
+		for (size_t i = 0; i < batch.size(); i++) {
+			AnalysisPosition& position = *batch[i];
+			const uint8_t* planes = &features[i * TOTAL_FEATURES];
+			Coord last_move = position.feature_extractor.move_history.empty() ? Coord{-1, -1} : position.feature_extractor.move_history.front();
+			float* policy = policies + i * POLICY_SIZE;
+			float max_logit = PASS_LOGIT;
+			for (int point = 0; point < BOARD_SIZE * BOARD_SIZE; point++) {
+				Coord xy{point % BOARD_SIZE, point / BOARD_SIZE};
+				if (not position.board.is_legal(position.to_move, xy) or pattern_is_eye(position.board.pattern_at(xy), (Cell)position.to_move)) {
+					logits[point] = -INFINITY;
+					continue;
+				}
+				float logit = 0;
+				for (const PlaneWeight& plane : PLANE_WEIGHTS)
+					logit += plane.weight * planes[plane.kind * BOARD_SIZE * BOARD_SIZE + point];
+				int line = std::min({xy.first, xy.second, BOARD_SIZE - 1 - xy.first, BOARD_SIZE - 1 - xy.second});
+				logit += LINE_WEIGHTS[std::min(line, (int)std::size(LINE_WEIGHTS) - 1)];
+				if (last_move != Coord{-1, -1} and std::max(std::abs(xy.first - last_move.first), std::abs(xy.second - last_move.second)) <= 2)
+					logit += LOCAL_WEIGHT;
+				logits[point] = logit;
+				max_logit = std::max(max_logit, logit);
+			}
+			logits[PASS_INDEX] = PASS_LOGIT;
+			float total = 0;
+			for (int move = 0; move < POLICY_SIZE; move++)
+				total += policy[move] = std::exp(logits[move] - max_logit);
+			for (int move = 0; move < POLICY_SIZE; move++)
+				policy[move] /= total;
+		}
+	}
+};
+
+static std::string gtp_vertex(int move) {
+	if (move == PASS_INDEX)
+		return "pass";
+	const char* columns = "ABCDEFGHJKLMNOPQRSTUVWXYZ";
+	return columns[move % BOARD_SIZE] + std::to_string(BOARD_SIZE - move / BOARD_SIZE);
+}
+
+static std::string sgf_point(int move) {
+	if (move == PASS_INDEX)
+		return "";
+	return {(char)('a' + move % BOARD_SIZE), (char)('a' + move / BOARD_SIZE)};
+}
+
+// The value of name in a query string like "a=1&b=2", or fallback.
+static int query_int(const std::string& query, const std::string& name, int fallback) {
+	std::istringstream in(query);
+	std::string pair;
+	while (std::getline(in, pair, '&')) {
+		if (pair.compare(0, name.size() + 1, name + "=") != 0)
+			continue;
+		try {
+			return std::stoi(pair.substr(name.size() + 1));
+		} catch (std::exception& e) {
+			return fallback;
+		}
+	}
+	return fallback;
+}
+
+static std::string format_analysis(const AnalysisPosition& position, const float* policy, const std::string& query, int batch_size) {
+	int top_count = std::max(0, std::min(query_int(query, "top", DEFAULT_TOP_MOVES), POLICY_SIZE));
+	std::vector<int> moves(POLICY_SIZE);
+	for (int move = 0; move < POLICY_SIZE; move++)
+		moves[move] = move;
+	std::partial_sort(moves.begin(), moves.begin() + top_count, moves.end(), [&](int a, int b) { return policy[a] > policy[b]; });
+
+	std::string json;
+	char number[64];
+	json += std::string("{\"to_move\":\"") + (position.to_move == Player::BLACK ? "B" : "W") + "\"";
+	json += ",\"move_number\":" + std::to_string(position.move_number);
+	json += ",\"batch_size\":" + std::to_string(batch_size);
+	json += ",\"top_moves\":[";
+	for (int i = 0; i < top_count and policy[moves[i]] > 0; i++) {
+		snprintf(number, sizeof(number), "%.6f", policy[moves[i]]);
+		json += std::string(i == 0 ? "" : ",") + "{\"move\":\"" + gtp_vertex(moves[i]) + "\",\"sgf\":\"" + sgf_point(moves[i]) + "\",\"prior\":" + number + "}";
+	}
+	json += "]";
+	if (query_int(query, "policy", 1)) {
+		// Row by row from the top, then pass.
+		json += ",\"policy\":[";
+		for (int move = 0; move < POLICY_SIZE; move++) {
+			snprintf(number, sizeof(number), "%s%.6g", move == 0 ? "" : ",", policy[move]);
+			json += number;
+		}
+		json += "]";
+	}
+	json += "}\n";
+	return json;
+}
+
+static std::string http_response(int status, const std::string& body, bool keep_alive, const char* content_type = "application/json") {
+	const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" :
+		status == 405 ? "Method Not Allowed" : status == 413 ? "Payload Too Large" : status == 431 ? "Request Header Fields Too Large" :
+		status == 501 ? "Not Implemented" : "Error";
+	std::string response = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n";
+	response += std::string("Content-Type: ") + content_type + "\r\n";
+	response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+	response += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+	return response + body;
+}
+
+static std::string error_json(const std::string& message) {
+	std::string escaped;
+	for (char c : message)
+		if (c != '"' and c != '\\' and (unsigned char)c >= 0x20)
+			escaped += c;
+	return "{\"error\":\"" + escaped + "\"}\n";
+}
+
+// A complete /analyze request, handed from the event loop to the evaluator threads.
+struct Job {
+	int fd;
+	uint64_t connection_id;
+	std::string query, body;
+	bool keep_alive;
+	Clock::time_point arrival;
+};
+
+// A finished response, handed back for the event loop to write.
+struct Completion {
+	int fd;
+	uint64_t connection_id;
+	std::string response;
+	bool keep_alive;
+	Clock::time_point arrival;
+	// Requests coalesced with this one, including any that failed to parse.
+	int batch_size;
+	bool failed;
+};
+
+// Coalesces jobs into batches: a batch goes as soon as it's full, or once its oldest job has waited max_wait.
+class BatchQueue {
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Job> jobs;
+	bool stopping = false;
+	size_t max_batch;
+	Clock::duration max_wait;
+
+public:
+	BatchQueue(int max_batch, int max_wait_us) : max_batch(max_batch), max_wait(std::chrono::microseconds(max_wait_us)) {}
+
+	void push(Job job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+		size_t size = jobs.size();
+		lock.unlock();
+		// One waiter is enough to start the clock on a new batch, but a full batch shouldn't wait for anyone's timeout.
+		if (size == 1)
+			changed.notify_one();
+		else if (size >= max_batch)
+			changed.notify_all();
+	}
+
+	// Returns false once stopped.
+	bool take_batch(std::vector<Job>& batch) {
+		batch.clear();
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed.wait(lock, [&] { return stopping or not jobs.empty(); });
+			if (stopping)
+				return false;
+			Clock::time_point deadline = jobs.front().arrival + max_wait;
+			changed.wait_until(lock, deadline, [&] { return stopping or jobs.size() >= max_batch; });
+			if (stopping)
+				return false;
+			// Another thread may have taken them all while this one waited.
+			if (not jobs.empty())
+				break;
+		}
+		while (not jobs.empty() and batch.size() < max_batch) {
+			batch.push_back(std::move(jobs.front()));
+			jobs.pop_front();
+		}
+		return true;
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+	}
+};
+
+// Completions waiting for the event loop, which is woken through an eventfd.
+class CompletionQueue {
+	std::mutex mutex;
+	std::vector<Completion> completions;
+
+public:
+	int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	void push(std::vector<Completion>& batch) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (Completion& completion : batch)
+				completions.push_back(std::move(completion));
+		}
+		uint64_t one = 1;
+		if (write(event_fd, &one, sizeof(one)) < 0 and errno != EAGAIN)
+			perror("eventfd write");
+	}
+
+	void take(std::vector<Completion>& taken) {
+		uint64_t count;
+		if (read(event_fd, &count, sizeof(count)) < 0 and errno != EAGAIN)
+			perror("eventfd read");
+		std::lock_guard<std::mutex> lock(mutex);
+		taken.swap(completions);
+	}
+};
+
+static void run_evaluator(BatchQueue& queue, CompletionQueue& completions) {
+	FeaturePriorEvaluator evaluator;
+	std::vector<Job> jobs;
+	std::vector<Completion> done;
+	std::vector<float> policies;
+	while (queue.take_batch(jobs)) {
+		std::vector<std::unique_ptr<AnalysisPosition>> positions(jobs.size());
+		std::vector<std::string> errors(jobs.size());
+		std::vector<AnalysisPosition*> batch;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			positions[i].reset(new AnalysisPosition);
+			const std::string& body = jobs[i].body;
+			size_t start = body.find_first_not_of(" \t\r\n");
+			bool is_sgf = start != std::string::npos and body[start] == '(';
+			bool parsed = is_sgf ? parse_sgf_position(body, *positions[i], errors[i]) : parse_diagram_position(body, *positions[i], errors[i]);
+			if (parsed and check_liberties(*positions[i], errors[i]))
+				batch.push_back(positions[i].get());
+		}
+		policies.resize(batch.size() * POLICY_SIZE);
+		if (not batch.empty())
+			evaluator.evaluate(batch, policies.data());
+
+		size_t evaluated = 0;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			Job& job = jobs[i];
+			bool failed = not errors[i].empty();
+			std::string body = failed ? error_json(errors[i]) : format_analysis(*positions[i], &policies[evaluated++ * POLICY_SIZE], job.query, batch.size());
+			done.push_back({job.fd, job.connection_id, http_response(failed ? 400 : 200, body, job.keep_alive), job.keep_alive, job.arrival, (int)jobs.size(), failed});
+		}
+		completions.push(done);
+		done.clear();
+	}
+}
+
+// Request latencies and counts since the last report, kept by the event loop thread alone.
+struct ServerStats {
+	Clock::time_point window_start = Clock::now();
+	std::vector<double> latencies_ms;
+	uint64_t batched_requests = 0, failed_requests = 0;
+	uint64_t total_requests = 0;
+
+	void record(const Completion& completion) {
+		latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - completion.arrival).count());
+		batched_requests += completion.batch_size;
+		failed_requests += completion.failed;
+		total_requests++;
+	}
+
+	std::string summary_json() {
+		double seconds = std::chrono::duration<double>(Clock::now() - window_start).count();
+		std::vector<double> sorted = latencies_ms;
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&](double q) { return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))]; };
+		char json[512];
+		snprintf(json, sizeof(json),
+			"{\"total_requests\":%llu,\"window_seconds\":%.3f,\"requests\":%zu,\"failed\":%llu,\"requests_per_second\":%.1f,"
+			"\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"mean_batch_size\":%.2f}\n",
+			(unsigned long long)total_requests, seconds, sorted.size(), (unsigned long long)failed_requests, sorted.size() / seconds,
+			percentile(0.5), percentile(0.99), sorted.empty() ? 0.0 : (double)batched_requests / sorted.size());
+		return json;
+	}
+
+	void report_and_reset() {
+		if (not latencies_ms.empty())
+			std::cout << summary_json() << std::flush;
+		latencies_ms.clear();
+		batched_requests = failed_requests = 0;
+		window_start = Clock::now();
+	}
+};
+
+struct Connection {
+	uint64_t id;
+	std::string input, output;
+	size_t output_sent = 0;
+	// At most one request per connection is with the evaluators at a time, so pipelined responses stay in order.
+	bool in_flight = false;
+	bool close_after_write = false;
+	bool continue_sent = false;
+	uint32_t events = 0;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+	stop_requested = 1;
+}
+
+class AnalysisServer {
+	ServerConfig config;
+	int listen_fd = -1, epoll_fd = -1;
+	uint64_t next_connection_id = 1;
+	std::unordered_map<int, Connection> connections;
+	BatchQueue queue;
+	CompletionQueue completions;
+	ServerStats stats;
+
+	void set_events(int fd, Connection& connection) {
+		uint32_t events = 0;
+		if (not connection.in_flight and not connection.close_after_write)
+			events |= EPOLLIN;
+		if (connection.output_sent < connection.output.size())
+			events |= EPOLLOUT;
+		if (events == connection.events)
+			return;
+		epoll_event event{};
+		event.events = events;
+		event.data.fd = fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+		connection.events = events;
+	}
+
+	void close_connection(int fd) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		close(fd);
+		connections.erase(fd);
+	}
+
+	void accept_connections() {
+		while (true) {
+			int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0) {
+				if (errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR)
+					perror("accept");
+				return;
+			}
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			Connection& connection = connections[fd];
+			connection = Connection();
+			connection.id = next_connection_id++;
+			connection.events = EPOLLIN;
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+		}
+	}
+
+	// Returns false if the connection was closed.
+	bool flush(int fd, Connection& connection) {
+		while (connection.output_sent < connection.output.size()) {
+			ssize_t sent = send(fd, connection.output.data() + connection.output_sent, connection.output.size() - connection.output_sent, MSG_NOSIGNAL);
+			if (sent < 0) {
+				if (errno == EAGAIN or errno == EWOULDBLOCK)
+					break;
+				if (errno == EINTR)
+					continue;
+				close_connection(fd);
+				return false;
+			}
+			connection.output_sent += sent;
+		}
+		if (connection.output_sent == connection.output.size()) {
+			connection.output.clear();
+			connection.output_sent = 0;
+			if (connection.close_after_write) {
+				close_connection(fd);
+				return false;
+			}
+		}
+		set_events(fd, connection);
+		return true;
+	}
+
+	void respond(Connection& connection, int status, const std::string& body, bool keep_alive) {
+		connection.output += http_response(status, body, keep_alive);
+		connection.close_after_write |= not keep_alive;
+	}
+
+	// Dispatches every complete request at the front of the connection's input that can be dispatched now.
+	// Returns false if the connection was closed.
+	bool handle_input(int fd, Connection& connection) {
+		while (not connection.in_flight and not connection.close_after_write) {
+			size_t head_end = connection.input.find("\r\n\r\n");
+			if (head_end == std::string::npos) {
+				if (connection.input.size() > MAX_HEAD_BYTES)
+					respond(connection, 431, error_json("request head too large"), false);
+				break;
+			}
+			std::istringstream head(connection.input.substr(0, head_end));
+			std::string line, method, target, version;
+			std::getline(head, line);
+			std::istringstream(line) >> method >> target >> version;
+			bool keep_alive = version == "HTTP/1.1";
+			size_t content_length = 0;
+			bool chunked = false, expect_continue = false;
+			while (std::getline(head, line)) {
+				size_t colon = line.find(':');
+				if (colon == std::string::npos)
+					continue;
+				std::string name = line.substr(0, colon), value = line.substr(colon + 1);
+				std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+				std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+				value.erase(0, value.find_first_not_of(" \t"));
+				value.erase(value.find_last_not_of(" \t\r") + 1);
+				if (name == "content-length")
+					content_length = std::strtoull(value.c_str(), nullptr, 10);
+				else if (name == "connection")
+					keep_alive = value == "close" ? false : value == "keep-alive" ? true : keep_alive;
+				else if (name == "transfer-encoding")
+					chunked = value != "identity";
+				else if (name == "expect")
+					expect_continue = value == "100-continue";
+			}
+			if (method.empty() or version.compare(0, 5, "HTTP/") != 0) {
+				respond(connection, 400, error_json("malformed request line"), false);
+				break;
+			}
+			if (chunked) {
+				respond(connection, 501, error_json("chunked request bodies aren't supported"), false);
+				break;
+			}
+			if (content_length > MAX_BODY_BYTES) {
+				respond(connection, 413, error_json("request body too large"), false);
+				break;
+			}
+			size_t request_end = head_end + 4 + content_length;
+			if (connection.input.size() < request_end) {
+				if (expect_continue and not connection.continue_sent) {
+					connection.output += "HTTP/1.1 100 Continue\r\n\r\n";
+					connection.continue_sent = true;
+				}
+				break;
+			}
+			std::string body = connection.input.substr(head_end + 4, content_length);
+			connection.input.erase(0, request_end);
+			connection.continue_sent = false;
+
+			size_t question = target.find('?');
+			std::string path = target.substr(0, question), query = question == std::string::npos ? "" : target.substr(question + 1);
+			if (path == "/analyze" and method == "POST") {
+				connection.in_flight = true;
+				queue.push({fd, connection.id, query, std::move(body), keep_alive, Clock::now()});
+			} else if (path == "/stats" and method == "GET") {
+				respond(connection, 200, stats.summary_json(), keep_alive);
+			} else if (path == "/analyze" or path == "/stats") {
+				respond(connection, 405, error_json("use POST /analyze or GET /stats"), keep_alive);
+			} else {
+				respond(connection, 404, error_json("no such endpoint; use POST /analyze or GET /stats"), keep_alive);
+			}
+		}
+		return flush(fd, connection);
+	}
+
+	void read_input(int fd, Connection& connection) {
+		char buffer[64 << 10];
+		while (true) {
+			ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+			if (received > 0) {
+				connection.input.append(buffer, received);
+				continue;
+			}
+			if (received < 0 and errno == EINTR)
+				continue;
+			if (received < 0 and (errno == EAGAIN or errno == EWOULDBLOCK))
+				break;
+			// The client hung up (or the connection failed), and any request it left in flight is dropped on return.
+			close_connection(fd);
+			return;
+		}
+		handle_input(fd, connection);
+	}
+
+	void deliver_completions() {
+		std::vector<Completion> taken;
+		completions.take(taken);
+		for (Completion& completion : taken) {
+			stats.record(completion);
+			auto it = connections.find(completion.fd);
+			// The connection may have closed, and its descriptor even been reused, while the job was out.
+			if (it == connections.end() or it->second.id != completion.connection_id)
+				continue;
+			Connection& connection = it->second;
+			connection.in_flight = false;
+			connection.output += completion.response;
+			connection.close_after_write |= not completion.keep_alive;
+			handle_input(completion.fd, connection);
+		}
+	}
+
+public:
+	AnalysisServer(const ServerConfig& config) : config(config), queue(config.max_batch, config.max_wait_us) {}
+
+	bool listen_on_port() {
+		listen_fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		int one = 1, zero = 0;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		// Take IPv4 connections too.
+		setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+		sockaddr_in6 address{};
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(config.port);
+		if (listen_fd < 0 or bind(listen_fd, (sockaddr*)&address, sizeof(address)) < 0 or listen(listen_fd, SOMAXCONN) < 0) {
+			std::cerr << "Couldn't listen on port " << config.port << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void run() {
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		for (int fd : {listen_fd, completions.event_fd}) {
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+		}
+		std::vector<std::thread> evaluators;
+		for (int t = 0; t < config.evaluator_threads; t++)
+			evaluators.emplace_back(run_evaluator, std::ref(queue), std::ref(completions));
+
+		auto next_report = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.report_seconds));
+		epoll_event events[256];
+		while (not stop_requested) {
+			int timeout_ms = std::max(0, (int)std::chrono::duration_cast<std::chrono::milliseconds>(next_report - Clock::now()).count() + 1);
+			int ready = epoll_wait(epoll_fd, events, 256, timeout_ms);
+			if (ready < 0 and errno != EINTR) {
+				perror("epoll_wait");
+				break;
+			}
+			for (int i = 0; i < ready; i++) {
+				int fd = events[i].data.fd;
+				if (fd == listen_fd) {
+					accept_connections();
+					continue;
+				}
+				if (fd == completions.event_fd) {
+					deliver_completions();
+					continue;
+				}
+				auto it = connections.find(fd);
+				if (it == connections.end())
+					continue;
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+					close_connection(fd);
+					continue;
+				}
+				if ((events[i].events & EPOLLOUT) and not flush(fd, it->second))
+					continue;
+				if (events[i].events & EPOLLIN)
+					read_input(fd, it->second);
+			}
+			if (Clock::now() >= next_report) {
+				stats.report_and_reset();
+				next_report = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.report_seconds));
+			}
+		}
+
+		queue.stop();
+		for (std::thread& thread : evaluators)
+			thread.join();
+		stats.report_and_reset();
+		for (auto& entry : connections)
+			close(entry.first);
+		close(listen_fd);
+		close(epoll_fd);
+	}
+};
+
+int main(int argc, char** argv) {
+	ServerConfig config;
+	bool bad_options = false;
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--port")
+			config.port = std::stoi(argv[++i]);
+		else if (option == "--max-batch")
+			config.max_batch = std::stoi(argv[++i]);
+		else if (option == "--max-wait-us")
+			config.max_wait_us = std::stoi(argv[++i]);
+		else if (option == "--evaluator-threads")
+			config.evaluator_threads = std::stoi(argv[++i]);
+		else if (option == "--report-seconds")
+			config.report_seconds = std::stod(argv[++i]);
+		else
+			bad_options = true;
+	}
+	if (bad_options or config.max_batch < 1 or config.max_wait_us < 0 or config.evaluator_threads < 1 or not (config.report_seconds > 0)) {
+		std::cerr << "Usage: analysis_server [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Serves HTTP/1.1 on every interface. POST /analyze takes an SGF (analysing the position after its last move) or a" << std::endl;
+		std::cerr << "board diagram of " << BOARD_SIZE << " rows of '.', 'X' and 'O', optionally followed by a line \"to_move white\", and returns" << std::endl;
+		std::cerr << "JSON with the top moves and the whole policy. Add ?top=n for more or fewer top moves and ?policy=0 to leave the" << std::endl;
+		std::cerr << "policy out. GET /stats returns request rate, p50/p99 latency and mean batch size, which are also printed as JSON" << std::endl;
+		std::cerr << "every report interval. Concurrent requests are coalesced into batches for the evaluator." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --port n               Port to listen on (default 13697)." << std::endl;
+		std::cerr << "  --max-batch n          Most positions evaluated in one call (default 64)." << std::endl;
+		std::cerr << "  --max-wait-us n        Longest a request waits for its batch to fill, in microseconds (default 2000)." << std::endl;
+		std::cerr << "  --evaluator-threads n  Threads forming and evaluating batches (default 1)." << std::endl;
+		std::cerr << "  --report-seconds s     Interval between printed statistics (default 10)." << std::endl;
+		return 1;
+	}
+
+	AnalysisServer server(config);
+	if (not server.listen_on_port())
+		return 1;
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+	std::cerr << "Listening on port " << config.port << "." << std::endl;
+	server.run();
+}
@@ -0,0 +1,144 @@
+// Benchmark feature extraction on a deterministic set of random positions.
+
+#include "go_utils.h"
+#include "feature_extraction.h"
+#include "plane_emission.h"
+#include "ladder.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+constexpr int POSITION_COUNT = 64;
+
+struct Position {
+	GoBoard board;
+	FeatureExtractor feature_extractor;
+	Player to_move = Player::BLACK;
+};
+
+// Play uniformly random moves on empty points, which is plenty to get realistic group and liberty structure.
+static void make_random_positions(std::vector<Position>& positions, std::mt19937& rng) {
+	positions.resize(POSITION_COUNT);
+	for (Position& position : positions) {
+		int move_count = std::uniform_int_distribution<int>(20, 250)(rng);
+		for (int move = 0; move < move_count; move++) {
+			std::vector<Coord> empty;
+			for (int y = 0; y < BOARD_SIZE; y++)
+				for (int x = 0; x < BOARD_SIZE; x++)
+					if (piece_at(position.board, {x, y}) == 0)
+						empty.push_back({x, y});
+			if (empty.empty())
+				break;
+			Coord xy = empty[std::uniform_int_distribution<int>(0, empty.size() - 1)(rng)];
+			position.board.place_stone(position.to_move, xy);
+			position.feature_extractor.add_move_to_history(xy);
+			position.to_move = opponent_of(position.to_move);
+		}
+	}
+}
+
+template <typename F>
+static double nanoseconds_per_call(int calls, F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < calls; i++)
+		f(i);
+	auto stop = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(stop - start).count() / calls;
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? std::stoi(argv[1]) : 20000;
+
+	std::mt19937 rng(12345);
+	std::vector<Position> positions;
+	make_random_positions(positions, rng);
+
+	// Compute reference features with the scalar kernel so every other kernel can be checked against it.
+	std::vector<std::vector<uint8_t>> reference(POSITION_COUNT, std::vector<uint8_t>(TOTAL_FEATURES));
+	set_emission_kernel(EmissionKernel::SCALAR);
+	for (int i = 0; i < POSITION_COUNT; i++)
+		positions[i].feature_extractor.fill_features(&reference[i][0], positions[i].board, positions[i].to_move);
+
+	// Precompute point states so emission can be timed on its own.
+	std::vector<PointStates> states(POSITION_COUNT);
+	for (int i = 0; i < POSITION_COUNT; i++)
+		positions[i].feature_extractor.gather_point_states(states[i], positions[i].board, positions[i].to_move);
+
+	std::vector<uint8_t> features(TOTAL_FEATURES);
+	double gather_ns = nanoseconds_per_call(iterations, [&](int i) {
+		Position& position = positions[i % POSITION_COUNT];
+		position.feature_extractor.gather_point_states(states[i % POSITION_COUNT], position.board, position.to_move);
+	});
+
+	// Ladder reading is part of the gather; time it on its own to see what the ladder planes cost.
+	LadderReader ladder_reader;
+	double ladder_ns = nanoseconds_per_call(iterations, [&](int i) {
+		Position& position = positions[i % POSITION_COUNT];
+		PointStates& s = states[i % POSITION_COUNT];
+		std::fill(std::begin(s.ladder_captures), std::end(s.ladder_captures), 0);
+		std::fill(std::begin(s.ladder_escapes), std::end(s.ladder_escapes), 0);
+		fill_ladder_points(ladder_reader, position.board.cells, s.colour, s.liberties, s.ladder_captures, s.ladder_escapes);
+	});
+
+	// Loading a whole position, as the API does: stone by stone in raster order, or all at once with from_cells.
+	set_emission_kernel(EmissionKernel::SCALAR);
+	for (int i = 0; i < POSITION_COUNT; i++) {
+		GoBoard loaded = GoBoard::from_cells(positions[i].board.cells);
+		FeatureExtractor feature_extractor = positions[i].feature_extractor;
+		feature_extractor.fill_features(&features[0], loaded, positions[i].to_move);
+		if (features != reference[i]) {
+			std::cerr << "Bulk loaded board disagrees with the played board on position " << i << std::endl;
+			return 1;
+		}
+	}
+	double place_stone_ns = nanoseconds_per_call(iterations / 10, [&](int i) {
+		const GoBoard& position_board = positions[i % POSITION_COUNT].board;
+		GoBoard board;
+		for (int y = 0; y < BOARD_SIZE; y++)
+			for (int x = 0; x < BOARD_SIZE; x++)
+				if (piece_at(position_board, {x, y}) != 0)
+					board.place_stone((Player)piece_at(position_board, {x, y}), {x, y});
+	});
+	double from_cells_ns = nanoseconds_per_call(iterations / 10, [&](int i) {
+		GoBoard board = GoBoard::from_cells(positions[i % POSITION_COUNT].board.cells);
+	});
+
+	printf("Positions: %i  Iterations: %i  Planes: %i  Bytes/sample: %i\n", POSITION_COUNT, iterations, FEATURE_COUNT, TOTAL_FEATURES);
+	printf("Point state gather: %10.1f ns/sample\n", gather_ns);
+	printf("  of which ladders: %10.1f ns/sample (%.1f%%)\n", ladder_ns, 100.0 * ladder_ns / gather_ns);
+	printf("Load by place_stone: %9.1f ns/position\n", place_stone_ns);
+	printf("Load by from_cells: %10.1f ns/position\n", from_cells_ns);
+	printf("%-8s %18s %18s\n", "kernel", "emit ns/sample", "total ns/sample");
+	for (EmissionKernel kernel : {EmissionKernel::SCALAR, EmissionKernel::AVX2, EmissionKernel::AVX512}) {
+		if (not emission_kernel_supported(kernel)) {
+			printf("%-8s %18s %18s\n", emission_kernel_name(kernel), "unsupported", "unsupported");
+			continue;
+		}
+		set_emission_kernel(kernel);
+		for (int i = 0; i < POSITION_COUNT; i++) {
+			positions[i].feature_extractor.fill_features(&features[0], positions[i].board, positions[i].to_move);
+			if (features != reference[i]) {
+				std::cerr << "Kernel " << emission_kernel_name(kernel) << " disagrees with scalar on position " << i << std::endl;
+				return 1;
+			}
+		}
+
+		// Emission alone, from precomputed point states and without the history scatter.
+		double emit_ns = nanoseconds_per_call(iterations * 10, [&](int i) {
+			PlaneRule rules[FEATURE_COUNT];
+			FeatureExtractor::make_plane_rules(rules, states[i % POSITION_COUNT]);
+			emit_planes(rules, FEATURE_COUNT, &features[0]);
+		});
+		double total_ns = nanoseconds_per_call(iterations, [&](int i) {
+			Position& position = positions[i % POSITION_COUNT];
+			position.feature_extractor.fill_features(&features[0], position.board, position.to_move);
+		});
+		printf("%-8s %18.1f %18.1f\n", emission_kernel_name(kernel), emit_ns, total_ns);
+	}
+	printf("Dispatch selects: %s\n", emission_kernel_name(best_emission_kernel()));
+}
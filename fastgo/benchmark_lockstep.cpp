@@ -0,0 +1,174 @@
+// Benchmark replaying games and extracting features in lockstep against the scalar GoBoard path.
+
+#include "go_utils.h"
+#include "feature_extraction.h"
+#include "plane_emission.h"
+#include "lockstep.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+// A move as a point (x + y * BOARD_SIZE), or -1 for a pass.
+struct BenchmarkMove {
+	int16_t point;
+	Player who;
+};
+
+typedef std::vector<BenchmarkMove> BenchmarkGame;
+
+// Random legal moves with the odd pass, which is plenty to get realistic group, capture and ko structure.
+static void make_random_games(std::vector<BenchmarkGame>& games, int game_count, std::mt19937& rng) {
+	games.resize(game_count);
+	for (BenchmarkGame& game : games) {
+		GoBoard board;
+		Player to_move = Player::BLACK;
+		int move_count = std::uniform_int_distribution<int>(50, 300)(rng);
+		for (int move = 0; move < move_count; move++) {
+			std::vector<int> legal;
+			for (int point = 0; point < POINT_COUNT; point++)
+				if (board.is_legal(to_move, {point % BOARD_SIZE, point / BOARD_SIZE}))
+					legal.push_back(point);
+			if (legal.empty() or std::uniform_int_distribution<int>(0, 49)(rng) == 0) {
+				game.push_back({-1, to_move});
+			} else {
+				int point = legal[std::uniform_int_distribution<int>(0, legal.size() - 1)(rng)];
+				board.place_stone(to_move, {point % BOARD_SIZE, point / BOARD_SIZE});
+				game.push_back({(int16_t)point, to_move});
+			}
+			to_move = opponent_of(to_move);
+		}
+	}
+}
+
+static uint64_t hash_features(const uint8_t* features) {
+	uint64_t hash = 0;
+	for (int i = 0; i < TOTAL_FEATURES; i++)
+		hash = splitmix64(hash ^ features[i]);
+	return hash;
+}
+
+// Replays every game with GoBoard, and if featurise, uses FeatureExtractor on the position before every move that
+// isn't a pass. With hashes, records a hash of each position's features.
+static double scalar_replay(const std::vector<BenchmarkGame>& games, bool featurise, std::vector<std::vector<uint64_t>>* hashes) {
+	std::vector<uint8_t> features(TOTAL_FEATURES);
+	auto start = std::chrono::steady_clock::now();
+	for (size_t g = 0; g < games.size(); g++) {
+		GoBoard board;
+		FeatureExtractor feature_extractor;
+		for (const BenchmarkMove& m : games[g]) {
+			if (m.point < 0) {
+				feature_extractor.add_move_to_history({-1, -1});
+				continue;
+			}
+			Coord xy = {m.point % BOARD_SIZE, m.point / BOARD_SIZE};
+			if (featurise)
+				feature_extractor.fill_features(&features[0], board, m.who);
+			if (hashes != nullptr)
+				(*hashes)[g].push_back(hash_features(&features[0]));
+			board.place_stone(m.who, xy);
+			feature_extractor.add_move_to_history(xy);
+		}
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The same replay with LANES games at a time, refilling each lane with the next game as soon as its game ends.
+// With hashes, checks every position's features against them, and returns a negative time on any disagreement.
+template <int LANES>
+static double lockstep_replay(const std::vector<BenchmarkGame>& games, bool featurise, const std::vector<std::vector<uint64_t>>* hashes) {
+	typedef LockstepBoardsOfSize<BOARD_SIZE, LANES> Boards;
+	std::unique_ptr<Boards> boards(new Boards);
+	std::vector<uint8_t> features(LANES * TOTAL_FEATURES);
+	int lane_game[LANES], lane_move[LANES], lane_sample[LANES];
+	std::fill(lane_game, lane_game + LANES, -1);
+	size_t next_game = 0;
+	bool agrees = true;
+
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		Player perspective[LANES];
+		typename Boards::LaneMove moves[LANES];
+		bool any_active = false;
+		for (int lane = 0; lane < LANES; lane++) {
+			if (lane_game[lane] < 0 or lane_move[lane] == (int)games[lane_game[lane]].size()) {
+				lane_game[lane] = next_game < games.size() ? next_game++ : -1;
+				lane_move[lane] = lane_sample[lane] = 0;
+				if (lane_game[lane] >= 0)
+					boards->reset_lane(lane, {});
+			}
+			if (lane_game[lane] < 0) {
+				perspective[lane] = Player::NOBODY;
+				moves[lane] = {Boards::IDLE, Player::NOBODY};
+				continue;
+			}
+			any_active = true;
+			const BenchmarkMove& m = games[lane_game[lane]][lane_move[lane]++];
+			perspective[lane] = m.point < 0 ? Player::NOBODY : m.who;
+			moves[lane] = {m.point < 0 ? Boards::PASS : m.point, m.who};
+		}
+		if (not any_active)
+			break;
+
+		if (featurise)
+			boards->fill_features(&features[0], perspective);
+		for (int lane = 0; hashes != nullptr and lane < LANES; lane++)
+			if (perspective[lane] != Player::NOBODY)
+				agrees &= hash_features(&features[lane * TOTAL_FEATURES]) == (*hashes)[lane_game[lane]][lane_sample[lane]++];
+		boards->play(moves);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return agrees ? seconds : -1;
+}
+
+int main(int argc, char** argv) {
+	int game_count = argc > 1 ? std::stoi(argv[1]) : 256;
+
+	std::mt19937 rng(12345);
+	std::vector<BenchmarkGame> games;
+	make_random_games(games, game_count, rng);
+	uint64_t positions = 0;
+	for (const BenchmarkGame& game : games)
+		positions += std::count_if(game.begin(), game.end(), [](const BenchmarkMove& m) { return m.point >= 0; });
+
+	// Check every kernel and width against the scalar path before timing anything.
+	std::vector<std::vector<uint64_t>> hashes(games.size());
+	scalar_replay(games, true, &hashes);
+	for (EmissionKernel kernel : {EmissionKernel::SCALAR, EmissionKernel::AVX2, EmissionKernel::AVX512}) {
+		if (not emission_kernel_supported(kernel))
+			continue;
+		set_emission_kernel(kernel);
+		if (lockstep_replay<8>(games, true, &hashes) < 0 or lockstep_replay<16>(games, true, &hashes) < 0 or lockstep_replay<32>(games, true, &hashes) < 0) {
+			std::cerr << "Lockstep replay with the " << emission_kernel_name(kernel) << " kernel disagrees with GoBoard." << std::endl;
+			return 1;
+		}
+	}
+
+	// Replay alone is where lockstep wins most; with features, the per-lane ladder reading takes most of the time either way.
+	printf("Games: %i  Positions: %llu\n", game_count, (unsigned long long)positions);
+	set_emission_kernel(best_emission_kernel());
+	double scalar_replay_seconds = scalar_replay(games, false, nullptr);
+	double scalar_feature_seconds = scalar_replay(games, true, nullptr);
+	printf("%-8s %6s %18s %18s\n", "kernel", "lanes", "replay pos/s", "features pos/s");
+	printf("%-8s %6s %18.0f %18.0f\n", "GoBoard", "1", positions / scalar_replay_seconds, positions / scalar_feature_seconds);
+	for (EmissionKernel kernel : {EmissionKernel::SCALAR, EmissionKernel::AVX2, EmissionKernel::AVX512}) {
+		if (not emission_kernel_supported(kernel)) {
+			printf("%-8s %6s %18s %18s\n", emission_kernel_name(kernel), "", "unsupported", "unsupported");
+			continue;
+		}
+		set_emission_kernel(kernel);
+		int widths[] = {8, 16, 32};
+		double replay_seconds[] = {lockstep_replay<8>(games, false, nullptr), lockstep_replay<16>(games, false, nullptr), lockstep_replay<32>(games, false, nullptr)};
+		double feature_seconds[] = {lockstep_replay<8>(games, true, nullptr), lockstep_replay<16>(games, true, nullptr), lockstep_replay<32>(games, true, nullptr)};
+		for (int i = 0; i < 3; i++) {
+			printf("%-8s %6i %11.0f (%4.1fx) %11.0f (%4.2fx)\n", emission_kernel_name(kernel), widths[i],
+				positions / replay_seconds[i], scalar_replay_seconds / replay_seconds[i],
+				positions / feature_seconds[i], scalar_feature_seconds / feature_seconds[i]);
+		}
+	}
+}
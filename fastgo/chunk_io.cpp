@@ -0,0 +1,494 @@
+// Reading and writing zlib-compressed chunk files.
+
+#include "chunk_io.h"
+#include <chrono>
+#include <numeric>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <zlib.h>
+#include <immintrin.h>
+#include <boost/filesystem.hpp>
+
+ChunkWriter::ChunkWriter(std::string path, int compression_level) : file(path, std::ios_base::out | std::ios_base::binary) {
+	stream.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib_params(compression_level)));
+	stream.push(file);
+}
+
+void ChunkWriter::write(const char* data, std::streamsize length) {
+	stream.write(data, length);
+}
+
+void SampleBuffer::write(int stream, const char* data, std::streamsize length) {
+	if ((int)streams.size() <= stream)
+		streams.resize(stream + 1);
+	streams[stream].insert(streams[stream].end(), data, data + length);
+}
+
+void SampleBuffer::advance() {
+	sample_ends.emplace_back();
+	for (const std::vector<char>& stream : streams)
+		sample_ends.back().push_back(stream.size());
+}
+
+void SampleBuffer::flush_to(SampleSink& sink) {
+	std::vector<size_t> starts(streams.size(), 0);
+	for (const std::vector<size_t>& ends : sample_ends) {
+		for (size_t stream = 0; stream < ends.size(); stream++) {
+			if (ends[stream] > starts[stream])
+				sink.write(stream, &streams[stream][starts[stream]], ends[stream] - starts[stream]);
+			starts[stream] = ends[stream];
+		}
+		sink.advance();
+	}
+	for (std::vector<char>& stream : streams)
+		stream.clear();
+	sample_ends.clear();
+}
+
+RecordChunkWriter::RecordChunkWriter(std::string path, const std::vector<uint32_t>& part_bytes, int compression_level)
+	: file(path, std::ios_base::out | std::ios_base::binary), compression_level(compression_level)
+{
+	uint32_t part_count = part_bytes.size();
+	record_bytes = RECORD_HEADER_BYTES + std::accumulate(part_bytes.begin(), part_bytes.end(), 0u);
+	file.write(RECORD_CHUNK_MAGIC, sizeof(RECORD_CHUNK_MAGIC));
+	file.write(reinterpret_cast<const char*>(&part_count), sizeof(part_count));
+	file.write(reinterpret_cast<const char*>(part_bytes.data()), part_count * sizeof(uint32_t));
+}
+
+void RecordChunkWriter::write_block(const char* records, size_t length) {
+	assert(length % record_bytes == 0 and length <= UINT32_MAX);
+	uLongf compressed_bytes = compressBound(length);
+	std::vector<Bytef> compressed(compressed_bytes);
+	int status = compress2(compressed.data(), &compressed_bytes, reinterpret_cast<const Bytef*>(records), length, compression_level);
+	assert(status == Z_OK);
+	uint32_t header[4] = {
+		(uint32_t)(length / record_bytes),
+		(uint32_t)compressed_bytes,
+		(uint32_t)length,
+		(uint32_t)crc32(0, reinterpret_cast<const Bytef*>(records), length),
+	};
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(compressed.data()), compressed_bytes);
+}
+
+static constexpr std::array<uint32_t, 256> make_crc32c_table() {
+	std::array<uint32_t, 256> table = {};
+	for (uint32_t byte = 0; byte < 256; byte++) {
+		uint32_t crc = byte;
+		for (int bit = 0; bit < 8; bit++)
+			crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+		table[byte] = crc;
+	}
+	return table;
+}
+
+static constexpr std::array<uint32_t, 256> CRC32C_TABLE = make_crc32c_table();
+
+static uint32_t crc32c_scalar(uint32_t crc, const char* data, size_t length) {
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+		crc = CRC32C_TABLE[(crc ^ (uint8_t)data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const char* data, size_t length) {
+	uint64_t state = ~crc;
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		state = _mm_crc32_u64(state, word);
+	}
+	for (; i < length; i++)
+		state = _mm_crc32_u8(state, data[i]);
+	return ~(uint32_t)state;
+}
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t length) {
+	static const bool sse42 = __builtin_cpu_supports("sse4.2");
+	return sse42 ? crc32c_sse42(crc, data, length) : crc32c_scalar(crc, data, length);
+}
+
+// TFRecord stores its checksums rotated and offset, as checksumming data that holds checksums is otherwise error prone.
+static uint32_t masked_crc32c(const char* data, size_t length) {
+	uint32_t crc = crc32c(0, data, length);
+	return ((crc >> 15) | (crc << 17)) + 0xa282ead8;
+}
+
+static size_t varint_bytes(uint64_t value) {
+	size_t bytes = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		bytes++;
+	}
+	return bytes;
+}
+
+// The tag of a length-delimited protobuf field, and the length.
+static void append_field_header(std::string& out, int field, uint64_t length) {
+	out += (char)(field << 3 | 2);
+	for (; length >= 0x80; length >>= 7)
+		out += (char)(length | 0x80);
+	out += (char)length;
+}
+
+static size_t field_bytes(uint64_t length) {
+	return 1 + varint_bytes(length) + length;
+}
+
+TFRecordWriter::TFRecordWriter(std::string path, const std::vector<std::string>& part_names, const std::vector<uint32_t>& part_bytes, int compression_level)
+	: file(path, compression_level), parts(part_bytes)
+{
+	assert(part_names.size() == part_bytes.size());
+	// Example { Features features = 1; }, Features { map<string, Feature> feature = 1; }, whose entries are
+	// { string key = 1; Feature value = 2; }, Feature { BytesList bytes_list = 1; } and BytesList { repeated bytes value = 1; }.
+	std::vector<size_t> entry_bytes;
+	size_t features_bytes = 0;
+	for (size_t part = 0; part < parts.size(); part++) {
+		size_t feature_bytes = field_bytes(field_bytes(parts[part]));
+		entry_bytes.push_back(field_bytes(part_names[part].size()) + field_bytes(feature_bytes));
+		features_bytes += field_bytes(entry_bytes.back());
+	}
+	for (size_t part = 0; part < parts.size(); part++) {
+		std::string prefix;
+		if (part == 0)
+			append_field_header(prefix, 1, features_bytes);
+		append_field_header(prefix, 1, entry_bytes[part]);
+		append_field_header(prefix, 1, part_names[part].size());
+		prefix += part_names[part];
+		append_field_header(prefix, 2, field_bytes(field_bytes(parts[part])));
+		append_field_header(prefix, 1, field_bytes(parts[part]));
+		append_field_header(prefix, 1, parts[part]);
+		part_prefixes.push_back(prefix);
+	}
+
+	uint64_t example_bytes = field_bytes(features_bytes);
+	framing_header.assign(reinterpret_cast<const char*>(&example_bytes), sizeof(example_bytes));
+	uint32_t length_crc = masked_crc32c(framing_header.data(), framing_header.size());
+	framing_header.append(reinterpret_cast<const char*>(&length_crc), sizeof(length_crc));
+}
+
+void TFRecordWriter::write_block(const char* records, size_t length) {
+	scratch.clear();
+	for (size_t offset = 0; offset < length;) {
+		offset += RECORD_HEADER_BYTES;
+		scratch.insert(scratch.end(), framing_header.begin(), framing_header.end());
+		size_t example_start = scratch.size();
+		for (size_t part = 0; part < parts.size(); part++) {
+			scratch.insert(scratch.end(), part_prefixes[part].begin(), part_prefixes[part].end());
+			scratch.insert(scratch.end(), records + offset, records + offset + parts[part]);
+			offset += parts[part];
+		}
+		assert(offset <= length);
+		uint32_t example_crc = masked_crc32c(&scratch[example_start], scratch.size() - example_start);
+		scratch.insert(scratch.end(), reinterpret_cast<const char*>(&example_crc), reinterpret_cast<const char*>(&example_crc) + sizeof(example_crc));
+	}
+	file.write(scratch.data(), scratch.size());
+}
+
+RecordChunkReader::RecordChunkReader(std::string path) : file(path, std::ios_base::in | std::ios_base::binary) {
+	char magic[sizeof(RECORD_CHUNK_MAGIC)];
+	uint32_t part_count;
+	if (not file.read(magic, sizeof(magic)) or std::memcmp(magic, RECORD_CHUNK_MAGIC, sizeof(magic)) != 0)
+		return;
+	if (not file.read(reinterpret_cast<char*>(&part_count), sizeof(part_count)) or part_count > 64)
+		return;
+	parts.resize(part_count);
+	if (not file.read(reinterpret_cast<char*>(parts.data()), part_count * sizeof(uint32_t)))
+		return;
+	payload = std::accumulate(parts.begin(), parts.end(), 0u);
+	header_ok = true;
+}
+
+bool RecordChunkReader::read_block() {
+	uint32_t header[4];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (file.gcount() == 0)
+		return false;
+	// From here on, anything short of a whole, intact block of whole records is corruption.
+	corrupt = true;
+	if (file.gcount() != sizeof(header) or header[2] != (uint64_t)header[0] * (RECORD_HEADER_BYTES + payload))
+		return false;
+	compressed.resize(header[1]);
+	block.resize(header[2]);
+	if (not file.read(compressed.data(), compressed.size()))
+		return false;
+	uLongf uncompressed_bytes = block.size();
+	if (uncompress(reinterpret_cast<Bytef*>(block.data()), &uncompressed_bytes, reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()) != Z_OK)
+		return false;
+	if (uncompressed_bytes != block.size() or crc32(0, reinterpret_cast<const Bytef*>(block.data()), block.size()) != header[3])
+		return false;
+	corrupt = false;
+	position = 0;
+	return true;
+}
+
+bool RecordChunkReader::read_record(char* record) {
+	while (position == block.size())
+		if (not header_ok or corrupt or not read_block())
+			return false;
+	uint32_t record_payload;
+	std::memcpy(&record_payload, &block[position], sizeof(record_payload));
+	if (record_payload != payload) {
+		corrupt = true;
+		return false;
+	}
+	std::memcpy(record, &block[position + RECORD_HEADER_BYTES], payload);
+	position += RECORD_HEADER_BYTES + payload;
+	return true;
+}
+
+AsyncChunkSetWriter::AsyncChunkSetWriter(std::vector<std::string> base_paths, int count, int thread_count, int queue_batches)
+	: count(count), queue_batches(queue_batches), files(count), pending(count)
+{
+	assert(count > 0 and thread_count > 0 and queue_batches > 0);
+	for (int file = 0; file < count; file++) {
+		for (const std::string& base_path : base_paths) {
+			paths.push_back(base_path + "_" + std::to_string(file));
+			files[file].emplace_back(new ChunkWriter(paths.back()));
+		}
+		pending[file].resize(base_paths.size());
+	}
+	start_threads(thread_count);
+}
+
+AsyncChunkSetWriter::AsyncChunkSetWriter(std::vector<std::string> base_paths, SamplesPerFile samples_per_file, int thread_count, int queue_batches)
+	: count(thread_count), queue_batches(queue_batches), base_paths(base_paths), samples_per_file(samples_per_file.samples), pending(1)
+{
+	assert(samples_per_file.samples > 0 and thread_count > 0 and queue_batches > 0);
+	pending[0].resize(base_paths.size());
+	start_threads(thread_count);
+}
+
+AsyncChunkSetWriter::AsyncChunkSetWriter(std::string base_path, std::vector<uint32_t> part_bytes, int count, int thread_count, int queue_batches)
+	: count(count), queue_batches(queue_batches), pending(count)
+{
+	assert(count > 0 and thread_count > 0 and queue_batches > 0 and not part_bytes.empty());
+	record_payload_bytes = std::accumulate(part_bytes.begin(), part_bytes.end(), 0u);
+	for (int file = 0; file < count; file++) {
+		paths.push_back(base_path + "_" + std::to_string(file));
+		record_files.emplace_back(new RecordChunkWriter(paths.back(), part_bytes));
+		pending[file].resize(1);
+	}
+	start_threads(thread_count);
+}
+
+AsyncChunkSetWriter::AsyncChunkSetWriter(std::string base_path, std::vector<std::string> part_names, std::vector<uint32_t> part_bytes, int count, int thread_count, int queue_batches)
+	: count(count), queue_batches(queue_batches), pending(count)
+{
+	assert(count > 0 and thread_count > 0 and queue_batches > 0 and not part_bytes.empty());
+	record_payload_bytes = std::accumulate(part_bytes.begin(), part_bytes.end(), 0u);
+	for (int file = 0; file < count; file++) {
+		paths.push_back(base_path + "_" + std::to_string(file));
+		record_files.emplace_back(new TFRecordWriter(paths.back(), part_names, part_bytes));
+		pending[file].resize(1);
+	}
+	start_threads(thread_count);
+}
+
+void AsyncChunkSetWriter::start_threads(int thread_count) {
+	for (int t = 0; t < std::min(thread_count, count); t++) {
+		threads.emplace_back(new WriterThread);
+		threads.back()->thread = std::thread(&AsyncChunkSetWriter::run, this, std::ref(*threads.back()));
+	}
+}
+
+AsyncChunkSetWriter::~AsyncChunkSetWriter() {
+	close();
+}
+
+void AsyncChunkSetWriter::write(int stream, const char* data, std::streamsize length) {
+	assert(not closed);
+	if (not record_files.empty()) {
+		// Parts of a record all go into the one buffer, after a header that's filled in once the record is complete.
+		std::vector<char>& buffer = pending[index][0];
+		if (not record_open) {
+			record_start = buffer.size();
+			buffer.resize(buffer.size() + RECORD_HEADER_BYTES);
+			pending_bytes += RECORD_HEADER_BYTES;
+			record_open = true;
+			record_stream = 0;
+		}
+		// Parts have to arrive in stream order for the record to be read back right.
+		assert(stream >= record_stream);
+		record_stream = stream;
+		buffer.insert(buffer.end(), data, data + length);
+		pending_bytes += length;
+		return;
+	}
+	std::vector<char>& buffer = pending_for(index)[stream];
+	buffer.insert(buffer.end(), data, data + length);
+	pending_bytes += length;
+}
+
+void AsyncChunkSetWriter::advance() {
+	if (not record_files.empty()) {
+		std::vector<char>& buffer = pending[index][0];
+		uint32_t record_payload = buffer.size() - record_start - RECORD_HEADER_BYTES;
+		assert(record_open and record_payload == record_payload_bytes);
+		std::memcpy(&buffer[record_start], &record_payload, sizeof(record_payload));
+		record_open = false;
+	}
+	samples_written++;
+	if (samples_per_file > 0 and ++file_samples == samples_per_file) {
+		submit(index++);
+		file_samples = 0;
+		return;
+	}
+	for (const std::vector<char>& buffer : pending_for(index)) {
+		if (buffer.size() >= ASYNC_BATCH_BYTES) {
+			submit(index);
+			break;
+		}
+	}
+	if (samples_per_file > 0)
+		return;
+	// With many files, every batch could be well short of ASYNC_BATCH_BYTES and still add up to a lot of memory.
+	if (pending_bytes >= ASYNC_PENDING_BYTES) {
+		int largest = 0;
+		size_t largest_bytes = 0;
+		for (int file = 0; file < count; file++) {
+			size_t file_bytes = 0;
+			for (const std::vector<char>& buffer : pending[file])
+				file_bytes += buffer.size();
+			if (file_bytes > largest_bytes) {
+				largest = file;
+				largest_bytes = file_bytes;
+			}
+		}
+		submit(largest);
+	}
+	index = (index + 1) % count;
+}
+
+void AsyncChunkSetWriter::submit(int file) {
+	if (samples_per_file > 0 and paths.size() < (file + 1) * base_paths.size())
+		for (const std::string& base_path : base_paths)
+			paths.push_back(base_path + "_" + std::to_string(file));
+	Batch batch{file, std::move(pending_for(file))};
+	pending_for(file).assign(batch.parts.size(), std::vector<char>());
+	for (const std::vector<char>& part : batch.parts) {
+		bytes += part.size();
+		pending_bytes -= part.size();
+	}
+
+	WriterThread& writer = *threads[file % threads.size()];
+	std::unique_lock<std::mutex> lock(writer.mutex);
+	if (writer.queue.size() >= (size_t)queue_batches) {
+		auto start = std::chrono::steady_clock::now();
+		writer.not_full.wait(lock, [&] { return writer.queue.size() < (size_t)queue_batches; });
+		stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	writer.queue.push_back(std::move(batch));
+	writer.peak_depth = std::max(writer.peak_depth, writer.queue.size());
+	depth_total += writer.queue.size();
+	batches++;
+	lock.unlock();
+	writer.not_empty.notify_one();
+}
+
+void AsyncChunkSetWriter::run(WriterThread& writer) {
+	while (true) {
+		std::unique_lock<std::mutex> lock(writer.mutex);
+		writer.not_empty.wait(lock, [&] { return writer.closing or not writer.queue.empty(); });
+		if (writer.queue.empty()) {
+			writer.open_writers.clear();
+			return;
+		}
+		Batch batch = std::move(writer.queue.front());
+		writer.queue.pop_front();
+		lock.unlock();
+		writer.not_full.notify_one();
+
+		auto start = std::chrono::steady_clock::now();
+		if (not record_files.empty()) {
+			record_files[batch.file]->write_block(batch.parts[0].data(), batch.parts[0].size());
+		} else if (samples_per_file > 0) {
+			// A thread's files arrive in order, so a new file means the last one is finished with.
+			if (batch.file != writer.open_file) {
+				writer.open_writers.clear();
+				for (const std::string& base_path : base_paths)
+					writer.open_writers.emplace_back(new ChunkWriter(base_path + "_" + std::to_string(batch.file)));
+				writer.open_file = batch.file;
+			}
+			for (size_t stream = 0; stream < batch.parts.size(); stream++)
+				writer.open_writers[stream]->write(batch.parts[stream].data(), batch.parts[stream].size());
+		} else
+			for (size_t stream = 0; stream < batch.parts.size(); stream++)
+				files[batch.file][stream]->write(batch.parts[stream].data(), batch.parts[stream].size());
+		writer.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void AsyncChunkSetWriter::close() {
+	if (closed)
+		return;
+	closed = true;
+	// A record left half written would be an unreadable block.
+	assert(not record_open);
+	for (int file = 0; file < (int)pending.size(); file++)
+		if (std::any_of(pending[file].begin(), pending[file].end(), [](const std::vector<char>& buffer) { return not buffer.empty(); }))
+			submit(samples_per_file > 0 ? index : file);
+	for (auto& writer : threads) {
+		{
+			std::lock_guard<std::mutex> lock(writer->mutex);
+			writer->closing = true;
+		}
+		writer->not_empty.notify_one();
+		writer->thread.join();
+	}
+	// Destroying the writers flushes the compressors.
+	files.clear();
+	record_files.clear();
+}
+
+void AsyncChunkSetWriter::report(std::ostream& out) const {
+	size_t peak_depth = 0;
+	double busy_seconds = 0;
+	for (auto& writer : threads) {
+		peak_depth = std::max(peak_depth, writer->peak_depth);
+		busy_seconds += writer->busy_seconds;
+	}
+	out << "Async writer: " << batches << " batches (" << bytes / (1 << 20) << " MiB) on " << threads.size() << " threads"
+		<< ", peak queue depth " << peak_depth << "/" << queue_batches
+		<< ", mean depth " << (batches == 0 ? 0.0 : (double)depth_total / batches)
+		<< ", compressing and writing for " << busy_seconds << "s"
+		<< ", stalled for " << stall_seconds << "s" << std::endl;
+}
+
+uint64_t AsyncChunkSetWriter::file_bytes() const {
+	assert(closed);
+	uint64_t total = 0;
+	for (const std::string& path : paths)
+		total += boost::filesystem::file_size(path);
+	return total;
+}
+
+ChunkReader::ChunkReader(std::string path) : file(path, std::ios_base::in | std::ios_base::binary) {
+	stream.push(boost::iostreams::zlib_decompressor());
+	stream.push(file);
+}
+
+bool ChunkReader::read(char* data, std::streamsize length) {
+	stream.read(data, length);
+	std::streamsize got = stream.gcount();
+	if (got == length)
+		return true;
+	truncated = got != 0;
+	return false;
+}
+
+ChunkSetReader::ChunkSetReader(std::string features_path, std::string targets_path, std::string winners_path, SampleLayout layout)
+	: features(features_path), targets(targets_path), winners(winners_path), layout(layout) {}
+
+bool ChunkSetReader::read_record(char* record) {
+	bool got_features = features.read(record, layout.features_bytes);
+	bool got_targets  = targets.read(record + layout.features_bytes, layout.targets_bytes);
+	bool got_winners  = winners.read(record + layout.features_bytes + layout.targets_bytes, layout.winners_bytes);
+	if (got_features and got_targets and got_winners)
+		return true;
+	misaligned = got_features or got_targets or got_winners or features.truncated or targets.truncated or winners.truncated;
+	return false;
+}
@@ -0,0 +1,259 @@
+// Reading and writing zlib-compressed chunk files.
+
+#ifndef _SNPGO_CHUNK_IO_H
+#define _SNPGO_CHUNK_IO_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include "go_utils.h"
+#include "feature_extraction.h"
+
+using boost::iostreams::filtering_ostream;
+using boost::iostreams::filtering_istream;
+
+// Sizes of the three parts of a sample. The features size is configurable so that chunks made with an
+// older feature set can still be processed.
+struct SampleLayout {
+	int features_bytes = TOTAL_FEATURES;
+	int targets_bytes = BOARD_SIZE * BOARD_SIZE;
+	int winners_bytes = 2;
+
+	int record_bytes() const { return features_bytes + targets_bytes + winners_bytes; }
+};
+
+// A single compressed output file.
+class ChunkWriter {
+	std::ofstream file;
+	filtering_ostream stream;
+
+public:
+	ChunkWriter(std::string path, int compression_level = boost::iostreams::zlib::default_compression);
+	void write(const char* data, std::streamsize length);
+};
+
+// Somewhere to put samples made of parts in several parallel streams (features, targets, winners, ...).
+class SampleSink {
+public:
+	virtual ~SampleSink() {}
+	virtual void write(int stream, const char* data, std::streamsize length) = 0;
+	// Called once every part of a sample has been written.
+	virtual void advance() = 0;
+};
+
+// Holds samples in memory, so a worker thread can produce them without holding a lock and then hand them all over at once.
+class SampleBuffer : public SampleSink {
+	std::vector<std::vector<char>> streams;
+	// Where each sample ends in each stream.
+	std::vector<std::vector<size_t>> sample_ends;
+
+public:
+	void write(int stream, const char* data, std::streamsize length) override;
+	void advance() override;
+	int sample_count() const { return sample_ends.size(); }
+	// Writes every buffered sample into sink, in order, and empties the buffer.
+	void flush_to(SampleSink& sink);
+};
+
+// Record chunk files hold whole samples, with each sample's parts stored together, so the parts can't fall out of step.
+// File layout (all little-endian):
+//   "SNPGREC1" magic, a uint32 part count, then the uint32 size in bytes of each part (features, targets, winners, ...).
+//   Then blocks, each a uint32 record count, uint32 compressed size, uint32 uncompressed size and the uint32 CRC-32 of
+//   the uncompressed bytes, followed by that many zlib-compressed bytes of records.
+//   Each record is a uint32 holding its payload size (the sum of the part sizes), then the parts back to back.
+// Blocks only ever hold whole records, and each is checked as a whole when read.
+constexpr char RECORD_CHUNK_MAGIC[8] = {'S', 'N', 'P', 'G', 'R', 'E', 'C', '1'};
+constexpr int RECORD_HEADER_BYTES = 4;
+constexpr int RECORD_BLOCK_HEADER_BYTES = 16;
+
+// Takes whole records a block at a time, as AsyncChunkSetWriter's record mode hands them over.
+class RecordBlockWriter {
+public:
+	virtual ~RecordBlockWriter() {}
+	// Writes length bytes of whole records, headers included.
+	virtual void write_block(const char* records, size_t length) = 0;
+};
+
+class RecordChunkWriter : public RecordBlockWriter {
+	std::ofstream file;
+	uint32_t record_bytes;
+	int compression_level;
+
+public:
+	RecordChunkWriter(std::string path, const std::vector<uint32_t>& part_bytes, int compression_level = boost::iostreams::zlib::default_compression);
+	// Compresses the records into one block.
+	void write_block(const char* records, size_t length) override;
+};
+
+// The CRC-32C (Castagnoli) of TFRecord framing, continuing from crc as zlib's crc32 does. Uses SSE4.2 when the CPU has it.
+uint32_t crc32c(uint32_t crc, const char* data, size_t length);
+
+// TFRecord files, so tf.data can read samples directly with TFRecordDataset(paths, compression_type="ZLIB").
+// Each TFRecord is a uint64 length, the masked CRC-32C of the length, a serialized tf.train.Example, and the masked
+// CRC-32C of the example. The example has one bytes feature per part, named as in part_names, holding the part's raw
+// bytes. The whole file is a single zlib stream, which is what TFRecordDataset's ZLIB compression reads.
+// Parts are a fixed size, so everything but the part bytes and the final checksum is the same for every record, and
+// is worked out once up front.
+class TFRecordWriter : public RecordBlockWriter {
+	ChunkWriter file;
+	std::vector<uint32_t> parts;
+	// The length and its checksum, then the protobuf tags and lengths leading up to each part's bytes.
+	std::string framing_header;
+	std::vector<std::string> part_prefixes;
+	std::vector<char> scratch;
+
+public:
+	TFRecordWriter(std::string path, const std::vector<std::string>& part_names, const std::vector<uint32_t>& part_bytes, int compression_level = boost::iostreams::zlib::default_compression);
+	// Converts each record into a TFRecord holding one example.
+	void write_block(const char* records, size_t length) override;
+};
+
+class RecordChunkReader {
+	std::ifstream file;
+	std::vector<uint32_t> parts;
+	uint32_t payload = 0;
+	std::vector<char> compressed, block;
+	size_t position = 0;
+	bool header_ok = false;
+
+	bool read_block();
+
+public:
+	RecordChunkReader(std::string path);
+	bool is_open() const { return header_ok; }
+	const std::vector<uint32_t>& part_bytes() const { return parts; }
+	// The size of a record with its header stripped: all of its parts.
+	uint32_t payload_bytes() const { return payload; }
+	// Reads the next record's parts, back to back, into record. Returns false at the end of the file,
+	// setting corrupt if it ended part way through a block or a block failed its checks.
+	bool read_record(char* record);
+	bool corrupt = false;
+};
+
+// Per-file batches are handed off once they hold this many bytes of any one stream.
+constexpr size_t ASYNC_BATCH_BYTES = 1 << 20;
+// Batches waiting across all files never hold more than about this many bytes, however many files there are.
+constexpr size_t ASYNC_PENDING_BYTES = 16 << 20;
+constexpr int DEFAULT_ASYNC_QUEUE_BATCHES = 16;
+
+// Writes several parallel streams (features, targets, winners, ...) round robin over files named base_path_0,
+// base_path_1, and so on: sample i goes to file i modulo count, and each stream of a file is a single zlib stream
+// of its parts back to back. Compression and disk writes happen on thread_count background threads, so the thread
+// replaying games only copies bytes. Each file's samples are gathered into a batch that goes through a bounded queue
+// to the thread owning that file (file index modulo thread_count), which keeps each file's batches in order. A batch
+// is handed off once any of its streams reaches ASYNC_BATCH_BYTES, or, when the batches of all files together reach
+// ASYNC_PENDING_BYTES, if it's the largest. The caller only waits if a queue is full, and that stall time is reported.
+class AsyncChunkSetWriter : public SampleSink {
+public:
+	// Selects filling files in order, rather than round robin.
+	struct SamplesPerFile {
+		uint64_t samples;
+	};
+
+	AsyncChunkSetWriter(std::vector<std::string> base_paths, int count, int thread_count, int queue_batches = DEFAULT_ASYNC_QUEUE_BATCHES);
+	// Fills base_path_0 with samples_per_file samples, then base_path_1 and so on, for as many files as it takes. Each
+	// file is only opened once its first batch is written and closed as soon as it's full, so only about one file per
+	// thread is open at a time.
+	AsyncChunkSetWriter(std::vector<std::string> base_paths, SamplesPerFile samples_per_file, int thread_count, int queue_batches = DEFAULT_ASYNC_QUEUE_BATCHES);
+	// Writes record chunk files base_path_0, base_path_1, ... instead, with each sample as one record whose parts, written
+	// in stream order, must add up to the given part sizes. Each batch becomes one checksummed block.
+	AsyncChunkSetWriter(std::string base_path, std::vector<uint32_t> part_bytes, int count, int thread_count, int queue_batches = DEFAULT_ASYNC_QUEUE_BATCHES);
+	// The same, but writing TFRecord files base_path_0, base_path_1, ..., with each part as the example feature named in part_names.
+	AsyncChunkSetWriter(std::string base_path, std::vector<std::string> part_names, std::vector<uint32_t> part_bytes, int count, int thread_count, int queue_batches = DEFAULT_ASYNC_QUEUE_BATCHES);
+	~AsyncChunkSetWriter();
+
+	void write(int stream, const char* data, std::streamsize length) override;
+	// Moves every stream on to the next file together, or in order mode, on to the next file once this one is full.
+	void advance() override;
+	// Hands off all partial batches, waits for the writer threads, and closes the files.
+	void close();
+	// Only call this after close.
+	void report(std::ostream& out) const;
+	// The total size on disk of every file written. Only call this after close.
+	uint64_t file_bytes() const;
+
+	int index = 0;
+	uint64_t samples_written = 0;
+
+private:
+	struct Batch {
+		int file;
+		std::vector<std::vector<char>> parts;
+	};
+	struct WriterThread {
+		std::mutex mutex;
+		std::condition_variable not_empty, not_full;
+		std::deque<Batch> queue;
+		bool closing = false;
+		// In order mode, the one file the thread has open.
+		int open_file = -1;
+		std::vector<std::unique_ptr<ChunkWriter>> open_writers;
+		std::thread thread;
+		size_t peak_depth = 0;
+		double busy_seconds = 0;
+	};
+
+	int count;
+	int queue_batches;
+	std::vector<std::string> base_paths, paths;
+	// In order mode, how many samples each file gets and how many the current file (index) has so far. There's only
+	// one set of pending buffers, for the current file.
+	uint64_t samples_per_file = 0, file_samples = 0;
+	// files[file][stream] belongs to the writer thread for that file; pending[file][stream] to the caller.
+	std::vector<std::vector<std::unique_ptr<ChunkWriter>>> files;
+	std::vector<std::vector<std::vector<char>>> pending;
+	// The bytes in every pending buffer together.
+	size_t pending_bytes = 0;
+	std::vector<std::unique_ptr<WriterThread>> threads;
+	// In record mode, the files and the sample record currently being written, which starts at record_start in pending[index][0].
+	std::vector<std::unique_ptr<RecordBlockWriter>> record_files;
+	uint32_t record_payload_bytes = 0;
+	bool record_open = false;
+	int record_stream = 0;
+	size_t record_start = 0;
+	bool closed = false;
+
+	uint64_t batches = 0, bytes = 0, depth_total = 0;
+	double stall_seconds = 0;
+
+	void start_threads(int thread_count);
+	std::vector<std::vector<char>>& pending_for(int file) { return pending[samples_per_file > 0 ? 0 : file]; }
+	void submit(int file);
+	void run(WriterThread& writer);
+};
+
+// A single compressed input file.
+class ChunkReader {
+	std::ifstream file;
+	filtering_istream stream;
+
+public:
+	ChunkReader(std::string path);
+	bool is_open() const { return file.is_open(); }
+	// Reads exactly length bytes. Returns false at the end of the stream, setting truncated if it ended mid-read.
+	bool read(char* data, std::streamsize length);
+	bool truncated = false;
+};
+
+// Reads one file of a features/targets/winners chunk set in lockstep, as whole sample records laid out contiguously.
+class ChunkSetReader {
+	ChunkReader features, targets, winners;
+	SampleLayout layout;
+
+public:
+	ChunkSetReader(std::string features_path, std::string targets_path, std::string winners_path, SampleLayout layout);
+	bool is_open() const { return features.is_open() and targets.is_open() and winners.is_open(); }
+	// Returns false at the end of the set. If the three streams don't end together, misaligned is set.
+	bool read_record(char* record);
+	bool misaligned = false;
+};
+
+#endif
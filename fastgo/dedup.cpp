@@ -0,0 +1,189 @@
+// Dropping duplicate games and over-represented positions from a corpus.
+
+#include "dedup.h"
+#include <algorithm>
+
+static constexpr std::array<uint64_t, 2 * BOARD_SIZE * BOARD_SIZE> make_zobrist_keys() {
+	std::array<uint64_t, 2 * BOARD_SIZE * BOARD_SIZE> keys = {};
+	for (int i = 0; i < 2 * BOARD_SIZE * BOARD_SIZE; i++)
+		keys[i] = splitmix64(i);
+	return keys;
+}
+
+// One key per colour and point, shared by all board sizes, which get told apart by mixing the size into their hashes.
+static constexpr std::array<uint64_t, 2 * BOARD_SIZE * BOARD_SIZE> ZOBRIST_KEYS = make_zobrist_keys();
+
+static inline uint64_t zobrist_key(Cell colour, int point) {
+	assert(colour == 1 or colour == 2);
+	return ZOBRIST_KEYS[(colour - 1) * BOARD_SIZE * BOARD_SIZE + point];
+}
+
+template <int SIZE>
+static uint64_t game_hash_under_symmetry(const Game& game, int symmetry) {
+	const std::array<int16_t, SIZE * SIZE>& transform = SYMMETRY_TABLE<SIZE>[symmetry];
+	// Setup stones are unordered, so they go in as a Zobrist hash, and the moves are then chained on in order.
+	uint64_t setup = 0;
+	for (const Move& m : game.setup_stones)
+		setup ^= zobrist_key((Cell)m.who_moved, transform[m.xy.first + m.xy.second * SIZE]);
+	uint64_t hash = splitmix64(setup ^ SIZE);
+	for (const Move& m : game.moves) {
+		uint64_t point = m.pass ? 0xffff : transform[m.xy.first + m.xy.second * SIZE];
+		hash = splitmix64(hash ^ ((uint64_t)m.who_moved << 16 | point));
+	}
+	return hash;
+}
+
+template <int SIZE>
+static uint64_t canonical_game_hash_of_size(const Game& game) {
+	uint64_t hash = UINT64_MAX;
+	for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
+		hash = std::min(hash, game_hash_under_symmetry<SIZE>(game, symmetry));
+	return hash;
+}
+
+uint64_t canonical_game_hash(const Game& game) {
+	switch (game.board_size) {
+#define CASE(SIZE) case SIZE: return canonical_game_hash_of_size<SIZE>(game);
+	SNPGO_FOR_EACH_BOARD_SIZE(CASE)
+#undef CASE
+	}
+	assert(false);
+	return 0;
+}
+
+template <int SIZE>
+void CanonicalPositionHasherOfSize<SIZE>::set(const std::array<Cell, SIZE * SIZE>& cells) {
+	hashes.fill(SIZE);
+	for (int point = 0; point < SIZE * SIZE; point++)
+		if (cells[point] != 0)
+			toggle(point, cells[point]);
+}
+
+template <int SIZE>
+void CanonicalPositionHasherOfSize<SIZE>::toggle(int point, Cell colour) {
+	for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
+		hashes[symmetry] ^= zobrist_key(colour, SYMMETRY_TABLE<SIZE>[symmetry][point]);
+}
+
+template <int SIZE>
+uint64_t CanonicalPositionHasherOfSize<SIZE>::canonical_hash(Player to_move) const {
+	return splitmix64(*std::min_element(hashes.begin(), hashes.end()) ^ (uint64_t)to_move);
+}
+
+CountMinSketch::CountMinSketch(size_t bytes) {
+	// Round each row down to a power of two so that indexing is a mask.
+	size_t width = 1;
+	while (2 * width * DEPTH <= bytes)
+		width *= 2;
+	width_mask = width - 1;
+	counters.assign(width * DEPTH, 0);
+}
+
+int CountMinSketch::increment(uint64_t key) {
+	// Conservative update: only raise the counters that are at the current minimum.
+	int current = estimate(key);
+	if (current == MAX_COUNT)
+		return current;
+	for (int row = 0; row < DEPTH; row++) {
+		uint8_t& counter = counters[row * (width_mask + 1) + (splitmix64(key + row) & width_mask)];
+		if (counter == current)
+			counter++;
+	}
+	return current + 1;
+}
+
+int CountMinSketch::estimate(uint64_t key) const {
+	int smallest = MAX_COUNT;
+	for (int row = 0; row < DEPTH; row++)
+		smallest = std::min<int>(smallest, counters[row * (width_mask + 1) + (splitmix64(key + row) & width_mask)]);
+	return smallest;
+}
+
+CorpusDeduplicator::CorpusDeduplicator(const DedupConfig& config) : config(config) {
+	if (config.max_position_repeats > 0)
+		position_counts.reset(new CountMinSketch((size_t)config.position_sketch_mib << 20));
+}
+
+bool CorpusDeduplicator::admit_game(const Game& game) {
+	if (not config.drop_duplicate_games or seen_games.insert(canonical_game_hash(game)).second)
+		return true;
+	duplicate_games++;
+	return false;
+}
+
+template <int SIZE>
+void CorpusDeduplicator::filter_positions_of_size(const Game& game, std::vector<bool>& selected) {
+	int last_selected = -1;
+	for (int move_index = 0; move_index < (int)selected.size(); move_index++)
+		if (selected[move_index])
+			last_selected = move_index;
+
+	GoBoardOfSize<SIZE> board = initial_board<SIZE>(game);
+	CanonicalPositionHasherOfSize<SIZE> hasher;
+	hasher.set(board.cells);
+	for (int move_index = 0; move_index <= last_selected; move_index++) {
+		const Move& m = game.moves[move_index];
+		if (m.pass)
+			continue;
+		if (selected[move_index] and position_counts->increment(hasher.canonical_hash(m.who_moved)) > config.max_position_repeats) {
+			selected[move_index] = false;
+			repeated_positions++;
+		}
+
+		// Captures are rare, so rather than track which stones went, just rehash the whole board after one.
+		bool captures = false;
+		for (Coord neighbor : NEIGHBORS_INIT_LIST(m.xy))
+			if (coord_in_bounds<SIZE>(neighbor) and piece_at(board, neighbor) == (int)opponent_of(m.who_moved) and board.liberty_count(neighbor) == 1)
+				captures = true;
+		board.place_stone(m.who_moved, m.xy);
+		if (captures)
+			hasher.set(board.cells);
+		else
+			hasher.toggle(m.xy.first + m.xy.second * SIZE, (Cell)m.who_moved);
+	}
+}
+
+void CorpusDeduplicator::filter_positions(const Game& game, std::vector<bool>& selected) {
+	if (position_counts == nullptr)
+		return;
+	switch (game.board_size) {
+#define CASE(SIZE) case SIZE: filter_positions_of_size<SIZE>(game, selected); break;
+	SNPGO_FOR_EACH_BOARD_SIZE(CASE)
+#undef CASE
+	}
+}
+
+void CorpusDeduplicator::report(std::ostream& out) const {
+	if (config.drop_duplicate_games)
+		out << "Dropped " << duplicate_games << " duplicate games of " << duplicate_games + seen_games.size() << "." << std::endl;
+	if (position_counts != nullptr)
+		out << "Dropped " << repeated_positions << " positions already written " << config.max_position_repeats << " times." << std::endl;
+}
+
+bool parse_dedup_option(int argc, char** argv, int& i, DedupConfig& config) {
+	std::string option = argv[i];
+	if (option == "--dedup-games") {
+		config.drop_duplicate_games = true;
+		return true;
+	}
+	if (i + 1 >= argc)
+		return false;
+	if (option == "--position-repeats") {
+		config.max_position_repeats = std::stoi(argv[++i]);
+		return config.max_position_repeats >= 0 and config.max_position_repeats < CountMinSketch::MAX_COUNT;
+	}
+	if (option == "--sketch-mib") {
+		config.position_sketch_mib = std::stoi(argv[++i]);
+		return config.position_sketch_mib >= 1 and config.position_sketch_mib <= MAX_POSITION_SKETCH_MIB;
+	}
+	return false;
+}
+
+const char* DEDUP_OPTIONS_USAGE =
+	"  --dedup-games          Skip games whose moves repeat an earlier game's, up to rotation and reflection.\n"
+	"  --position-repeats n   Write each position (up to symmetry) at most n times, counted approximately (n < 255).\n"
+	"  --sketch-mib m         Memory in MiB for counting positions, from 1 to 65536 (default 64).\n";
+
+#define INSTANTIATE(SIZE) template class CanonicalPositionHasherOfSize<SIZE>;
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
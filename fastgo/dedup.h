@@ -0,0 +1,110 @@
+// Dropping duplicate games and over-represented positions from a corpus.
+
+#ifndef _SNPGO_DEDUP_H
+#define _SNPGO_DEDUP_H
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <ostream>
+#include <unordered_set>
+#include "go_utils.h"
+#include "sgf.h"
+
+constexpr int SYMMETRY_COUNT = 8;
+
+// Where each point goes under each of the eight rotations and reflections of the board. Built at compile time.
+template <int SIZE>
+constexpr std::array<std::array<int16_t, SIZE * SIZE>, SYMMETRY_COUNT> make_symmetry_table() {
+	std::array<std::array<int16_t, SIZE * SIZE>, SYMMETRY_COUNT> table = {};
+	for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++) {
+		for (int y = 0; y < SIZE; y++) {
+			for (int x = 0; x < SIZE; x++) {
+				int u = symmetry & 1 ? SIZE - 1 - x : x;
+				int v = symmetry & 2 ? SIZE - 1 - y : y;
+				table[symmetry][x + y * SIZE] = symmetry & 4 ? v + u * SIZE : u + v * SIZE;
+			}
+		}
+	}
+	return table;
+}
+
+template <int SIZE>
+inline constexpr std::array<std::array<int16_t, SIZE * SIZE>, SYMMETRY_COUNT> SYMMETRY_TABLE = make_symmetry_table<SIZE>();
+
+// A hash of the game's board size, setup stones and moves that is the same for all eight symmetric copies of the game.
+uint64_t canonical_game_hash(const Game& game);
+
+// Zobrist hashes of a position under all eight symmetries, kept up to date as stones come and go.
+template <int SIZE>
+class CanonicalPositionHasherOfSize {
+	std::array<uint64_t, SYMMETRY_COUNT> hashes;
+
+public:
+	void set(const std::array<Cell, SIZE * SIZE>& cells);
+	// Adds or removes a stone of colour at point.
+	void toggle(int point, Cell colour);
+	// The smallest of the symmetric hashes, with the player to move mixed in.
+	uint64_t canonical_hash(Player to_move) const;
+	// The hash of the position after transforming it by SYMMETRY_TABLE<SIZE>[symmetry].
+	uint64_t hash_under_symmetry(int symmetry) const { return hashes[symmetry]; }
+};
+
+// Approximate counts of 64-bit keys in fixed memory, with conservative updates and saturating one-byte counters.
+// Estimates are never low, only sometimes high when keys collide in every row.
+class CountMinSketch {
+	static constexpr int DEPTH = 4;
+	uint64_t width_mask;
+	std::vector<uint8_t> counters;
+
+public:
+	// Counts stick here, so limits must be below it for every extra occurrence to show.
+	static constexpr int MAX_COUNT = UINT8_MAX;
+
+	explicit CountMinSketch(size_t bytes);
+	// Counts one more occurrence of key and returns its new estimated count.
+	int increment(uint64_t key);
+	int estimate(uint64_t key) const;
+};
+
+constexpr int MAX_POSITION_SKETCH_MIB = 1 << 16;
+
+struct DedupConfig {
+	// Drop games whose canonical game hash has already been seen.
+	bool drop_duplicate_games = false;
+	// Write each position (up to symmetry, and with the same player to move) at most this many times, or any number if zero.
+	// Must be below CountMinSketch::MAX_COUNT.
+	int max_position_repeats = 0;
+	// Memory for counting positions. Overcounting from a small sketch drops a few positions early, but never lets extras through.
+	// From 1 to MAX_POSITION_SKETCH_MIB.
+	int position_sketch_mib = 64;
+};
+
+// Applies a DedupConfig across a whole run of the converter. Earlier games win, so keep the input order deterministic.
+class CorpusDeduplicator {
+	DedupConfig config;
+	std::unordered_set<uint64_t> seen_games;
+	std::unique_ptr<CountMinSketch> position_counts;
+	uint64_t duplicate_games = 0, repeated_positions = 0;
+
+	template <int SIZE>
+	void filter_positions_of_size(const Game& game, std::vector<bool>& selected);
+
+public:
+	explicit CorpusDeduplicator(const DedupConfig& config);
+	// Returns false if the game is a duplicate that should be skipped entirely.
+	bool admit_game(const Game& game);
+	// Clears selected[i] for positions that have already been written max_position_repeats times, and counts the rest.
+	// This replays the game, which is cheap next to the feature extraction it saves.
+	void filter_positions(const Game& game, std::vector<bool>& selected);
+	void report(std::ostream& out) const;
+};
+
+// Parses the option at argv[i] (advancing i past its argument) into config, returning false if it isn't a dedup option
+// or its value is out of range.
+bool parse_dedup_option(int argc, char** argv, int& i, DedupConfig& config);
+extern const char* DEDUP_OPTIONS_USAGE;
+
+#endif
+
@@ -0,0 +1,137 @@
+// Caching network evaluations by position, shared between threads.
+
+#include "eval_cache.h"
+#include "dedup.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+template <int SIZE>
+EvalCacheKey eval_cache_key(const std::array<Cell, SIZE * SIZE>& cells, Player to_move, const Coord* history, int history_length) {
+	CanonicalPositionHasherOfSize<SIZE> hasher;
+	hasher.set(cells);
+	// The smallest key over all the symmetries, history included, so positions that are themselves symmetric
+	// still agree on which way round their history goes.
+	EvalCacheKey best{UINT64_MAX, 0};
+	for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++) {
+		uint64_t hash = splitmix64(hasher.hash_under_symmetry(symmetry) ^ (uint64_t)to_move);
+		for (int age = 0; age < history_length; age++) {
+			Coord xy = history[age];
+			uint64_t point = xy == Coord{-1, -1} ? 0xffff : SYMMETRY_TABLE<SIZE>[symmetry][xy.first + xy.second * SIZE];
+			hash = splitmix64(hash ^ point);
+		}
+		if (hash < best.hash)
+			best = {hash, symmetry};
+	}
+	return best;
+}
+
+template <int SIZE>
+void eval_to_canonical(int symmetry, const float* values, float* canonical, int entry_floats) {
+	const std::array<int16_t, SIZE * SIZE>& transform = SYMMETRY_TABLE<SIZE>[symmetry];
+	for (int point = 0; point < SIZE * SIZE; point++)
+		canonical[transform[point]] = values[point];
+	std::copy(values + SIZE * SIZE, values + entry_floats, canonical + SIZE * SIZE);
+}
+
+template <int SIZE>
+void eval_from_canonical(int symmetry, const float* canonical, float* values, int entry_floats) {
+	const std::array<int16_t, SIZE * SIZE>& transform = SYMMETRY_TABLE<SIZE>[symmetry];
+	for (int point = 0; point < SIZE * SIZE; point++)
+		values[point] = canonical[transform[point]];
+	std::copy(canonical + SIZE * SIZE, canonical + entry_floats, values + SIZE * SIZE);
+}
+
+EvalCache::EvalCache(size_t bytes, int entry_floats) : entry_floats(entry_floats), stripes(new Stripe[STRIPES]) {
+	assert(entry_floats > 0);
+	// Round the set count down to a power of two, so that picking a set is a mask.
+	size_t set_bytes = WAYS * (sizeof(uint64_t) + sizeof(uint8_t) + entry_floats * sizeof(float)) + sizeof(uint8_t);
+	size_t sets = 1;
+	while (2 * sets * set_bytes <= bytes)
+		sets *= 2;
+	set_mask = sets - 1;
+	keys.assign(sets * WAYS, 0);
+	referenced.assign(sets * WAYS, 0);
+	hands.assign(sets, 0);
+	payloads.assign(sets * WAYS * entry_floats, 0);
+}
+
+bool EvalCache::lookup(uint64_t key, float* values) {
+	auto start = std::chrono::steady_clock::now();
+	key = stored_key(key);
+	size_t set = key & set_mask;
+	Stripe& stripe = stripes[set % STRIPES];
+	std::lock_guard<std::mutex> lock(stripe.mutex);
+	bool hit = false;
+	for (size_t way = set * WAYS; way < (set + 1) * WAYS; way++) {
+		if (keys[way] == key) {
+			referenced[way] = 1;
+			std::memcpy(values, &payloads[way * entry_floats], entry_floats * sizeof(float));
+			hit = true;
+			break;
+		}
+	}
+	(hit ? stripe.stats.hits : stripe.stats.misses)++;
+	stripe.probe_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return hit;
+}
+
+void EvalCache::insert(uint64_t key, const float* values) {
+	key = stored_key(key);
+	size_t set = key & set_mask;
+	Stripe& stripe = stripes[set % STRIPES];
+	std::lock_guard<std::mutex> lock(stripe.mutex);
+	size_t first = set * WAYS, chosen = SIZE_MAX;
+	for (size_t way = first; way < first + WAYS and chosen == SIZE_MAX; way++)
+		if (keys[way] == key or keys[way] == 0)
+			chosen = way;
+	if (chosen == SIZE_MAX) {
+		// Every way is taken: sweep the hand round, clearing reference bits, until it finds an entry without one.
+		uint8_t& hand = hands[set];
+		while (referenced[first + hand]) {
+			referenced[first + hand] = 0;
+			hand = (hand + 1) % WAYS;
+		}
+		chosen = first + hand;
+		hand = (hand + 1) % WAYS;
+		stripe.stats.evictions++;
+	}
+	keys[chosen] = key;
+	referenced[chosen] = 0;
+	std::memcpy(&payloads[chosen * entry_floats], values, entry_floats * sizeof(float));
+	stripe.stats.inserts++;
+}
+
+void EvalCache::clear() {
+	for (int s = 0; s < STRIPES; s++)
+		stripes[s].mutex.lock();
+	std::fill(keys.begin(), keys.end(), 0);
+	std::fill(referenced.begin(), referenced.end(), 0);
+	std::fill(hands.begin(), hands.end(), 0);
+	for (int s = 0; s < STRIPES; s++)
+		stripes[s].mutex.unlock();
+}
+
+EvalCacheStats EvalCache::stats() const {
+	EvalCacheStats total;
+	uint64_t probe_ns = 0;
+	for (int s = 0; s < STRIPES; s++) {
+		std::lock_guard<std::mutex> lock(stripes[s].mutex);
+		const EvalCacheStats& stats = stripes[s].stats;
+		total.hits += stats.hits;
+		total.misses += stats.misses;
+		total.inserts += stats.inserts;
+		total.evictions += stats.evictions;
+		probe_ns += stripes[s].probe_ns;
+	}
+	uint64_t probes = total.hits + total.misses;
+	total.mean_probe_ns = probes == 0 ? 0.0 : (double)probe_ns / probes;
+	return total;
+}
+
+#define INSTANTIATE(SIZE) \
+	template EvalCacheKey eval_cache_key<SIZE>(const std::array<Cell, SIZE * SIZE>& cells, Player to_move, const Coord* history, int history_length); \
+	template void eval_to_canonical<SIZE>(int symmetry, const float* values, float* canonical, int entry_floats); \
+	template void eval_from_canonical<SIZE>(int symmetry, const float* canonical, float* values, int entry_floats);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,76 @@
+// Caching network evaluations by position, shared between threads.
+
+#ifndef _SNPGO_EVAL_CACHE_H
+#define _SNPGO_EVAL_CACHE_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "go_utils.h"
+
+struct EvalCacheKey {
+	uint64_t hash;
+	// The symmetry (an index into SYMMETRY_TABLE) taking this copy of the position onto the canonical one.
+	int symmetry;
+};
+
+// The same key for all eight symmetric copies of a position, with the same player to move and the correspondingly
+// transformed recent moves. history holds history_length moves, most recent first, with (-1, -1) for a pass or a
+// missing move, as FeatureExtractor sees them. Instantiated for each of SNPGO_FOR_EACH_BOARD_SIZE.
+template <int SIZE>
+EvalCacheKey eval_cache_key(const std::array<Cell, SIZE * SIZE>& cells, Player to_move, const Coord* history, int history_length);
+
+// Moves an evaluation between a position's orientation and the canonical one. The first SIZE * SIZE of the entry_floats
+// values are per point and get permuted; the rest (a value, a pass probability, ...) are copied as they are.
+template <int SIZE>
+void eval_to_canonical(int symmetry, const float* values, float* canonical, int entry_floats);
+template <int SIZE>
+void eval_from_canonical(int symmetry, const float* canonical, float* values, int entry_floats);
+
+struct EvalCacheStats {
+	uint64_t hits = 0, misses = 0, inserts = 0, evictions = 0;
+	// Mean time per lookup, from asking for the lock to having copied the entry out.
+	double mean_probe_ns = 0;
+};
+
+// Evaluations of entry_floats floats each, keyed by EvalCacheKey hashes, in memory fixed at construction.
+// Entries live in sets of WAYS, picked by the key, and a full set evicts by CLOCK: a hand sweeps the set, giving each
+// entry used since it last passed a second chance. Sets are grouped into stripes with a lock each, so threads only
+// contend when they probe the same stripe at once, and each stripe keeps its own statistics under its lock.
+class EvalCache {
+	static constexpr int WAYS = 8;
+	static constexpr int STRIPES = 256;
+
+	struct alignas(64) Stripe {
+		std::mutex mutex;
+		EvalCacheStats stats;
+		uint64_t probe_ns = 0;
+	};
+
+	int entry_floats;
+	size_t set_mask;
+	// Zero for an empty way, so stored keys are never zero.
+	std::vector<uint64_t> keys;
+	std::vector<uint8_t> referenced;
+	std::vector<uint8_t> hands;
+	std::vector<float> payloads;
+	std::unique_ptr<Stripe[]> stripes;
+
+	static uint64_t stored_key(uint64_t key) { return key == 0 ? 1 : key; }
+
+public:
+	// Uses at most bytes of memory for entries, and always has room for at least one set.
+	EvalCache(size_t bytes, int entry_floats);
+	int floats_per_entry() const { return entry_floats; }
+	size_t capacity() const { return keys.size(); }
+	// Copies the entry for key into values and returns true, or returns false if there isn't one.
+	bool lookup(uint64_t key, float* values);
+	// Adds or replaces the entry for key.
+	void insert(uint64_t key, const float* values);
+	void clear();
+	EvalCacheStats stats() const;
+};
+
+#endif
@@ -0,0 +1,385 @@
+// C entry points exported by libfastgo.so.
+
+#include "go_utils.h"
+#include "feature_extraction.h"
+#include "game_records.h"
+#include "eval_cache.h"
+
+#include <array>
+#include <list>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+// Each history holds this many (x, y) pairs, most recent first. (-1, -1) marks a pass or a missing move.
+constexpr int HISTORY_INTS = FeatureExtractor::AGE_LAYERS * 2;
+
+enum FastgoStatus {
+	FASTGO_OK = 0,
+	FASTGO_BAD_ARGUMENT = -1,
+	FASTGO_BAD_BOARD = -2,
+	FASTGO_BAD_PERSPECTIVE = -3,
+	FASTGO_BAD_HISTORY = -4,
+	FASTGO_ILLEGAL_MOVE = -5,
+	FASTGO_NOTHING_TO_UNDO = -6,
+};
+
+extern "C" int fastgo_feature_plane_count() {
+	return FEATURE_COUNT;
+}
+
+extern "C" int fastgo_board_size() {
+	return BOARD_SIZE;
+}
+
+static int validate_batch(const uint8_t* raw_boards, const int* perspective_players, const int* move_histories, int batch_size) {
+	for (int i = 0; i < batch_size * BOARD_SIZE * BOARD_SIZE; i++)
+		if (raw_boards[i] > 2)
+			return FASTGO_BAD_BOARD;
+	// GoBoard::from_cells captures nothing, and features of a board with a dead group on it make no sense.
+	BoardAnalysis analysis;
+	for (int i = 0; i < batch_size; i++) {
+		std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+		std::copy(raw_boards + i * BOARD_SIZE * BOARD_SIZE, raw_boards + (i + 1) * BOARD_SIZE * BOARD_SIZE, cells.begin());
+		analysis.analyse(cells);
+		if (analysis.has_group_without_liberties())
+			return FASTGO_BAD_BOARD;
+	}
+	for (int i = 0; i < batch_size; i++)
+		if (perspective_players[i] != 1 and perspective_players[i] != 2)
+			return FASTGO_BAD_PERSPECTIVE;
+	if (move_histories != nullptr) {
+		for (int i = 0; i < batch_size * FeatureExtractor::AGE_LAYERS; i++) {
+			Coord xy{move_histories[2 * i], move_histories[2 * i + 1]};
+			if (xy != Coord{-1, -1} and not coord_in_bounds(xy))
+				return FASTGO_BAD_HISTORY;
+		}
+	}
+	return FASTGO_OK;
+}
+
+// Writes TOTAL_FEATURES values for one position at output, as uint8 or float32.
+static void write_features(FeatureExtractor& feature_extractor, GoBoard& board, Player perspective_player, void* output, bool output_float32) {
+	if (output_float32) {
+		uint8_t scratch[TOTAL_FEATURES];
+		feature_extractor.fill_features(scratch, board, perspective_player);
+		std::copy(scratch, scratch + TOTAL_FEATURES, static_cast<float*>(output));
+	} else {
+		feature_extractor.fill_features(static_cast<uint8_t*>(output), board, perspective_player);
+	}
+}
+
+static void extract_range(const uint8_t* raw_boards, const int* perspective_players, const int* move_histories, int start, int stop, void* output, bool output_float32) {
+	for (int index = start; index < stop; index++) {
+		// Build the board from all of the stones at once.
+		std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+		std::copy(raw_boards + index * BOARD_SIZE * BOARD_SIZE, raw_boards + (index + 1) * BOARD_SIZE * BOARD_SIZE, cells.begin());
+		GoBoard board = GoBoard::from_cells(cells);
+		// Replay the history oldest first so the most recent move ends up at the front.
+		FeatureExtractor feature_extractor;
+		if (move_histories != nullptr) {
+			const int* history = move_histories + index * HISTORY_INTS;
+			for (int age = FeatureExtractor::AGE_LAYERS - 1; age >= 0; age--)
+				feature_extractor.add_move_to_history({history[2 * age], history[2 * age + 1]});
+		}
+		size_t value_bytes = output_float32 ? sizeof(float) : sizeof(uint8_t);
+		write_features(feature_extractor, board, (Player)perspective_players[index], static_cast<char*>(output) + (size_t)index * TOTAL_FEATURES * value_bytes, output_float32);
+	}
+}
+
+// Writes batch_size samples of TOTAL_FEATURES values into the caller-owned output buffer, as uint8 or float32.
+// raw_boards holds batch_size boards of BOARD_SIZE * BOARD_SIZE cells (0 empty, 1 black, 2 white) in which every group
+// has a liberty, perspective_players holds 1 or 2 per board, and move_histories (which may be null) holds HISTORY_INTS
+// ints per board.
+// The batch is split into contiguous ranges over up to thread_count threads.
+extern "C" int fastgo_extract_features_batch(
+	const uint8_t* raw_boards,
+	const int* perspective_players,
+	const int* move_histories,
+	int batch_size,
+	void* output,
+	int output_float32,
+	int thread_count
+) {
+	if (raw_boards == nullptr or perspective_players == nullptr or output == nullptr or batch_size < 0)
+		return FASTGO_BAD_ARGUMENT;
+	int status = validate_batch(raw_boards, perspective_players, move_histories, batch_size);
+	if (status != FASTGO_OK)
+		return status;
+
+	thread_count = std::max(1, std::min(thread_count, batch_size));
+	if (thread_count == 1) {
+		extract_range(raw_boards, perspective_players, move_histories, 0, batch_size, output, output_float32);
+		return FASTGO_OK;
+	}
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++) {
+		int start = (long)batch_size * t / thread_count;
+		int stop  = (long)batch_size * (t + 1) / thread_count;
+		threads.emplace_back(extract_range, raw_boards, perspective_players, move_histories, start, stop, output, (bool)output_float32);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	return FASTGO_OK;
+}
+
+// A game records file held in memory, plus a sampler drawing training positions from it.
+struct FastgoSampler {
+	GameRecordSet records;
+	std::unique_ptr<GameRecordSampler> sampler;
+};
+
+// Returns null if the file can't be loaded or holds no positions.
+extern "C" FastgoSampler* fastgo_sampler_open(const char* path, uint64_t seed, int thread_count) {
+	FastgoSampler* handle = new FastgoSampler;
+	if (not handle->records.load(path) or handle->records.position_count() == 0) {
+		delete handle;
+		return nullptr;
+	}
+	handle->sampler.reset(new GameRecordSampler(handle->records, seed, thread_count));
+	return handle;
+}
+
+extern "C" int fastgo_sampler_game_count(FastgoSampler* handle) {
+	return handle->records.game_count();
+}
+
+extern "C" uint64_t fastgo_sampler_position_count(FastgoSampler* handle) {
+	return handle->records.position_count();
+}
+
+// Writes count samples: TOTAL_FEATURES feature bytes, BOARD_SIZE * BOARD_SIZE target bytes and 2 winner bytes each.
+// Any of the output buffers may be null to skip generating that part.
+extern "C" int fastgo_sampler_sample(FastgoSampler* handle, int count, uint8_t* features, uint8_t* targets, uint8_t* winners) {
+	if (handle == nullptr or count < 0)
+		return FASTGO_BAD_ARGUMENT;
+	handle->sampler->sample(count, features, targets, winners);
+	return FASTGO_OK;
+}
+
+extern "C" void fastgo_sampler_close(FastgoSampler* handle) {
+	delete handle;
+}
+
+// Network evaluations for BOARD_SIZE * BOARD_SIZE per point values plus extra_floats more (a value head, say), cached
+// under a key shared by all eight symmetric copies of a board, so a rotated or reflected repeat is a hit too.
+// Safe to share between threads calling lookup and insert at once.
+struct FastgoEvalCache {
+	EvalCache cache;
+	FastgoEvalCache(uint64_t bytes, int entry_floats) : cache(bytes, entry_floats) {}
+};
+
+extern "C" FastgoEvalCache* fastgo_eval_cache_create(uint64_t bytes, int extra_floats) {
+	if (extra_floats < 0)
+		return nullptr;
+	return new FastgoEvalCache(bytes, BOARD_SIZE * BOARD_SIZE + extra_floats);
+}
+
+static EvalCacheKey eval_cache_key_for(const uint8_t* raw_boards, const int* perspective_players, const int* move_histories, int index) {
+	std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+	std::copy(raw_boards + index * BOARD_SIZE * BOARD_SIZE, raw_boards + (index + 1) * BOARD_SIZE * BOARD_SIZE, cells.begin());
+	std::array<Coord, FeatureExtractor::AGE_LAYERS> history;
+	for (int age = 0; age < FeatureExtractor::AGE_LAYERS; age++) {
+		const int* xy = move_histories == nullptr ? nullptr : move_histories + index * HISTORY_INTS + 2 * age;
+		history[age] = xy == nullptr ? Coord{-1, -1} : Coord{xy[0], xy[1]};
+	}
+	return eval_cache_key<BOARD_SIZE>(cells, (Player)perspective_players[index], history.data(), history.size());
+}
+
+// Boards, perspectives and histories are laid out as for fastgo_extract_features_batch. For each board found, writes its
+// entry (in the board's own orientation) to outputs and sets its hits byte to 1; misses leave outputs alone and set 0.
+// Returns the number of hits, or a negative FastgoStatus.
+extern "C" int fastgo_eval_cache_lookup_batch(
+	FastgoEvalCache* handle,
+	const uint8_t* raw_boards,
+	const int* perspective_players,
+	const int* move_histories,
+	int batch_size,
+	float* outputs,
+	uint8_t* hits
+) {
+	if (handle == nullptr or raw_boards == nullptr or perspective_players == nullptr or outputs == nullptr or hits == nullptr or batch_size < 0)
+		return FASTGO_BAD_ARGUMENT;
+	int status = validate_batch(raw_boards, perspective_players, move_histories, batch_size);
+	if (status != FASTGO_OK)
+		return status;
+	int entry_floats = handle->cache.floats_per_entry();
+	std::vector<float> canonical(entry_floats);
+	int hit_count = 0;
+	for (int index = 0; index < batch_size; index++) {
+		EvalCacheKey key = eval_cache_key_for(raw_boards, perspective_players, move_histories, index);
+		hits[index] = handle->cache.lookup(key.hash, canonical.data());
+		if (hits[index]) {
+			eval_from_canonical<BOARD_SIZE>(key.symmetry, canonical.data(), outputs + (size_t)index * entry_floats, entry_floats);
+			hit_count++;
+		}
+	}
+	return hit_count;
+}
+
+// Stores batch_size entries from values, laid out as the outputs of fastgo_eval_cache_lookup_batch.
+extern "C" int fastgo_eval_cache_insert_batch(
+	FastgoEvalCache* handle,
+	const uint8_t* raw_boards,
+	const int* perspective_players,
+	const int* move_histories,
+	int batch_size,
+	const float* values
+) {
+	if (handle == nullptr or raw_boards == nullptr or perspective_players == nullptr or values == nullptr or batch_size < 0)
+		return FASTGO_BAD_ARGUMENT;
+	int status = validate_batch(raw_boards, perspective_players, move_histories, batch_size);
+	if (status != FASTGO_OK)
+		return status;
+	int entry_floats = handle->cache.floats_per_entry();
+	std::vector<float> canonical(entry_floats);
+	for (int index = 0; index < batch_size; index++) {
+		EvalCacheKey key = eval_cache_key_for(raw_boards, perspective_players, move_histories, index);
+		eval_to_canonical<BOARD_SIZE>(key.symmetry, values + (size_t)index * entry_floats, canonical.data(), entry_floats);
+		handle->cache.insert(key.hash, canonical.data());
+	}
+	return FASTGO_OK;
+}
+
+// Writes hits, misses, inserts and evictions so far to counts, and the mean lookup time to mean_probe_ns.
+extern "C" int fastgo_eval_cache_stats(FastgoEvalCache* handle, uint64_t* counts, double* mean_probe_ns) {
+	if (handle == nullptr or counts == nullptr or mean_probe_ns == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	EvalCacheStats stats = handle->cache.stats();
+	counts[0] = stats.hits;
+	counts[1] = stats.misses;
+	counts[2] = stats.inserts;
+	counts[3] = stats.evictions;
+	*mean_probe_ns = stats.mean_probe_ns;
+	return FASTGO_OK;
+}
+
+extern "C" uint64_t fastgo_eval_cache_capacity(FastgoEvalCache* handle) {
+	return handle->cache.capacity();
+}
+
+extern "C" void fastgo_eval_cache_clear(FastgoEvalCache* handle) {
+	handle->cache.clear();
+}
+
+extern "C" void fastgo_eval_cache_destroy(FastgoEvalCache* handle) {
+	delete handle;
+}
+
+// A game in progress, for engines that play move by move: the native board, the move history its features see, and
+// snapshots of every earlier position for undo. Play updates the board in place, while undo and clone rebuild it from a
+// snapshot with GoBoard::from_cells.
+struct FastgoBoard {
+	struct Snapshot {
+		std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+		Coord ko_point;
+		Player to_move;
+		std::list<Coord> move_history;
+	};
+
+	GoBoard board;
+	FeatureExtractor feature_extractor;
+	Player to_move = Player::BLACK;
+	std::vector<Snapshot> undo_stack;
+
+	void restore(const Snapshot& snapshot) {
+		board = GoBoard::from_cells(snapshot.cells);
+		board.ko_point = snapshot.ko_point;
+		to_move = snapshot.to_move;
+		feature_extractor.move_history = snapshot.move_history;
+	}
+};
+
+// An empty board with black to move.
+extern "C" FastgoBoard* fastgo_board_create() {
+	return new FastgoBoard;
+}
+
+// An independent copy, undo history included, for trying moves out without disturbing the original.
+extern "C" FastgoBoard* fastgo_board_clone(const FastgoBoard* handle) {
+	FastgoBoard* clone = new FastgoBoard;
+	clone->restore({handle->board.cells, handle->board.ko_point, handle->to_move, handle->feature_extractor.move_history});
+	clone->undo_stack = handle->undo_stack;
+	return clone;
+}
+
+extern "C" void fastgo_board_destroy(FastgoBoard* handle) {
+	delete handle;
+}
+
+// Plays a stone for player (1 black, 2 white) at (x, y), or passes for (-1, -1), capturing as it goes. Players needn't
+// alternate, as with GTP's play command, but whoever didn't move last is to move next.
+extern "C" int fastgo_board_play(FastgoBoard* handle, int player, int x, int y) {
+	if (handle == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	if (player != 1 and player != 2)
+		return FASTGO_BAD_PERSPECTIVE;
+	Player who = (Player)player;
+	Coord xy{x, y};
+	bool pass = xy == Coord{-1, -1};
+	if (not pass and not handle->board.is_legal(who, xy))
+		return FASTGO_ILLEGAL_MOVE;
+	handle->undo_stack.push_back({handle->board.cells, handle->board.ko_point, handle->to_move, handle->feature_extractor.move_history});
+	if (pass)
+		handle->board.pass();
+	else
+		handle->board.place_stone(who, xy);
+	handle->feature_extractor.add_move_to_history(xy);
+	handle->to_move = opponent_of(who);
+	return FASTGO_OK;
+}
+
+// Takes back the last move, restoring the position from its snapshot.
+extern "C" int fastgo_board_undo(FastgoBoard* handle) {
+	if (handle == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	if (handle->undo_stack.empty())
+		return FASTGO_NOTHING_TO_UNDO;
+	handle->restore(handle->undo_stack.back());
+	handle->undo_stack.pop_back();
+	return FASTGO_OK;
+}
+
+extern "C" int fastgo_board_to_move(const FastgoBoard* handle) {
+	return (int)handle->to_move;
+}
+
+extern "C" int fastgo_board_move_count(const FastgoBoard* handle) {
+	return handle->undo_stack.size();
+}
+
+// Writes BOARD_SIZE * BOARD_SIZE cells (0 empty, 1 black, 2 white), as fastgo_extract_features_batch takes them.
+extern "C" int fastgo_board_cells(const FastgoBoard* handle, uint8_t* cells) {
+	if (handle == nullptr or cells == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	std::copy(handle->board.cells.begin(), handle->board.cells.end(), cells);
+	return FASTGO_OK;
+}
+
+// Writes BOARD_SIZE * BOARD_SIZE bytes, 1 where player may legally play and 0 elsewhere, leaving out moves that fill
+// the player's own eyes if exclude_own_eyes is set. Returns the number of moves marked, or a negative FastgoStatus.
+extern "C" int fastgo_board_legal_moves(FastgoBoard* handle, int player, int exclude_own_eyes, uint8_t* legal) {
+	if (handle == nullptr or legal == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	if (player != 1 and player != 2)
+		return FASTGO_BAD_PERSPECTIVE;
+	int count = 0;
+	for (int point = 0; point < BOARD_SIZE * BOARD_SIZE; point++) {
+		Coord xy{point % BOARD_SIZE, point / BOARD_SIZE};
+		legal[point] = handle->board.is_legal((Player)player, xy) and not (exclude_own_eyes and pattern_is_eye(handle->board.pattern_at(xy), (Cell)player));
+		count += legal[point];
+	}
+	return count;
+}
+
+// Writes the current position's TOTAL_FEATURES values, from perspective_player's point of view, as
+// fastgo_extract_features_batch would for one board with this game's history.
+extern "C" int fastgo_board_features(FastgoBoard* handle, int perspective_player, void* output, int output_float32) {
+	if (handle == nullptr or output == nullptr)
+		return FASTGO_BAD_ARGUMENT;
+	if (perspective_player != 1 and perspective_player != 2)
+		return FASTGO_BAD_PERSPECTIVE;
+	write_features(handle->feature_extractor, handle->board, (Player)perspective_player, output, output_float32);
+	return FASTGO_OK;
+}
@@ -1,79 +1,98 @@
 // Feature extraction.
 
 #include "feature_extraction.h"
+#include <algorithm>
 
-void FeatureExtractor::add_move_to_history(Coord location) {
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::add_move_to_history(Coord location) {
 	move_history.push_front(location);
 	if (move_history.size() > AGE_LAYERS)
 		move_history.pop_back();
 }
 
-void FeatureExtractor::fill_features(uint8_t* feature_buffer, GoBoard& board, Player perspective_player) {
-#define FEATURE(k) (feature_buffer[(BOARD_SIZE * BOARD_SIZE * (k)) + (x) + (y) * BOARD_SIZE])
-	std::fill(feature_buffer, feature_buffer + TOTAL_FEATURES, 0);
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::gather_point_states(PointStates& states, GoBoardOfSize<SIZE>& board, Player perspective_player) {
+	std::fill(std::begin(states.colour), std::end(states.colour), 0);
+	std::fill(std::begin(states.liberties), std::end(states.liberties), 0);
+	std::fill(std::begin(states.p1_captures), std::end(states.p1_captures), 0);
+	std::fill(std::begin(states.p2_captures), std::end(states.p2_captures), 0);
+	std::fill(std::begin(states.ladder_captures), std::end(states.ladder_captures), 0);
+	std::fill(std::begin(states.ladder_escapes), std::end(states.ladder_escapes), 0);
 
-	// Fill in the history features.
-	int moves_ago = 0;
-	for (Coord xy : move_history) {
-		// The special move {-1, -1} is a dummy that we ignore.
-		if (xy == {-1, -1})
-			continue;
-		int x = xy.first, y = xy.second;
-		FEATURE(FEAT_HISTORY1 + moves_ago) = 1;
-		moves_ago++;
+	// Colours are stored relative to the perspective player: 1 for our stones and 2 for theirs.
+	for (int i = 0; i < SIZE * SIZE; i++) {
+		Cell piece = board.cells[i];
+		assert(piece == 0 or piece == 1 or piece == 2);
+		if (piece != 0)
+			states.colour[i] = piece == (int)perspective_player ? 1 : 2;
 	}
 
-	// Fill in all the other features.
-	for (int y = 0; y < BOARD_SIZE; y++) {
-		for (int x = 0; x < BOARD_SIZE; x++) {
-			Cell piece = piece_at(board, {x, y});
-			assert(piece == 0 or piece == 1 or piece == 2);
+	// Liberties and captures come from one pass over the groups.
+	analysis.analyse(board.cells);
+	for (int i = 0; i < SIZE * SIZE; i++) {
+		if (states.colour[i] != 0) {
+			assert(analysis.liberties[i] > 0);
+			states.liberties[i] = std::min<int>(analysis.liberties[i], MAX_LIBERTIES_FEATURE);
+			continue;
+		}
+		states.p1_captures[i] = std::min(analysis.captures_for(perspective_player, i), MAX_CAPTURES_FEATURE);
+		states.p2_captures[i] = std::min(analysis.captures_for(opponent_of(perspective_player), i), MAX_CAPTURES_FEATURE);
+	}
 
-			FEATURE(FEAT_ONES_PLANE)            = 1;
-			FEATURE(FEAT_EMPTY_LOCATIONS_PLANE) = piece == 0;
-			FEATURE(FEAT_P1_STONES)             = piece == (int)perspective_player;
-			FEATURE(FEAT_P2_STONES)             = piece == (int)opponent_of(perspective_player);
+	fill_ladder_points(ladder_reader, board.cells, states.colour, states.liberties, states.ladder_captures, states.ladder_escapes);
+}
 
-			// If the piece is non-zero then lookup the liberty count, and write out feature maps.
-			int liberties = (piece != 0) ? board.liberty_count({x, y}) : 0;
-			assert(liberties > 0);
-			liberties = std::min(liberties, MAX_LIBERTIES_FEATURE);
-			FEATURE(FEAT_LIBERTIES1 + (liberties - 1)) = 1;
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::make_plane_rules(PlaneRule* rules, const PointStates& states) {
+	alignas(64) static const uint8_t zeros[PointStates::PADDED_POINT_COUNT] = {};
+	// Every plane is a single comparison against one of the per-point arrays.
+	// Planes that never match (0xff) come out all zero, and the history planes are scattered in afterwards.
+	rules[FEAT_ONES_PLANE]            = {zeros, 0};
+	rules[FEAT_EMPTY_LOCATIONS_PLANE] = {states.colour, 0};
+	rules[FEAT_P1_STONES]             = {states.colour, 1};
+	rules[FEAT_P2_STONES]             = {states.colour, 2};
+	for (int liberties = 1; liberties <= MAX_LIBERTIES_FEATURE; liberties++)
+		rules[FEAT_LIBERTIES1 + (liberties - 1)] = {states.liberties, (uint8_t)liberties};
+	for (int age = 0; age < AGE_LAYERS; age++)
+		rules[FEAT_HISTORY1 + age] = {zeros, 0xff};
+	for (int captures = 1; captures <= MAX_CAPTURES_FEATURE; captures++) {
+		rules[FEAT_P1_PLAY_CAUSES_CAPTURE1 + (captures - 1)] = {states.p1_captures, (uint8_t)captures};
+		rules[FEAT_P2_PLAY_CAUSES_CAPTURE1 + (captures - 1)] = {states.p2_captures, (uint8_t)captures};
+	}
+	rules[FEAT_LADDER_CAPTURE] = {states.ladder_captures, 1};
+	rules[FEAT_LADDER_ESCAPE]  = {states.ladder_escapes, 1};
+}
 
-			for (auto layer_and_player : {
-				std::pair<FeatureKind, Player>
-				{FEAT_P1_PLAY_CAUSES_CAPTURE1, perspective_player},
-				{FEAT_P2_PLAY_CAUSES_CAPTURE1, opponent_of(perspective_player)},
-			}) {
-				FeatureKind feature_layer = layer_and_player.first;
-				Player player = layer_and_player.second;
-				FEATURE(feature_layer) = 0;
-				// Check for a neighbor we might capture.
-				if (piece_at(board, {x, y}) == 0) {
-					Coord left  {x - 1, y};
-					Coord right {x + 1, y};
-					Coord above {x, y - 1};
-					Coord below {x, y + 1};
-					// Look for an adjacent group owned by the other player with exactly one liberty.
-					// If such a group exists, then playing here causes a capture.
-					int total_captured_stones = 0;
-					for (auto direction : {left, right, above, below}) {
-						if (coord_in_bounds(direction) and piece_at(board, direction) == (int)opponent_of(player)) {
-							if (board.liberty_count(direction) == 1) {
-								total_captured_stones += board.group_size(direction);
-							}
-						}
-					}
-					total_captured_stones = std::min(total_captured_stones, MAX_CAPTURES_FEATURE);
-					if (total_captured_stones > 0)
-						FEATURE(feature_layer + (total_captured_stones - 1)) = 1;
-				}
-			}
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::fill_features(uint8_t* feature_buffer, GoBoardOfSize<SIZE>& board, Player perspective_player) {
+	PointStates states;
+	gather_point_states(states, board, perspective_player);
+	fill_features_from_states(feature_buffer, states);
+}
 
-		} // loop over x
-	} // loop over y
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::fill_features_from_states(uint8_t* feature_buffer, const PointStates& states) {
+	PlaneRule rules[FEATURE_COUNT];
+	make_plane_rules(rules, states);
+	emit_planes<SIZE>(rules, FEATURE_COUNT, feature_buffer);
 
-#undef FEATURE
+	// Fill in the history features.
+	int moves_ago = 0;
+	for (Coord xy : move_history) {
+		// The special move {-1, -1} is a pass, which occupies its age layer but marks nothing.
+		if (xy != Coord{-1, -1})
+			feature_buffer[(SIZE * SIZE * (FEAT_HISTORY1 + moves_ago)) + xy.first + xy.second * SIZE] = 1;
+		moves_ago++;
+	}
 }
 
+template <int SIZE>
+void FeatureExtractorOfSize<SIZE>::fill_eye_plane(uint8_t* plane, const GoBoardOfSize<SIZE>& board, Player perspective_player) {
+	for (int point = 0; point < SIZE * SIZE; point++)
+		plane[point] = board.cells[point] == 0 and pattern_is_eye(board.patterns[point], (Cell)perspective_player);
+}
 
+#define INSTANTIATE(SIZE) \
+	template struct FeatureExtractorOfSize<SIZE>;
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
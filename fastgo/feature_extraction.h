@@ -5,6 +5,8 @@
 
 #include <list>
 #include "go_utils.h"
+#include "plane_emission.h"
+#include "ladder.h"
 
 enum FeatureKind {
 	FEAT_ONES_PLANE,
@@ -31,20 +33,57 @@ enum FeatureKind {
 	FEAT_P1_PLAY_CAUSES_CAPTURE2PLUS,
 	FEAT_P2_PLAY_CAUSES_CAPTURE1,
 	FEAT_P2_PLAY_CAUSES_CAPTURE2PLUS,
+	FEAT_LADDER_CAPTURE,
+	FEAT_LADDER_ESCAPE,
 	FEATURE_COUNT,
 };
 
 constexpr int MAX_LIBERTIES_FEATURE = 8;
 constexpr int MAX_CAPTURES_FEATURE = 2;
-constexpr int TOTAL_FEATURES = FEATURE_COUNT * BOARD_SIZE * BOARD_SIZE;
+constexpr int total_features(int size) { return FEATURE_COUNT * size * size; }
+constexpr int TOTAL_FEATURES = total_features(BOARD_SIZE);
 
-struct FeatureExtractor {
+// Per-point board state that every plane is computed from, laid out for the emission kernels.
+template <int SIZE>
+struct PointStatesOfSize {
+	constexpr static int PADDED_POINT_COUNT = padded_point_count(SIZE);
+
+	// 0 for empty, 1 for a stone of the perspective player, 2 for an opponent stone.
+	alignas(64) uint8_t colour[PADDED_POINT_COUNT];
+	// Liberties of the group at each stone, clamped to MAX_LIBERTIES_FEATURE, or 0 for empty points.
+	alignas(64) uint8_t liberties[PADDED_POINT_COUNT];
+	// Stones captured by the perspective player (p1) or opponent (p2) playing here, clamped to MAX_CAPTURES_FEATURE.
+	alignas(64) uint8_t p1_captures[PADDED_POINT_COUNT];
+	alignas(64) uint8_t p2_captures[PADDED_POINT_COUNT];
+	// 1 where the perspective player has a working ladder capture, or escapes a ladder, by playing here.
+	alignas(64) uint8_t ladder_captures[PADDED_POINT_COUNT];
+	alignas(64) uint8_t ladder_escapes[PADDED_POINT_COUNT];
+};
+
+typedef PointStatesOfSize<BOARD_SIZE> PointStates;
+
+// Instantiated for each of SNPGO_FOR_EACH_BOARD_SIZE, writing total_features(SIZE) bytes per position.
+template <int SIZE>
+struct FeatureExtractorOfSize {
+	typedef PointStatesOfSize<SIZE> PointStates;
 	constexpr static int AGE_LAYERS = 8;
 	std::list<Coord> move_history;
+	LadderReaderOfSize<SIZE> ladder_reader;
+	// The groups of the position last gathered, which any further feature code can read too.
+	BoardAnalysisOfSize<SIZE> analysis;
 
 	void add_move_to_history(Coord location);
-	void fill_features(uint8_t* feature_buffer, GoBoard& board, Player perspective_player);
+	void gather_point_states(PointStates& states, GoBoardOfSize<SIZE>& board, Player perspective_player);
+	static void make_plane_rules(PlaneRule* rules, const PointStates& states);
+	// Emits every plane from already gathered point states, then scatters in the move history.
+	void fill_features_from_states(uint8_t* feature_buffer, const PointStates& states);
+	void fill_features(uint8_t* feature_buffer, GoBoardOfSize<SIZE>& board, Player perspective_player);
+	// The optional extra plane, SIZE * SIZE bytes: 1 at each empty point that's an eye for the perspective player by the
+	// playout rule, read straight from the board's pattern codes.
+	static void fill_eye_plane(uint8_t* plane, const GoBoardOfSize<SIZE>& board, Player perspective_player);
 };
 
+typedef FeatureExtractorOfSize<BOARD_SIZE> FeatureExtractor;
+
 #endif
 
@@ -0,0 +1,182 @@
+// Compact binary game records, and on-the-fly sampling of training positions from them.
+
+#include "game_records.h"
+#include "feature_extraction.h"
+
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+constexpr uint8_t PASS_BYTE = 0x7f;
+constexpr uint8_t HIGH_BIT  = 0x80;
+
+GameRecordWriter::GameRecordWriter(std::string path) : file(path, std::ios_base::out | std::ios_base::binary) {
+	file.write(GAME_RECORDS_MAGIC, sizeof(GAME_RECORDS_MAGIC));
+	file.write(reinterpret_cast<const char*>(&game_count), sizeof(game_count));
+}
+
+GameRecordWriter::~GameRecordWriter() {
+	// Now that we know how many games there are, patch the count into the header.
+	file.seekp(sizeof(GAME_RECORDS_MAGIC));
+	file.write(reinterpret_cast<const char*>(&game_count), sizeof(game_count));
+}
+
+void GameRecordWriter::write(const Game& game) {
+	// Records hold neither a board size nor setup stones.
+	assert(game.board_size == BOARD_SIZE and game.setup_stones.empty());
+	assert(game.moves.size() <= UINT16_MAX);
+	uint16_t move_count = game.moves.size();
+	int8_t header[GAME_RECORD_HEADER_BYTES - 2] = {
+		(int8_t)std::max(-128, game.black_rank),
+		(int8_t)std::max(-128, game.white_rank),
+		(int8_t)std::lround(game.komi * 2),
+		(int8_t)game.who_won,
+	};
+	file.write(reinterpret_cast<const char*>(&move_count), sizeof(move_count));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	std::vector<uint8_t> moves;
+	moves.reserve(GAME_RECORD_MOVE_BYTES * game.moves.size());
+	for (const Move& m : game.moves) {
+		uint8_t x = m.pass ? PASS_BYTE : m.xy.first;
+		uint8_t y = m.pass ? PASS_BYTE : m.xy.second;
+		moves.push_back(x | (m.who_moved == Player::WHITE ? HIGH_BIT : 0));
+		moves.push_back(y | (m.is_random_self_play_move ? HIGH_BIT : 0));
+	}
+	file.write(reinterpret_cast<const char*>(moves.data()), moves.size());
+	game_count++;
+}
+
+bool GameRecordSet::load(std::string path) {
+	std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+	if (not in)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	offsets.clear();
+	cumulative_positions.clear();
+
+	size_t header_bytes = sizeof(GAME_RECORDS_MAGIC) + sizeof(uint32_t);
+	if (data.size() < header_bytes or std::memcmp(data.data(), GAME_RECORDS_MAGIC, sizeof(GAME_RECORDS_MAGIC)) != 0) {
+		std::cerr << "Not a game records file: " << path << std::endl;
+		return false;
+	}
+	uint32_t expected_games;
+	std::memcpy(&expected_games, &data[sizeof(GAME_RECORDS_MAGIC)], sizeof(expected_games));
+
+	uint64_t total_positions = 0;
+	size_t offset = header_bytes;
+	while (offset + GAME_RECORD_HEADER_BYTES <= data.size()) {
+		uint16_t move_count;
+		std::memcpy(&move_count, &data[offset], sizeof(move_count));
+		size_t record_bytes = GAME_RECORD_HEADER_BYTES + GAME_RECORD_MOVE_BYTES * (size_t)move_count;
+		if (offset + record_bytes > data.size())
+			break;
+		offsets.push_back(offset);
+		for (int i = 0; i < move_count; i++)
+			total_positions += (data[offset + GAME_RECORD_HEADER_BYTES + 2 * i] & ~HIGH_BIT) != PASS_BYTE;
+		cumulative_positions.push_back(total_positions);
+		offset += record_bytes;
+	}
+	if (offset != data.size() or offsets.size() != expected_games) {
+		std::cerr << "Truncated game records file: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void GameRecordSet::decode(int index, Game& game) const {
+	const uint8_t* record = &data[offsets.at(index)];
+	uint16_t move_count;
+	std::memcpy(&move_count, record, sizeof(move_count));
+	game.black_rank = (int8_t)record[2];
+	game.white_rank = (int8_t)record[3];
+	game.komi = (int8_t)record[4] / 2.0f;
+	game.who_won = (Player)record[5];
+	game.moves.clear();
+	const uint8_t* moves = record + GAME_RECORD_HEADER_BYTES;
+	for (int i = 0; i < move_count; i++) {
+		uint8_t x = moves[2 * i], y = moves[2 * i + 1];
+		Move m;
+		m.who_moved = (x & HIGH_BIT) ? Player::WHITE : Player::BLACK;
+		m.is_random_self_play_move = (y & HIGH_BIT) != 0;
+		x &= ~HIGH_BIT;
+		y &= ~HIGH_BIT;
+		m.pass = x == PASS_BYTE;
+		m.xy = m.pass ? Coord{-1, -1} : Coord{x, y};
+		game.moves.push_back(m);
+	}
+}
+
+GameRecordSampler::GameRecordSampler(const GameRecordSet& records, uint64_t seed, int thread_count) : records(records) {
+	for (int i = 0; i < std::max(1, thread_count); i++)
+		generators.emplace_back(seed + i);
+}
+
+void GameRecordSampler::write_sample(const Game& game, int move_index, uint8_t* features, uint8_t* targets, uint8_t* winners) {
+	const Move& sampled = game.moves.at(move_index);
+	assert(not sampled.pass);
+
+	// Replay up to the position right BEFORE the sampled move, exactly as write_all_samples does.
+	if (features != nullptr) {
+		GoBoard board;
+		FeatureExtractor feature_extractor;
+		for (int i = 0; i < move_index; i++) {
+			const Move& m = game.moves[i];
+			if (m.pass) {
+				feature_extractor.add_move_to_history({-1, -1});
+				continue;
+			}
+			board.place_stone(m.who_moved, m.xy);
+			feature_extractor.add_move_to_history(m.xy);
+		}
+		feature_extractor.fill_features(features, board, sampled.who_moved);
+	}
+
+	if (targets != nullptr) {
+		std::fill(targets, targets + BOARD_SIZE * BOARD_SIZE, 0);
+		targets[sampled.xy.first + sampled.xy.second * BOARD_SIZE] = 1;
+	}
+
+	if (winners != nullptr) {
+		winners[0] = game.who_won == sampled.who_moved;
+		winners[1] = game.who_won == opponent_of(sampled.who_moved);
+	}
+}
+
+void GameRecordSampler::sample_range(std::mt19937_64& generator, int start, int stop, uint8_t* features, uint8_t* targets, uint8_t* winners) {
+	std::uniform_int_distribution<uint64_t> position_distribution(0, records.position_count() - 1);
+	Game game;
+	for (int index = start; index < stop; index++) {
+		// Choose uniformly over positions, then find which non-pass move of which game that is.
+		uint64_t position = position_distribution(generator);
+		auto it = std::upper_bound(records.cumulative_positions.begin(), records.cumulative_positions.end(), position);
+		int game_index = it - records.cumulative_positions.begin();
+		uint64_t skip = position - (game_index == 0 ? 0 : records.cumulative_positions[game_index - 1]);
+		records.decode(game_index, game);
+		int move_index = 0;
+		while (game.moves[move_index].pass or skip-- > 0)
+			move_index++;
+		write_sample(
+			game, move_index,
+			features == nullptr ? nullptr : features + (size_t)index * TOTAL_FEATURES,
+			targets  == nullptr ? nullptr : targets  + (size_t)index * BOARD_SIZE * BOARD_SIZE,
+			winners  == nullptr ? nullptr : winners  + (size_t)index * 2
+		);
+	}
+}
+
+void GameRecordSampler::sample(int count, uint8_t* features, uint8_t* targets, uint8_t* winners) {
+	assert(records.position_count() > 0);
+	int thread_count = generators.size();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++) {
+		int start = (long)count * t / thread_count;
+		int stop  = (long)count * (t + 1) / thread_count;
+		threads.emplace_back(&GameRecordSampler::sample_range, this, std::ref(generators[t]), start, stop, features, targets, winners);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
@@ -0,0 +1,64 @@
+// Compact binary game records, and on-the-fly sampling of training positions from them.
+
+#ifndef _SNPGO_GAME_RECORDS_H
+#define _SNPGO_GAME_RECORDS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include "go_utils.h"
+#include "sgf.h"
+
+// File layout (all little-endian):
+//   "SNPGAME1" magic, then a uint32 game count.
+//   Per game: uint16 move count, int8 black rank, int8 white rank, int8 komi in half points, uint8 winner (a Player),
+//   then two bytes per move. The first byte is x (or 0x7f for a pass), with 0x80 set for White;
+//   the second is y (or 0x7f for a pass), with 0x80 set for moves flagged as random self-play moves.
+// A typical game takes a few hundred bytes, where its featurised positions took megabytes.
+constexpr char GAME_RECORDS_MAGIC[8] = {'S', 'N', 'P', 'G', 'A', 'M', 'E', '1'};
+constexpr int GAME_RECORD_HEADER_BYTES = 6;
+constexpr int GAME_RECORD_MOVE_BYTES = 2;
+
+class GameRecordWriter {
+	std::ofstream file;
+	uint32_t game_count = 0;
+
+public:
+	GameRecordWriter(std::string path);
+	~GameRecordWriter();
+	void write(const Game& game);
+};
+
+// An entire records file held in memory, with an index for random access.
+struct GameRecordSet {
+	std::vector<uint8_t> data;
+	std::vector<size_t> offsets;
+	// cumulative_positions[i] is the number of non-pass moves in games up to and including i, for sampling uniformly over positions.
+	std::vector<uint64_t> cumulative_positions;
+
+	bool load(std::string path);
+	int game_count() const { return offsets.size(); }
+	uint64_t position_count() const { return cumulative_positions.empty() ? 0 : cumulative_positions.back(); }
+	void decode(int index, Game& game) const;
+};
+
+// Picks (game, move) pairs uniformly over all non-pass moves, replays each game up to that move, and writes
+// the same features, targets and winners that sgf_to_chunks would have written for it.
+class GameRecordSampler {
+	const GameRecordSet& records;
+	std::vector<std::mt19937_64> generators;
+
+	void sample_range(std::mt19937_64& generator, int start, int stop, uint8_t* features, uint8_t* targets, uint8_t* winners);
+
+public:
+	GameRecordSampler(const GameRecordSet& records, uint64_t seed, int thread_count);
+
+	// Any of the output buffers may be null. Each generator thread fills a contiguous slice of the outputs.
+	void sample(int count, uint8_t* features, uint8_t* targets, uint8_t* winners);
+	static void write_sample(const Game& game, int move_index, uint8_t* features, uint8_t* targets, uint8_t* winners);
+};
+
+#endif
+
@@ -0,0 +1,156 @@
+// Play self-play games on several threads, writing training samples straight into chunks.
+
+#include "go_utils.h"
+#include "sgf.h"
+#include "chunk_io.h"
+#include "sampling.h"
+#include "scoring.h"
+#include "samples.h"
+#include "self_play.h"
+#include "game_records.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+int main(int argc, char** argv) {
+	SelfPlayConfig config;
+	SamplingPolicy sampling_policy;
+	std::string policy_name = "capture";
+	std::string territory_chunk_path, game_records_path, record_chunk_path, tfrecord_path;
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	int writer_threads = 1;
+	uint64_t seed = 12345;
+	bool eye_plane = false;
+	bool bad_options = argc < 6;
+	for (int i = 6; i < argc; i++) {
+		std::string option = argv[i];
+		if (parse_sampling_option(argc, argv, i, sampling_policy))
+			continue;
+		if (option == "--eye-plane")
+			eye_plane = true;
+		else if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--policy")
+			policy_name = argv[++i];
+		else if (option == "--random-moves")
+			config.random_moves = std::stoi(argv[++i]);
+		else if (option == "--random-move-horizon")
+			config.random_move_horizon = std::stoi(argv[++i]);
+		else if (option == "--komi")
+			config.komi = std::stof(argv[++i]);
+		else if (option == "--scoring-playouts")
+			config.scoring_playouts = std::stoi(argv[++i]);
+		else if (option == "--threads")
+			thread_count = std::stoi(argv[++i]);
+		else if (option == "--writer-threads")
+			writer_threads = std::stoi(argv[++i]);
+		else if (option == "--seed")
+			seed = std::stoull(argv[++i]);
+		else if (option == "--territory")
+			territory_chunk_path = argv[++i];
+		else if (option == "--record-chunks")
+			record_chunk_path = argv[++i];
+		else if (option == "--tfrecords")
+			tfrecord_path = argv[++i];
+		else if (option == "--game-records")
+			game_records_path = argv[++i];
+		else
+			bad_options = true;
+	}
+	if (bad_options or make_move_policy(policy_name) == nullptr or thread_count < 1 or writer_threads < 1 or config.random_move_horizon < 1 or not (record_chunk_path.empty() or tfrecord_path.empty())) {
+		std::cerr << "Usage: generate_self_play features_chunk.z targets_chunk.z winners_chunk.z round_robin_count game_count [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Plays game_count self-play games and writes their samples round robin over the chunk files, just as" << std::endl;
+		std::cerr << "sgf_to_chunks would for the same games, without any SGF files in between." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --policy name            Move policy: random or capture (default capture)." << std::endl;
+		std::cerr << "  --random-moves n         Random moves injected per game, flagged as random self-play moves (default 1)." << std::endl;
+		std::cerr << "  --random-move-horizon n  Random moves are injected at move numbers below this (default 250)." << std::endl;
+		std::cerr << "  --komi k                 Komi (default 7.5)." << std::endl;
+		std::cerr << "  --scoring-playouts n     Random playouts for finding dead stones when scoring (default " << DEFAULT_SCORING_PLAYOUTS << ")." << std::endl;
+		std::cerr << "  --threads n              Threads playing games (default: one per core)." << std::endl;
+		std::cerr << "  --writer-threads n       Background threads compressing and writing chunks (default 1)." << std::endl;
+		std::cerr << "  --seed n                 Seed; game i is played with seed + i (default 12345)." << std::endl;
+		std::cerr << "  --territory path         Also write territory chunks, as sgf_to_chunks --territory does." << std::endl;
+		std::cerr << "  --eye-plane              Add sgf_to_chunks --eye-plane's extra feature plane." << std::endl;
+		std::cerr << "  --record-chunks base     Write record chunks base_0, base_1, ... instead, as sgf_to_chunks --record-chunks does." << std::endl;
+		std::cerr << "  --tfrecords base         Write TFRecord files base_0, base_1, ... instead, as sgf_to_chunks --tfrecords does." << std::endl;
+		std::cerr << "  --game-records path      Also write every game to a compact game records file." << std::endl;
+		std::cerr << SAMPLING_OPTIONS_USAGE;
+		return 1;
+	}
+
+	std::string features_chunk_path = argv[1];
+	std::string targets_chunk_path  = argv[2];
+	std::string winners_chunk_path  = argv[3];
+	int round_robin_count = std::stoi(argv[4]);
+	int game_count        = std::stoi(argv[5]);
+
+	std::unique_ptr<AsyncChunkSetWriter> chunk_writer;
+	if (not record_chunk_path.empty()) {
+		std::vector<uint32_t> part_bytes = sample_part_bytes(BOARD_SIZE, not territory_chunk_path.empty(), eye_plane);
+		chunk_writer.reset(new AsyncChunkSetWriter(record_chunk_path, part_bytes, round_robin_count, writer_threads));
+	} else if (not tfrecord_path.empty()) {
+		std::vector<uint32_t> part_bytes = sample_part_bytes(BOARD_SIZE, not territory_chunk_path.empty(), eye_plane);
+		std::vector<std::string> part_names = sample_part_names(not territory_chunk_path.empty());
+		chunk_writer.reset(new AsyncChunkSetWriter(tfrecord_path, part_names, part_bytes, round_robin_count, writer_threads));
+	} else {
+		std::vector<std::string> base_paths{features_chunk_path, targets_chunk_path, winners_chunk_path};
+		if (not territory_chunk_path.empty())
+			base_paths.push_back(territory_chunk_path);
+		chunk_writer.reset(new AsyncChunkSetWriter(base_paths, round_robin_count, writer_threads));
+	}
+	AsyncChunkSetWriter& writer = *chunk_writer;
+	std::unique_ptr<GameRecordWriter> records_writer;
+	if (not game_records_path.empty())
+		records_writer.reset(new GameRecordWriter(game_records_path));
+
+	// Workers claim games by index, play and featurise them without locking, and only hold the lock to hand over finished samples.
+	std::mutex output_mutex;
+	std::atomic<int> next_game{0};
+	uint64_t samples_written = 0, moves_played = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	auto worker = [&]() {
+		std::unique_ptr<MovePolicy> policy = make_move_policy(policy_name);
+		SampleBuffer buffer;
+		Game game;
+		AreaScore final_score;
+		std::vector<bool> selected;
+		for (int index; (index = next_game++) < game_count;) {
+			std::mt19937_64 generator(seed + index);
+			play_self_play_game(*policy, config, generator, game, final_score);
+			sampling_policy.select(game, generator, selected);
+			sampling_policy.cap(generator, selected);
+			write_all_samples(buffer, game, selected, territory_chunk_path.empty() ? nullptr : &final_score, eye_plane);
+
+			std::lock_guard<std::mutex> lock(output_mutex);
+			samples_written += buffer.sample_count();
+			moves_played += game.moves.size();
+			buffer.flush_to(writer);
+			if (records_writer)
+				records_writer->write(game);
+			if ((index + 1) % 1000 == 0)
+				printf("Played %i games.\n", index + 1);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++)
+		threads.emplace_back(worker);
+	for (std::thread& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	writer.close();
+	printf("Played %i games (%llu moves) and wrote %llu samples in %.1fs on %i threads: %.0f games/hour/core.\n",
+		game_count, (unsigned long long)moves_played, (unsigned long long)samples_written, seconds, thread_count,
+		game_count / (seconds / 3600) / thread_count);
+	writer.report(std::cout);
+}
@@ -10,6 +10,7 @@
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
 using std::cout;
 using std::endl;
 using std::vector;
@@ -27,7 +28,7 @@ std::ostream& operator <<(std::ostream& os, const Coord& xy) {
 	return os;
 }
 
-std::ostream& operator <<(std::ostream& os, const GoBoard::Group& group) {
+std::ostream& operator <<(std::ostream& os, const StoneGroup& group) {
 	os << "<";
 	for (auto xy : group.stones)
 		os << xy << " ";
@@ -38,9 +39,10 @@ std::ostream& operator <<(std::ostream& os, const GoBoard::Group& group) {
 	return os;
 }
 
-std::ostream& operator <<(std::ostream& os, const GoBoard& board) {
-	for (int y = 0; y < BOARD_SIZE; y++) {
-		for (int x = 0; x < BOARD_SIZE; x++) {
+template <int SIZE>
+std::ostream& operator <<(std::ostream& os, const GoBoardOfSize<SIZE>& board) {
+	for (int y = 0; y < SIZE; y++) {
+		for (int x = 0; x < SIZE; x++) {
 			cout << unordered_map<Cell, string>{{0, "."}, {1, "#"}, {2, "o"}}[piece_at(board, {x, y})] << " ";
 		}
 		cout << endl;
@@ -49,8 +51,8 @@ std::ostream& operator <<(std::ostream& os, const GoBoard& board) {
 }
 
 template <>
-struct merge_trait<GoBoard::Group> {
-	static void merge_values(GoBoard::Group& g1, GoBoard::Group& g2) {
+struct merge_trait<StoneGroup> {
+	static void merge_values(StoneGroup& g1, StoneGroup& g2) {
 		assert(g1.owner == g2.owner);
 		g1.stones.insert(g2.stones.begin(), g2.stones.end());
 		g1.liberties.insert(g2.liberties.begin(), g2.liberties.end());
@@ -61,20 +63,61 @@ struct merge_trait<GoBoard::Group> {
 	}
 };
 
-void GoBoard::remove_group(DisjointSet<Coord, Group>::DisjointSetNode* node) {
+template <int SIZE>
+GoBoardOfSize<SIZE> GoBoardOfSize<SIZE>::from_cells(const std::array<Cell, SIZE * SIZE>& cells) {
+	GoBoardOfSize<SIZE> board;
+	board.cells = cells;
+	std::array<bool, SIZE * SIZE> visited = {};
+	std::array<int16_t, SIZE * SIZE> stack;
+	for (int point = 0; point < SIZE * SIZE; point++) {
+		assert(cells[point] <= 2);
+		if (cells[point] == 0 or visited[point])
+			continue;
+		// Flood fill the group, picking up its stones and liberties as we go.
+		Cell colour = cells[point];
+		Group group{(Player)colour, {}, {}};
+		int stack_size = 0;
+		stack[stack_size++] = point;
+		visited[point] = true;
+		while (stack_size > 0) {
+			int here = stack[--stack_size];
+			group.stones.insert({here % SIZE, here / SIZE});
+			for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+				if (neighbor < 0)
+					continue;
+				if (cells[neighbor] == 0) {
+					group.liberties.insert({neighbor % SIZE, neighbor / SIZE});
+				} else if (cells[neighbor] == colour and not visited[neighbor]) {
+					visited[neighbor] = true;
+					stack[stack_size++] = neighbor;
+				}
+			}
+		}
+		// The first stone carries the group, and every other stone hangs directly off it.
+		Coord root_xy = {point % SIZE, point / SIZE};
+		auto root = board.groups.make_node(root_xy, std::move(group));
+		for (const Coord& xy : root->value.stones)
+			if (xy != root_xy)
+				board.groups.make_child_node(xy, root);
+	}
+	board.recompute_patterns();
+	return board;
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::remove_group(typename DisjointSet<Coord, Group>::DisjointSetNode* node, std::vector<Coord>* liberties_gained) {
 	node = groups.find(node);
 	groups.root_nodes.erase(node);
 	// First erase all of our key_to_node entries.
 	for (const Coord& xy : node->value.stones) {
 		groups.key_to_node.erase(xy);
-		Cell& cell = piece_at(cells, xy);
-		assert(cell == (int)node->value.owner);
-		cell = 0;
+		assert(piece_at(cells, xy) == (int)node->value.owner);
+		set_cell(xy.first + xy.second * SIZE, 0);
 	}
 	// Then find all of our neighbors and increment their libery counts.
 	for (const Coord& xy : node->value.stones) {
 		for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy)) {
-			if (not coord_in_bounds(neighbor_xy))
+			if (not coord_in_bounds<SIZE>(neighbor_xy))
 				continue;
 			// Look for a neighboring group at neighbor_xy.
 			auto it = groups.key_to_node.find(neighbor_xy);
@@ -83,34 +126,42 @@ void GoBoard::remove_group(DisjointSet<Coord, Group>::DisjointSetNode* node) {
 				// At this point it should be impossible for a neigbhor to be of the same color, as we would have been in the same group.
 				assert(other_node->value.owner != node->value.owner);
 				groups.find(other_node)->value.liberties.insert(xy);
+				if (liberties_gained != nullptr)
+					liberties_gained->push_back(neighbor_xy);
 			}
 		}
 	}
 }
 
-void GoBoard::eliminate_dead_stones_of(Player color) {
-	vector<DisjointSet<Coord, Group>::DisjointSetNode*> to_remove;
-	for (DisjointSet<Coord, Group>::DisjointSetNode* node : groups.root_nodes) {
+template <int SIZE>
+void GoBoardOfSize<SIZE>::eliminate_dead_stones_of(Player color, std::vector<Coord>* liberties_gained) {
+	vector<typename DisjointSet<Coord, Group>::DisjointSetNode*> to_remove;
+	for (typename DisjointSet<Coord, Group>::DisjointSetNode* node : groups.root_nodes) {
 		if (node->value.owner == color and node->value.liberties.size() == 0)
 			to_remove.push_back(node);
 	}
 	for (auto node : to_remove)
-		remove_group(node);
+		remove_group(node, liberties_gained);
 }
 
-void GoBoard::place_stone(Player color, Coord xy) {
+template <int SIZE>
+void GoBoardOfSize<SIZE>::place_stone(Player color, Coord xy) {
 	// First, check that the location is free.
-	Cell& cell = piece_at(cells, xy);
-	assert(cell == (int)Player::NOBODY);
+	assert(piece_at(cells, xy) == (int)Player::NOBODY);
+	set_cell(xy.first + xy.second * SIZE, (Cell)color);
 
-	cell = (int)color;
+	// Note whether the groups we're about to join were in atari, to know whether their atari bits need rewriting.
+	bool joined_in_atari[2] = {false, false};
+	for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy))
+		if (coord_in_bounds<SIZE>(neighbor_xy) and piece_at(cells, neighbor_xy) == (int)color)
+			joined_in_atari[atari_bits_say_in_atari(neighbor_xy)] = true;
 
 	// Make a group for the node.
-	DisjointSet<Coord, Group>::DisjointSetNode* node = groups.make_node(xy, {color, {xy}, {}});
+	typename DisjointSet<Coord, Group>::DisjointSetNode* node = groups.make_node(xy, {color, {xy}, {}});
 
 	// Try to merge with neighbors, and also update liberties for us and neighbors.
 	for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy)) {
-		if (not coord_in_bounds(neighbor_xy))
+		if (not coord_in_bounds<SIZE>(neighbor_xy))
 			continue;
 		// Look for a neighboring group at neighbor_xy.
 		auto it = groups.key_to_node.find(neighbor_xy);
@@ -128,24 +179,202 @@ void GoBoard::place_stone(Player color, Coord xy) {
 		}
 	}
 
+	// Note what we're about to capture, for the simple ko rule.
+	int captured = 0;
+	Coord captured_xy = {-1, -1};
+	vector<typename DisjointSet<Coord, Group>::DisjointSetNode*> captured_groups;
+	for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy)) {
+		if (not coord_in_bounds<SIZE>(neighbor_xy) or piece_at(cells, neighbor_xy) != (int)opponent_of(color))
+			continue;
+		auto other_node = groups.find(neighbor_xy);
+		if (other_node->value.liberties.size() == 0 and std::find(captured_groups.begin(), captured_groups.end(), other_node) == captured_groups.end()) {
+			captured_groups.push_back(other_node);
+			captured += other_node->value.stones.size();
+			captured_xy = neighbor_xy;
+		}
+	}
+
 	// Eliminate enemy groups with zero liberties.
-	eliminate_dead_stones_of(opponent_of(color));
-	eliminate_dead_stones_of(color);
+	std::vector<Coord> liberties_gained;
+	eliminate_dead_stones_of(opponent_of(color), &liberties_gained);
+	eliminate_dead_stones_of(color, &liberties_gained);
+
+	// Our group's atari bits only need rewriting everywhere if some part of it changed status, and otherwise just
+	// around the new stone. After that every other group's bits are consistent, so the groups whose liberties changed
+	// can each be checked against their own.
+	if (piece_at(cells, xy) == (int)color) {
+		node = groups.find(xy);
+		bool in_atari = node->value.liberties.size() == 1;
+		if (joined_in_atari[not in_atari])
+			set_atari_bits(node->value, in_atari);
+		else
+			set_atari_bits(xy, in_atari);
+	}
+	for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy))
+		if (coord_in_bounds<SIZE>(neighbor_xy))
+			refresh_atari_bits(neighbor_xy);
+	for (Coord stone : liberties_gained)
+		refresh_atari_bits(stone);
+
+	// Capturing one stone with a lone stone left in atari makes a ko.
+	bool is_ko = captured == 1 and piece_at(cells, xy) == (int)color and group_size(xy) == 1 and liberty_count(xy) == 1;
+	ko_point = is_ko ? captured_xy : Coord{-1, -1};
 }
 
-int GoBoard::liberty_count(Coord xy) {
-	assert(coord_in_bounds(xy));
+template <int SIZE>
+bool GoBoardOfSize<SIZE>::is_legal(Player who, Coord xy) {
+	if (not coord_in_bounds<SIZE>(xy) or piece_at(cells, xy) != 0 or xy == ko_point)
+		return false;
+	// The move needs a liberty, a friendly group to connect to with a spare liberty, or something to capture.
+	for (auto neighbor_xy : NEIGHBORS_INIT_LIST(xy)) {
+		if (not coord_in_bounds<SIZE>(neighbor_xy))
+			continue;
+		Cell neighbor = piece_at(cells, neighbor_xy);
+		if (neighbor == 0)
+			return true;
+		int liberties = liberty_count(neighbor_xy);
+		if (neighbor == (int)who ? liberties >= 2 : liberties == 1)
+			return true;
+	}
+	return false;
+}
+
+template <int SIZE>
+int GoBoardOfSize<SIZE>::liberty_count(Coord xy) {
+	assert(coord_in_bounds<SIZE>(xy));
 	auto it = groups.key_to_node.find(xy);
 	if (it == groups.key_to_node.end())
 		return 0;
 	return groups.find((*it).second)->value.liberties.size();
 }
 
-int GoBoard::group_size(Coord xy) {
-	assert(coord_in_bounds(xy));
+template <int SIZE>
+uint32_t GoBoardOfSize<SIZE>::pattern_at(Coord xy) const {
+	assert(coord_in_bounds<SIZE>(xy));
+	return patterns[xy.first + xy.second * SIZE];
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::set_cell(int point, Cell colour) {
+	cells[point] = colour;
+	for (int i = 0; i < PATTERN_NEIGHBOURS; i++) {
+		int neighbor = PATTERN_NEIGHBORS<SIZE>[point][i];
+		if (neighbor < 0)
+			continue;
+		int j = PATTERN_NEIGHBOURS - 1 - i;
+		uint32_t& pattern = patterns[neighbor];
+		pattern = (pattern & ~(3u << (2 * j))) | (uint32_t)colour << (2 * j);
+		if (colour == 0 and PATTERN_ATARI_BIT[j] >= 0)
+			pattern &= ~(1u << (PATTERN_ATARI_SHIFT + PATTERN_ATARI_BIT[j]));
+	}
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::set_atari_bits(Coord stone, bool in_atari) {
+	int point = stone.first + stone.second * SIZE;
+	for (int i = 0; i < PATTERN_NEIGHBOURS; i++) {
+		int neighbor = PATTERN_NEIGHBORS<SIZE>[point][i];
+		if (neighbor < 0 or PATTERN_ATARI_BIT[i] < 0)
+			continue;
+		uint32_t bit = 1u << (PATTERN_ATARI_SHIFT + PATTERN_ATARI_BIT[PATTERN_NEIGHBOURS - 1 - i]);
+		patterns[neighbor] = in_atari ? patterns[neighbor] | bit : patterns[neighbor] & ~bit;
+	}
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::set_atari_bits(const Group& group, bool in_atari) {
+	for (const Coord& stone : group.stones)
+		set_atari_bits(stone, in_atari);
+}
+
+template <int SIZE>
+bool GoBoardOfSize<SIZE>::atari_bits_say_in_atari(Coord xy) const {
+	int point = xy.first + xy.second * SIZE;
+	for (int i = 0; i < PATTERN_NEIGHBOURS; i++) {
+		int neighbor = PATTERN_NEIGHBORS<SIZE>[point][i];
+		if (neighbor >= 0 and PATTERN_ATARI_BIT[i] >= 0)
+			return pattern_neighbour_in_atari(patterns[neighbor], PATTERN_NEIGHBOURS - 1 - i);
+	}
+	return false;
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::refresh_atari_bits(Coord xy) {
+	if (piece_at(cells, xy) == 0)
+		return;
+	const Group& group = groups.find(xy)->value;
+	bool in_atari = group.liberties.size() == 1;
+	if (atari_bits_say_in_atari(xy) != in_atari)
+		set_atari_bits(group, in_atari);
+}
+
+template <int SIZE>
+void GoBoardOfSize<SIZE>::recompute_patterns() {
+	patterns = EMPTY_BOARD_PATTERNS<SIZE>;
+	for (int point = 0; point < SIZE * SIZE; point++)
+		if (cells[point] != 0)
+			set_cell(point, cells[point]);
+	for (auto node : groups.root_nodes)
+		set_atari_bits(node->value, node->value.liberties.size() == 1);
+}
+
+template <int SIZE>
+int GoBoardOfSize<SIZE>::group_size(Coord xy) {
+	assert(coord_in_bounds<SIZE>(xy));
 	auto it = groups.key_to_node.find(xy);
 	if (it == groups.key_to_node.end())
 		return 0;
 	return groups.find((*it).second)->value.stones.size();
 }
 
+template <int SIZE>
+void BoardAnalysisOfSize<SIZE>::analyse(const std::array<Cell, SIZE * SIZE>& cells) {
+	group_id.fill(NO_GROUP);
+	group_size.fill(0);
+	liberties.fill(0);
+	capture_size[0].fill(0);
+	capture_size[1].fill(0);
+	liberty_stamp.fill(NO_GROUP);
+	group_count = 0;
+	for (int point = 0; point < SIZE * SIZE; point++) {
+		assert(cells[point] <= 2);
+		if (cells[point] == 0 or group_id[point] != NO_GROUP)
+			continue;
+		// Flood fill the group, leaving its stones on the stack and counting each liberty the first time it's reached.
+		Cell colour = cells[point];
+		int id = group_count++;
+		int size = 0, liberty_count = 0, last_liberty = -1;
+		stack[size++] = point;
+		group_id[point] = id;
+		for (int next = 0; next < size; next++) {
+			for (int neighbor : POINT_NEIGHBORS<SIZE>[stack[next]]) {
+				if (neighbor < 0)
+					continue;
+				if (cells[neighbor] == 0) {
+					if (liberty_stamp[neighbor] != id) {
+						liberty_stamp[neighbor] = id;
+						liberty_count++;
+						last_liberty = neighbor;
+					}
+				} else if (cells[neighbor] == colour and group_id[neighbor] == NO_GROUP) {
+					group_id[neighbor] = id;
+					stack[size++] = neighbor;
+				}
+			}
+		}
+		for (int i = 0; i < size; i++) {
+			group_size[stack[i]] = size;
+			liberties[stack[i]] = liberty_count;
+		}
+		// A group in atari is captured by the other player filling its last liberty.
+		if (liberty_count == 1)
+			capture_size[2 - colour][last_liberty] += size;
+	}
+}
+
+#define INSTANTIATE(SIZE) \
+	template struct GoBoardOfSize<SIZE>; \
+	template struct BoardAnalysisOfSize<SIZE>; \
+	template std::ostream& operator <<(std::ostream& os, const GoBoardOfSize<SIZE>& board);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
@@ -8,6 +8,7 @@
 #include <memory>
 #include <array>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -41,6 +42,14 @@ static inline Player opponent_of(Player p) {
 	return p == Player::BLACK ? Player::WHITE : Player::BLACK;
 }
 
+// The SplitMix64 finaliser, for mixing game data into well spread 64-bit hashes.
+static inline constexpr uint64_t splitmix64(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
 template <typename T>
 struct merge_trait {
 	static void merge_values(T& a, T& b);
@@ -64,7 +73,7 @@ struct DisjointSet {
 		assert(it == key_to_node.end());
 //		if (it != key_to_node.end())
 //			return (*it).second;
-		DisjointSetNode* node = new DisjointSetNode{nullptr, 0, key, value};
+		DisjointSetNode* node = new DisjointSetNode{nullptr, 0, key, std::move(value)};
 		node->parent = node;
 		// Add a unique_ptr into nodes to handle destruction.
 //		std::unique_ptr<DisjointSetNode> p(node);
@@ -76,6 +85,16 @@ struct DisjointSet {
 		return node;
 	}
 
+	// Adds key directly under root, for building sets whose members are all known up front. The node's own value is never read.
+	DisjointSetNode* make_child_node(Key key, DisjointSetNode* root) {
+		assert(key_to_node.count(key) == 0 and root->parent == root);
+		DisjointSetNode* node = new DisjointSetNode{root, 0, key, Value{}};
+		nodes.emplace_back(node);
+		key_to_node[key] = node;
+		root->rank = std::max(root->rank, 1);
+		return node;
+	}
+
 	inline bool contains(Key key) {
 		return key_to_node.count(key) != 0;
 	}
@@ -118,45 +137,185 @@ struct DisjointSet {
 	}
 };
 
-struct GoBoard {
-	struct Group {
-		Player owner;
-		std::unordered_set<Coord> stones;
-		std::unordered_set<Coord> liberties;
-	};
+// The board sizes the pipeline is instantiated for. BOARD_SIZE is the default, used wherever a size isn't given.
+#define SNPGO_FOR_EACH_BOARD_SIZE(X) X(9) X(13) X(19)
+
+constexpr int board_size_of_cell_count(size_t cell_count) {
+	int size = 0;
+	while ((size_t)(size * size) < cell_count)
+		size++;
+	return size;
+}
+
+template <int SIZE>
+static inline bool coord_in_bounds(Coord xy) {
+	return 0 <= xy.first and xy.first < SIZE and 0 <= xy.second and xy.second < SIZE;
+}
+
+static inline bool coord_in_bounds(Coord xy) {
+	return coord_in_bounds<BOARD_SIZE>(xy);
+}
+
+// 3x3 pattern codes. Bits 2i and 2i + 1 hold neighbour i, in raster order (NW, N, NE, W, E, SW, S, SE), as 0 for empty,
+// 1 for black, 2 for white or 3 for off the board. Bits 16 to 19 are set where the orthogonal neighbour N, W, E or S
+// is a stone whose group has exactly one liberty. Neighbour i of a point sees that point as its neighbour 7 - i.
+constexpr int PATTERN_NEIGHBOURS = 8;
+constexpr Cell PATTERN_OFF_BOARD = 3;
+constexpr int PATTERN_ATARI_SHIFT = 16;
+constexpr int PATTERN_DX[PATTERN_NEIGHBOURS] = {-1, 0, 1, -1, 1, -1, 0, 1};
+constexpr int PATTERN_DY[PATTERN_NEIGHBOURS] = {-1, -1, -1, 0, 0, 1, 1, 1};
+// Which atari bit each neighbour has, or -1 for the diagonals.
+constexpr int PATTERN_ATARI_BIT[PATTERN_NEIGHBOURS] = {-1, 0, -1, 1, 2, -1, 3, -1};
+
+static inline constexpr Cell pattern_neighbour(uint32_t pattern, int i) {
+	return pattern >> (2 * i) & 3;
+}
+
+static inline constexpr bool pattern_neighbour_in_atari(uint32_t pattern, int i) {
+	return PATTERN_ATARI_BIT[i] >= 0 and (pattern >> (PATTERN_ATARI_SHIFT + PATTERN_ATARI_BIT[i]) & 1);
+}
+
+// The same pattern with black and white exchanged, for looking patterns up from one player's point of view.
+static inline constexpr uint32_t swap_pattern_colours(uint32_t pattern) {
+	uint32_t one_colour = (pattern ^ (pattern >> 1)) & 0x5555;
+	return pattern ^ (one_colour | one_colour << 1);
+}
+
+// Would an empty point with this pattern be an eye for colour, by the playout rule is_playout_eye uses?
+static inline constexpr bool pattern_is_eye(uint32_t pattern, Cell colour) {
+	int opponent_diagonals = 0, off_board_diagonals = 0;
+	for (int i = 0; i < PATTERN_NEIGHBOURS; i++) {
+		Cell neighbour = pattern_neighbour(pattern, i);
+		if (PATTERN_ATARI_BIT[i] >= 0 and neighbour != colour and neighbour != PATTERN_OFF_BOARD)
+			return false;
+		if (PATTERN_ATARI_BIT[i] < 0) {
+			off_board_diagonals += neighbour == PATTERN_OFF_BOARD;
+			opponent_diagonals += neighbour == 3 - colour;
+		}
+	}
+	return opponent_diagonals < (off_board_diagonals > 0 ? 1 : 2);
+}
+
+template <int SIZE>
+constexpr std::array<std::array<int16_t, PATTERN_NEIGHBOURS>, SIZE * SIZE> make_pattern_neighbors() {
+	std::array<std::array<int16_t, PATTERN_NEIGHBOURS>, SIZE * SIZE> table = {};
+	for (int point = 0; point < SIZE * SIZE; point++) {
+		for (int i = 0; i < PATTERN_NEIGHBOURS; i++) {
+			int x = point % SIZE + PATTERN_DX[i], y = point / SIZE + PATTERN_DY[i];
+			table[point][i] = 0 <= x and x < SIZE and 0 <= y and y < SIZE ? x + y * SIZE : -1;
+		}
+	}
+	return table;
+}
+
+// Flat indices of the eight pattern neighbours of every point, with -1 for off the board.
+template <int SIZE>
+inline constexpr std::array<std::array<int16_t, PATTERN_NEIGHBOURS>, SIZE * SIZE> PATTERN_NEIGHBORS = make_pattern_neighbors<SIZE>();
+
+template <int SIZE>
+constexpr std::array<uint32_t, SIZE * SIZE> make_empty_board_patterns() {
+	std::array<uint32_t, SIZE * SIZE> patterns = {};
+	for (int point = 0; point < SIZE * SIZE; point++)
+		for (int i = 0; i < PATTERN_NEIGHBOURS; i++)
+			if (PATTERN_NEIGHBORS<SIZE>[point][i] < 0)
+				patterns[point] |= (uint32_t)PATTERN_OFF_BOARD << (2 * i);
+	return patterns;
+}
+
+template <int SIZE>
+inline constexpr std::array<uint32_t, SIZE * SIZE> EMPTY_BOARD_PATTERNS = make_empty_board_patterns<SIZE>();
+
+struct StoneGroup {
+	Player owner;
+	std::unordered_set<Coord> stones;
+	std::unordered_set<Coord> liberties;
+};
+
+template <int SIZE>
+struct GoBoardOfSize {
+	constexpr static int size = SIZE;
+	typedef StoneGroup Group;
 
 	DisjointSet<Coord, Group> groups;
-	std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells = {};
+	std::array<Cell, SIZE * SIZE> cells = {};
+	// Where the last move captured a single stone in a way the opponent can't immediately retake, or (-1, -1).
+	Coord ko_point = {-1, -1};
+	// The 3x3 pattern code of every point. Placing or removing a stone only updates its eight neighbours' codes,
+	// and a group's atari bits are only rewritten when it goes into or out of atari.
+	std::array<uint32_t, SIZE * SIZE> patterns = EMPTY_BOARD_PATTERNS<SIZE>;
 
-	void remove_group(DisjointSet<Coord, Group>::DisjointSetNode* group);
-	void eliminate_dead_stones_of(Player color);
+	// Builds the board for a whole position at once, labelling each group and collecting its liberties in a single
+	// flood fill, rather than placing the stones one by one. Nothing is captured, so the position should be legal.
+	static GoBoardOfSize from_cells(const std::array<Cell, SIZE * SIZE>& cells);
+
+	// Notes a stone of each group that gains liberties in liberties_gained, if given.
+	void remove_group(typename DisjointSet<Coord, Group>::DisjointSetNode* group, std::vector<Coord>* liberties_gained = nullptr);
+	void eliminate_dead_stones_of(Player color, std::vector<Coord>* liberties_gained = nullptr);
 	void place_stone(Player who, Coord xy);
+	void pass() { ko_point = {-1, -1}; }
+	// Is xy empty, not the ko point, and not suicide for who?
+	bool is_legal(Player who, Coord xy);
 	int liberty_count(Coord xy);
 	int group_size(Coord xy);
+	uint32_t pattern_at(Coord xy) const;
+
+	// Sets a cell along with its neighbours' pattern codes, clearing any atari bits that pointed at it.
+	void set_cell(int point, Cell colour);
+	// Rewrites the atari bits pointing at one stone, or at every stone of a group.
+	void set_atari_bits(Coord stone, bool in_atari);
+	void set_atari_bits(const Group& group, bool in_atari);
+	// What the atari bits around the stone at xy currently say about its group.
+	bool atari_bits_say_in_atari(Coord xy) const;
+	// Brings the atari bits of the group at xy, if it's still there, up to date.
+	void refresh_atari_bits(Coord xy);
+	void recompute_patterns();
 };
 
-static inline bool coord_in_bounds(Coord xy) {
-	return 0 <= xy.first and xy.first < BOARD_SIZE and 0 <= xy.second and xy.second < BOARD_SIZE;
-}
+typedef GoBoardOfSize<BOARD_SIZE> GoBoard;
 
-static inline Cell& piece_at(std::array<Cell, BOARD_SIZE * BOARD_SIZE>& board, Coord xy) {
-	assert(coord_in_bounds(xy));
-	return board[xy.first + xy.second * BOARD_SIZE];
+template <size_t CELLS>
+static inline Cell& piece_at(std::array<Cell, CELLS>& board, Coord xy) {
+	constexpr int size = board_size_of_cell_count(CELLS);
+	assert(coord_in_bounds<size>(xy));
+	return board[xy.first + xy.second * size];
 }
 
-static inline const Cell& piece_at(const std::array<Cell, BOARD_SIZE * BOARD_SIZE>& board, Coord xy) {
-	assert(coord_in_bounds(xy));
-	return board[xy.first + xy.second * BOARD_SIZE];
+template <size_t CELLS>
+static inline const Cell& piece_at(const std::array<Cell, CELLS>& board, Coord xy) {
+	constexpr int size = board_size_of_cell_count(CELLS);
+	assert(coord_in_bounds<size>(xy));
+	return board[xy.first + xy.second * size];
 }
 
-static inline Cell& piece_at(GoBoard& board, Coord xy) {
+template <int SIZE>
+static inline Cell& piece_at(GoBoardOfSize<SIZE>& board, Coord xy) {
 	return piece_at(board.cells, xy);
 }
 
-static inline const Cell& piece_at(const GoBoard& board, Coord xy) {
+template <int SIZE>
+static inline const Cell& piece_at(const GoBoardOfSize<SIZE>& board, Coord xy) {
 	return piece_at(board.cells, xy);
 }
 
+template <int SIZE>
+constexpr std::array<std::array<int16_t, 4>, SIZE * SIZE> make_point_neighbors() {
+	std::array<std::array<int16_t, 4>, SIZE * SIZE> table = {};
+	for (int y = 0; y < SIZE; y++) {
+		for (int x = 0; x < SIZE; x++) {
+			int16_t* neighbors = &table[x + y * SIZE][0];
+			neighbors[0] = x > 0        ? (x - 1) + y * SIZE : -1;
+			neighbors[1] = x < SIZE - 1 ? (x + 1) + y * SIZE : -1;
+			neighbors[2] = y > 0        ? x + (y - 1) * SIZE : -1;
+			neighbors[3] = y < SIZE - 1 ? x + (y + 1) * SIZE : -1;
+		}
+	}
+	return table;
+}
+
+// Flat indices (x + y * SIZE) of the four neighbors of every point, with -1 for off the board. Built at compile time.
+template <int SIZE>
+inline constexpr std::array<std::array<int16_t, 4>, SIZE * SIZE> POINT_NEIGHBORS = make_point_neighbors<SIZE>();
+
 #define NEIGHBORS_INIT_LIST(xy) { \
 	Coord{(xy).first - 1, (xy).second}, \
 	Coord{(xy).first + 1, (xy).second}, \
@@ -164,9 +323,44 @@ static inline const Cell& piece_at(const GoBoard& board, Coord xy) {
 	Coord{(xy).first, (xy).second + 1} \
 }
 
+// Everything about a position's groups that the features read, from one flood fill over its cells into flat per-point
+// arrays, so readers never go through the board's hashed groups. Keep one around and reuse it: analyse overwrites it all.
+template <int SIZE>
+struct BoardAnalysisOfSize {
+	constexpr static int NO_GROUP = -1;
+
+	// For stones, their group's number (groups are numbered in order of their first point), and NO_GROUP for empty points.
+	std::array<int16_t, SIZE * SIZE> group_id;
+	// For stones, the size and the liberty count of their group, and 0 for empty points.
+	std::array<int16_t, SIZE * SIZE> group_size;
+	std::array<int16_t, SIZE * SIZE> liberties;
+	// For empty points, how many stones a move there by each player (indexed by colour - 1) would capture: the total size
+	// of the distinct neighbouring opponent groups in atari.
+	std::array<std::array<int16_t, SIZE * SIZE>, 2> capture_size;
+	int group_count;
+
+	void analyse(const std::array<Cell, SIZE * SIZE>& cells);
+	int captures_for(Player who, int point) const { return capture_size[(int)who - 1][point]; }
+	// Whether some group has no liberties, which play never leaves on the board but a position built from cells can have.
+	bool has_group_without_liberties() const {
+		for (int point = 0; point < SIZE * SIZE; point++)
+			if (group_size[point] > 0 and liberties[point] == 0)
+				return true;
+		return false;
+	}
+
+private:
+	// Scratch for the flood fills: the stack, and each point's stamp of the last group that counted it as a liberty.
+	std::array<int16_t, SIZE * SIZE> stack;
+	std::array<int16_t, SIZE * SIZE> liberty_stamp;
+};
+
+typedef BoardAnalysisOfSize<BOARD_SIZE> BoardAnalysis;
+
 std::ostream& operator <<(std::ostream& os, const Coord& xy);
-std::ostream& operator <<(std::ostream& os, const GoBoard::Group& group);
-std::ostream& operator <<(std::ostream& os, const GoBoard& group);
+std::ostream& operator <<(std::ostream& os, const StoneGroup& group);
+template <int SIZE>
+std::ostream& operator <<(std::ostream& os, const GoBoardOfSize<SIZE>& board);
 
 #endif
 
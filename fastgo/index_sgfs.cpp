@@ -0,0 +1,65 @@
+// Index the root node metadata of every SGF under a directory, so conversions can skip unwanted games unopened.
+
+#include "sgf.h"
+#include "sgf_index.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <boost/filesystem.hpp>
+
+int main(int argc, char** argv) {
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	bool bad_options = argc < 3;
+	for (int i = 3; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--threads" and i + 1 < argc)
+			thread_count = std::stoi(argv[++i]);
+		else
+			bad_options = true;
+	}
+	if (bad_options or thread_count < 1) {
+		std::cerr << "Usage: index_sgfs root_directory index_path [--threads n]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Parses just the root node of every SGF under root_directory and writes a columnar index of their" << std::endl;
+		std::cerr << "board sizes, komis, results, ranks, handicaps and move counts, for sgf_to_chunks --index." << std::endl;
+		return 1;
+	}
+	std::string root_directory_path = argv[1];
+	std::string index_path = argv[2];
+
+	// Store paths relative to the root, in the same order sgf_to_chunks sorts them in before shuffling.
+	SgfIndex index;
+	boost::filesystem::path root(root_directory_path);
+	boost::filesystem::recursive_directory_iterator dir(root);
+	for (auto entry : dir)
+		if (boost::filesystem::extension(entry) == ".sgf")
+			index.paths.push_back(boost::filesystem::relative(entry.path(), root).string());
+	std::sort(index.paths.begin(), index.paths.end());
+	index.resize(index.paths.size());
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next_file{0};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++) {
+		threads.emplace_back([&]() {
+			for (size_t i; (i = next_file++) < index.size();)
+				index.index_file(root_directory_path, i);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (not index.save(index_path)) {
+		std::cerr << "Failed to write " << index_path << std::endl;
+		return 1;
+	}
+	size_t accepted = std::count(index.accepted.begin(), index.accepted.end(), 1);
+	printf("Indexed %zu SGF files (%zu accepted) in %.2fs.\n", index.size(), accepted, seconds);
+}
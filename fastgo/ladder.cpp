@@ -0,0 +1,193 @@
+// Bounded ladder reading for the ladder feature planes.
+
+#include "ladder.h"
+#include <algorithm>
+
+template <int SIZE>
+void LadderReaderOfSize<SIZE>::next_generation() {
+	// On wraparound stale marks would collide with the new generation, so clear them.
+	if (++generation == 0) {
+		marks.fill(0);
+		generation = 1;
+	}
+}
+
+template <int SIZE>
+int LadderReaderOfSize<SIZE>::count_liberties(const Cells& cells, int point, int max_liberties, int* liberties, uint8_t* group_stones) {
+	Cell colour = cells[point];
+	next_generation();
+	int count = 0, stack_size = 0;
+	stack[stack_size++] = point;
+	marks[point] = generation;
+	while (stack_size > 0) {
+		int here = stack[--stack_size];
+		if (group_stones != nullptr)
+			group_stones[here] = 1;
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+			if (neighbor < 0 or marks[neighbor] == generation)
+				continue;
+			if (cells[neighbor] == 0) {
+				marks[neighbor] = generation;
+				if (count < max_liberties)
+					liberties[count] = neighbor;
+				// Once we're over the limit the caller doesn't care about the exact count.
+				if (++count > max_liberties)
+					return count;
+			} else if (cells[neighbor] == colour) {
+				marks[neighbor] = generation;
+				stack[stack_size++] = neighbor;
+			}
+		}
+	}
+	return count;
+}
+
+template <int SIZE>
+void LadderReaderOfSize<SIZE>::remove_group(Cells& cells, int point) {
+	Cell colour = cells[point];
+	int stack_size = 0;
+	stack[stack_size++] = point;
+	cells[point] = 0;
+	while (stack_size > 0) {
+		int here = stack[--stack_size];
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+			if (neighbor >= 0 and cells[neighbor] == colour) {
+				cells[neighbor] = 0;
+				stack[stack_size++] = neighbor;
+			}
+		}
+	}
+}
+
+// Returns false (leaving the cells in an unspecified state) if the move is suicide.
+template <int SIZE>
+bool LadderReaderOfSize<SIZE>::play(Cells& cells, int point, Cell colour) {
+	assert(cells[point] == 0);
+	cells[point] = colour;
+	int scratch[1];
+	for (int neighbor : POINT_NEIGHBORS<SIZE>[point]) {
+		if (neighbor >= 0 and cells[neighbor] == 3 - colour and count_liberties(cells, neighbor, 0, scratch) == 0)
+			remove_group(cells, neighbor);
+	}
+	return count_liberties(cells, point, 0, scratch) > 0;
+}
+
+// The group at prey has exactly one liberty and its owner is to move. Is it captured?
+template <int SIZE>
+bool LadderReaderOfSize<SIZE>::prey_is_captured(const Cells& cells, int prey, int depth) {
+	if (depth >= MAX_LADDER_DEPTH or ++nodes > MAX_LADDER_NODES)
+		return false;
+	Cell prey_colour = cells[prey];
+
+	// The prey may extend at its liberty, or capture an adjacent attacking group that is itself in atari.
+	int candidates[MAX_LADDER_CANDIDATES];
+	int candidate_count = count_liberties(cells, prey, 1, candidates);
+	assert(candidate_count == 1);
+
+	// Collect the prey's stones first, as counting the attackers' liberties reuses the flood fill scratch.
+	next_generation();
+	int group_size = 0, stack_size = 0;
+	stack[stack_size++] = prey;
+	marks[prey] = generation;
+	while (stack_size > 0) {
+		int here = stack[--stack_size];
+		group[group_size++] = here;
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+			if (neighbor >= 0 and cells[neighbor] == prey_colour and marks[neighbor] != generation) {
+				marks[neighbor] = generation;
+				stack[stack_size++] = neighbor;
+			}
+		}
+	}
+	// Each adjacent attacking group is only examined once, however many prey stones it touches.
+	std::array<uint8_t, point_count(SIZE)> examined = {};
+	for (int g = 0; g < group_size; g++) {
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[group[g]]) {
+			if (neighbor < 0 or cells[neighbor] != 3 - prey_colour or examined[neighbor] or candidate_count == MAX_LADDER_CANDIDATES)
+				continue;
+			int liberty;
+			if (count_liberties(cells, neighbor, 1, &liberty, &examined[0]) == 1 and std::find(candidates, candidates + candidate_count, liberty) == candidates + candidate_count)
+				candidates[candidate_count++] = liberty;
+		}
+	}
+
+	for (int c = 0; c < candidate_count; c++) {
+		Cells next = cells;
+		if (not play(next, candidates[c], prey_colour))
+			continue;
+		int liberties[2];
+		int liberty_count = count_liberties(next, prey, 2, liberties);
+		if (liberty_count >= 3)
+			return false;
+		if (liberty_count == 2 and not attacker_captures(next, prey, depth + 1))
+			return false;
+	}
+	return true;
+}
+
+// The group at prey has exactly two liberties and the attacker is to move. Can it be captured?
+template <int SIZE>
+bool LadderReaderOfSize<SIZE>::attacker_captures(const Cells& cells, int prey, int depth) {
+	if (depth >= MAX_LADDER_DEPTH or ++nodes > MAX_LADDER_NODES)
+		return false;
+	Cell attacker_colour = 3 - cells[prey];
+	int liberties[2];
+	int liberty_count = count_liberties(cells, prey, 2, liberties);
+	assert(liberty_count == 2);
+	for (int i = 0; i < liberty_count; i++) {
+		Cells next = cells;
+		if (not play(next, liberties[i], attacker_colour))
+			continue;
+		int remaining;
+		if (count_liberties(next, prey, 1, &remaining) == 1 and prey_is_captured(next, prey, depth + 1))
+			return true;
+	}
+	return false;
+}
+
+template <int SIZE>
+bool LadderReaderOfSize<SIZE>::ladder_captures(const Cells& cells, int prey, int move) {
+	nodes = 0;
+	Cells next = cells;
+	if (not play(next, move, 3 - cells[prey]))
+		return false;
+	int remaining;
+	return count_liberties(next, prey, 1, &remaining) == 1 and prey_is_captured(next, prey, 1);
+}
+
+template <int SIZE>
+bool LadderReaderOfSize<SIZE>::ladder_escapes(const Cells& cells, int prey, int move) {
+	nodes = 0;
+	Cells next = cells;
+	if (not play(next, move, cells[prey]))
+		return false;
+	int liberties[2];
+	int liberty_count = count_liberties(next, prey, 2, liberties);
+	if (liberty_count >= 3)
+		return true;
+	return liberty_count == 2 and not attacker_captures(next, prey, 1);
+}
+
+template <int SIZE>
+void fill_ladder_points(LadderReaderOfSize<SIZE>& reader, const typename LadderReaderOfSize<SIZE>::Cells& cells, const uint8_t* colour, const uint8_t* liberties, uint8_t* captures, uint8_t* escapes) {
+	for (int point = 0; point < point_count(SIZE); point++) {
+		if (colour[point] != 0)
+			continue;
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[point]) {
+			if (neighbor < 0)
+				continue;
+			// Opponent groups with two liberties are ladder capture candidates, our groups in atari are escape candidates.
+			if (colour[neighbor] == 2 and liberties[neighbor] == 2 and not captures[point])
+				captures[point] = reader.ladder_captures(cells, neighbor, point);
+			if (colour[neighbor] == 1 and liberties[neighbor] == 1 and not escapes[point])
+				escapes[point] = reader.ladder_escapes(cells, neighbor, point);
+		}
+	}
+}
+
+#define INSTANTIATE(SIZE) \
+	template class LadderReaderOfSize<SIZE>; \
+	template void fill_ladder_points<SIZE>(LadderReaderOfSize<SIZE>& reader, const LadderReaderOfSize<SIZE>::Cells& cells, \
+		const uint8_t* colour, const uint8_t* liberties, uint8_t* captures, uint8_t* escapes);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,53 @@
+// Bounded ladder reading for the ladder feature planes.
+
+#ifndef _SNPGO_LADDER_H
+#define _SNPGO_LADDER_H
+
+#include <array>
+#include "go_utils.h"
+#include "plane_emission.h"
+
+// Ladders crossing the whole board take around 70 plies, so anything deeper is treated as an escape.
+constexpr int MAX_LADDER_DEPTH = 80;
+// Reading gives up (and reports an escape) after visiting this many nodes, to bound pathological branching.
+constexpr int MAX_LADDER_NODES = 200;
+// The prey considers extending plus at most this many captures of attacking stones in atari.
+constexpr int MAX_LADDER_CANDIDATES = 8;
+
+// Reads forced atari sequences on a private copy of the cells.
+// Nothing here touches the heap: each ply copies the cells onto the stack, and flood fills use fixed scratch arrays.
+template <int SIZE>
+class LadderReaderOfSize {
+public:
+	typedef std::array<Cell, point_count(SIZE)> Cells;
+
+	// Does playing move (one of the two liberties of the group at prey) capture that group in a ladder?
+	bool ladder_captures(const Cells& cells, int prey, int move);
+	// Does the owner of the group at prey (which must be in atari) escape the ladder by playing move?
+	bool ladder_escapes(const Cells& cells, int prey, int move);
+
+private:
+	// Scratch for flood fills, reset by bumping the generation rather than clearing.
+	std::array<uint32_t, point_count(SIZE)> marks = {};
+	uint32_t generation = 0;
+	std::array<int16_t, point_count(SIZE)> stack;
+	std::array<int16_t, point_count(SIZE)> group;
+	int nodes = 0;
+
+	void next_generation();
+	int count_liberties(const Cells& cells, int point, int max_liberties, int* liberties, uint8_t* group_stones = nullptr);
+	void remove_group(Cells& cells, int point);
+	bool play(Cells& cells, int point, Cell colour);
+	bool prey_is_captured(const Cells& cells, int prey, int depth);
+	bool attacker_captures(const Cells& cells, int prey, int depth);
+};
+
+typedef LadderReaderOfSize<BOARD_SIZE> LadderReader;
+
+// Marks the points where perspective_player has a working ladder capture (in captures) or a
+// successful ladder escape (in escapes). Only points next to groups with one or two liberties are read.
+template <int SIZE>
+void fill_ladder_points(LadderReaderOfSize<SIZE>& reader, const typename LadderReaderOfSize<SIZE>::Cells& cells, const uint8_t* colour, const uint8_t* liberties, uint8_t* captures, uint8_t* escapes);
+
+#endif
+
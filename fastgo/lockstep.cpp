@@ -0,0 +1,431 @@
+// Replaying many games at once in lockstep, one game per lane, so board updates vectorise across games.
+
+#include "lockstep.h"
+#include "plane_emission.h"
+#include "ladder.h"
+#include <algorithm>
+
+// Everything below is inlined into per-kernel entry points compiled for each instruction set, so the lane loops
+// vectorise as widely as the running CPU allows.
+#define LOCKSTEP_INLINE static inline __attribute__((always_inline))
+
+template <int SIZE>
+struct BitboardMasks {
+	constexpr static int WORDS = (SIZE * SIZE + 63) / 64;
+	uint64_t on_board[WORDS] = {};
+	uint64_t not_first_column[WORDS] = {};
+	uint64_t not_last_column[WORDS] = {};
+
+	constexpr BitboardMasks() {
+		for (int point = 0; point < SIZE * SIZE; point++) {
+			uint64_t bit = 1ull << (point % 64);
+			on_board[point / 64] |= bit;
+			if (point % SIZE != 0)
+				not_first_column[point / 64] |= bit;
+			if (point % SIZE != SIZE - 1)
+				not_last_column[point / 64] |= bit;
+		}
+	}
+};
+
+template <int SIZE>
+inline constexpr BitboardMasks<SIZE> BITBOARD_MASKS{};
+
+template <int SIZE, int LANES>
+using Bitboards = typename LockstepBoardsOfSize<SIZE, LANES>::Bitboards;
+
+// Each point of in, moved one step left (0), right (1), up (2) or down (3), dropping anything that leaves the board.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void shift(int direction, const Bitboards<SIZE, LANES>& in, Bitboards<SIZE, LANES>& out) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	const BitboardMasks<SIZE>& masks = BITBOARD_MASKS<SIZE>;
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			uint64_t below = w > 0 ? in[w - 1][l] : 0;
+			uint64_t above = w + 1 < WORDS ? in[w + 1][l] : 0;
+			uint64_t shifted;
+			switch (direction) {
+			case 0:  shifted = ((in[w][l] >> 1) | (above << 63)) & masks.not_last_column[w]; break;
+			case 1:  shifted = ((in[w][l] << 1) | (below >> 63)) & masks.not_first_column[w]; break;
+			case 2:  shifted = (in[w][l] >> SIZE) | (above << (64 - SIZE)); break;
+			default: shifted = (in[w][l] << SIZE) | (below >> (64 - SIZE)); break;
+			}
+			out[w][l] = shifted & masks.on_board[w];
+		}
+	}
+}
+
+// in together with all of its neighbours.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void dilate(const Bitboards<SIZE, LANES>& in, Bitboards<SIZE, LANES>& out) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	const BitboardMasks<SIZE>& masks = BITBOARD_MASKS<SIZE>;
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			uint64_t below = w > 0 ? in[w - 1][l] : 0;
+			uint64_t above = w + 1 < WORDS ? in[w + 1][l] : 0;
+			uint64_t left  = ((in[w][l] >> 1) | (above << 63)) & masks.not_last_column[w];
+			uint64_t right = ((in[w][l] << 1) | (below >> 63)) & masks.not_first_column[w];
+			uint64_t up    = (in[w][l] >> SIZE) | (above << (64 - SIZE));
+			uint64_t down  = (in[w][l] << SIZE) | (below >> (64 - SIZE));
+			out[w][l] = (in[w][l] | left | right | up | down) & masks.on_board[w];
+		}
+	}
+}
+
+// Grows region, which must lie within within, to everything connected to it through within, in every lane.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void flood_fill(Bitboards<SIZE, LANES>& region, const Bitboards<SIZE, LANES>& within) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	alignas(64) Bitboards<SIZE, LANES> grown;
+	while (true) {
+		dilate<SIZE, LANES>(region, grown);
+		uint64_t changed = 0;
+		for (int w = 0; w < WORDS; w++) {
+			for (int l = 0; l < LANES; l++) {
+				uint64_t next = grown[w][l] & within[w][l];
+				changed |= next ^ region[w][l];
+				region[w][l] = next;
+			}
+		}
+		if (changed == 0)
+			return;
+	}
+}
+
+// The number of empty points next to each lane's region.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void count_liberties(const Bitboards<SIZE, LANES>& region, const Bitboards<SIZE, LANES>& empty, Bitboards<SIZE, LANES>& liberties, int* counts) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	dilate<SIZE, LANES>(region, liberties);
+	for (int l = 0; l < LANES; l++)
+		counts[l] = 0;
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			liberties[w][l] &= empty[w][l];
+			counts[l] += __builtin_popcountll(liberties[w][l]);
+		}
+	}
+}
+
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void count_stones(const Bitboards<SIZE, LANES>& region, int* counts) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	for (int l = 0; l < LANES; l++)
+		counts[l] = 0;
+	for (int w = 0; w < WORDS; w++)
+		for (int l = 0; l < LANES; l++)
+			counts[l] += __builtin_popcountll(region[w][l]);
+}
+
+// The lowest point of one lane's bitboard, or -1.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE int first_point(const Bitboards<SIZE, LANES>& region, int lane) {
+	for (int w = 0; w < BitboardMasks<SIZE>::WORDS; w++)
+		if (region[w][lane] != 0)
+			return w * 64 + __builtin_ctzll(region[w][lane]);
+	return -1;
+}
+
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void play_lanes(LockstepBoardsOfSize<SIZE, LANES>& boards, const typename LockstepBoardsOfSize<SIZE, LANES>::LaneMove* moves) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	const BitboardMasks<SIZE>& masks = BITBOARD_MASKS<SIZE>;
+	alignas(64) Bitboards<SIZE, LANES> move = {}, own, opponent, empty, region, liberties;
+
+	// Work in terms of the mover's stones and their opponent's, with a per-lane mask for who's moving.
+	uint64_t black_to_move[LANES];
+	for (int l = 0; l < LANES; l++) {
+		black_to_move[l] = moves[l].who == Player::BLACK ? ~0ull : 0;
+		int point = moves[l].point;
+		if (point >= 0) {
+			assert(point < SIZE * SIZE);
+			move[point / 64][l] = 1ull << (point % 64);
+		}
+	}
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			uint64_t black = boards.stones[0][w][l], white = boards.stones[1][w][l];
+			assert((move[w][l] & (black | white)) == 0);
+			own[w][l] = ((black & black_to_move[l]) | (white & ~black_to_move[l])) | move[w][l];
+			opponent[w][l] = (white & black_to_move[l]) | (black & ~black_to_move[l]);
+			empty[w][l] = masks.on_board[w] & ~(own[w][l] | opponent[w][l]);
+		}
+	}
+
+	// Each of the move's neighbours may belong to a different enemy group, and any left without liberties is captured.
+	// Enemy groups never touch each other, so capturing one can't change another's liberties.
+	int captured[LANES] = {}, counts[LANES], dead_stones[LANES], group_stones[LANES];
+	int16_t captured_point[LANES];
+	std::fill(captured_point, captured_point + LANES, -1);
+	for (int direction = 0; direction < 4; direction++) {
+		shift<SIZE, LANES>(direction, move, region);
+		for (int w = 0; w < WORDS; w++)
+			for (int l = 0; l < LANES; l++)
+				region[w][l] &= opponent[w][l];
+		flood_fill<SIZE, LANES>(region, opponent);
+		count_liberties<SIZE, LANES>(region, empty, liberties, counts);
+		for (int w = 0; w < WORDS; w++) {
+			for (int l = 0; l < LANES; l++) {
+				region[w][l] = counts[l] == 0 ? region[w][l] : 0;
+				opponent[w][l] &= ~region[w][l];
+			}
+		}
+		count_stones<SIZE, LANES>(region, dead_stones);
+		for (int l = 0; l < LANES; l++) {
+			if (dead_stones[l] == 1)
+				captured_point[l] = first_point<SIZE, LANES>(region, l);
+			captured[l] += dead_stones[l];
+		}
+	}
+
+	// Then the mover's own group, which is removed again if the move was suicide.
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			region[w][l] = move[w][l];
+			empty[w][l] = masks.on_board[w] & ~(own[w][l] | opponent[w][l]);
+		}
+	}
+	flood_fill<SIZE, LANES>(region, own);
+	count_liberties<SIZE, LANES>(region, empty, liberties, counts);
+	count_stones<SIZE, LANES>(region, group_stones);
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			own[w][l] &= counts[l] == 0 ? ~region[w][l] : ~0ull;
+			boards.stones[0][w][l] = (own[w][l] & black_to_move[l]) | (opponent[w][l] & ~black_to_move[l]);
+			boards.stones[1][w][l] = (opponent[w][l] & black_to_move[l]) | (own[w][l] & ~black_to_move[l]);
+		}
+	}
+
+	// Capturing one stone with a lone stone left in atari makes a ko.
+	for (int l = 0; l < LANES; l++) {
+		if (moves[l].point == LockstepBoardsOfSize<SIZE, LANES>::IDLE)
+			continue;
+		bool is_ko = moves[l].point >= 0 and captured[l] == 1 and group_stones[l] == 1 and counts[l] == 1;
+		boards.ko_point[l] = is_ko ? captured_point[l] : -1;
+	}
+}
+
+// Fills in colour, liberties and both capture counts of the point states.
+template <int SIZE, int LANES>
+LOCKSTEP_INLINE void gather_lanes(LockstepBoardsOfSize<SIZE, LANES>& boards, const Player* perspective) {
+	constexpr int WORDS = BitboardMasks<SIZE>::WORDS;
+	const BitboardMasks<SIZE>& masks = BITBOARD_MASKS<SIZE>;
+	alignas(64) Bitboards<SIZE, LANES> unlabelled, empty, region, within, liberties, neighbours, alone;
+	alignas(64) Bitboards<SIZE, LANES> liberty_bits[3];
+
+	uint64_t active[LANES];
+	for (int l = 0; l < LANES; l++)
+		active[l] = perspective[l] != Player::NOBODY ? ~0ull : 0;
+	for (int w = 0; w < WORDS; w++) {
+		for (int l = 0; l < LANES; l++) {
+			uint64_t stones = boards.stones[0][w][l] | boards.stones[1][w][l];
+			unlabelled[w][l] = stones & active[l];
+			empty[w][l] = masks.on_board[w] & ~stones;
+			alone[w][l] = unlabelled[w][l];
+			liberty_bits[0][w][l] = liberty_bits[1][w][l] = liberty_bits[2][w][l] = 0;
+		}
+	}
+
+	// Most groups are single stones, which can all be done at once: a stone is alone if no neighbour shares its colour,
+	// and its liberties are a sum of its four neighbours' emptiness, added up bit-sliced into liberty_bits.
+	for (int colour = 0; colour < 2; colour++) {
+		for (int direction = 0; direction < 4; direction++) {
+			shift<SIZE, LANES>(direction, boards.stones[colour], neighbours);
+			for (int w = 0; w < WORDS; w++)
+				for (int l = 0; l < LANES; l++)
+					alone[w][l] &= ~(neighbours[w][l] & boards.stones[colour][w][l]);
+		}
+	}
+	for (int direction = 0; direction < 4; direction++) {
+		shift<SIZE, LANES>(direction, empty, neighbours);
+		for (int w = 0; w < WORDS; w++) {
+			for (int l = 0; l < LANES; l++) {
+				uint64_t carry = liberty_bits[0][w][l] & neighbours[w][l];
+				liberty_bits[0][w][l] ^= neighbours[w][l];
+				liberty_bits[2][w][l] |= liberty_bits[1][w][l] & carry;
+				liberty_bits[1][w][l] ^= carry;
+			}
+		}
+	}
+	for (int l = 0; l < LANES; l++) {
+		if (not active[l])
+			continue;
+		PointStatesOfSize<SIZE>& states = boards.states[l];
+		for (int w = 0; w < WORDS; w++) {
+			for (uint64_t bits = alone[w][l]; bits != 0; bits &= bits - 1) {
+				int bit = __builtin_ctzll(bits);
+				int point = w * 64 + bit;
+				Player owner = boards.stones[0][w][l] >> bit & 1 ? Player::BLACK : Player::WHITE;
+				uint8_t colour = owner == perspective[l] ? 1 : 2;
+				int count = (liberty_bits[0][w][l] >> bit & 1) | (liberty_bits[1][w][l] >> bit & 1) << 1 | (liberty_bits[2][w][l] >> bit & 1) << 2;
+				states.colour[point] = colour;
+				states.liberties[point] = count;
+				if (count != 1)
+					continue;
+				for (int neighbor : POINT_NEIGHBORS<SIZE>[point]) {
+					if (neighbor >= 0 and empty[neighbor / 64][l] >> (neighbor % 64) & 1) {
+						uint8_t* captures = colour == 2 ? states.p1_captures : states.p2_captures;
+						captures[neighbor] = std::min(captures[neighbor] + 1, MAX_CAPTURES_FEATURE);
+					}
+				}
+			}
+		}
+	}
+	for (int w = 0; w < WORDS; w++)
+		for (int l = 0; l < LANES; l++)
+			unlabelled[w][l] &= ~alone[w][l];
+
+	// The rest go one group per lane at a time.
+	int counts[LANES];
+	uint64_t found[LANES], black_group[LANES];
+	while (true) {
+		// Seed each lane with its lowest unlabelled stone, and grow that into its group.
+		for (int l = 0; l < LANES; l++)
+			found[l] = black_group[l] = 0;
+		for (int w = 0; w < WORDS; w++) {
+			for (int l = 0; l < LANES; l++) {
+				uint64_t seed = found[l] ? 0 : unlabelled[w][l] & -unlabelled[w][l];
+				region[w][l] = seed;
+				found[l] |= seed;
+				black_group[l] |= seed & boards.stones[0][w][l];
+			}
+		}
+		uint64_t any_found = 0;
+		for (int l = 0; l < LANES; l++)
+			any_found |= found[l];
+		if (any_found == 0)
+			return;
+		for (int w = 0; w < WORDS; w++)
+			for (int l = 0; l < LANES; l++)
+				within[w][l] = black_group[l] ? boards.stones[0][w][l] : boards.stones[1][w][l];
+		flood_fill<SIZE, LANES>(region, within);
+		count_liberties<SIZE, LANES>(region, empty, liberties, counts);
+		for (int w = 0; w < WORDS; w++)
+			for (int l = 0; l < LANES; l++)
+				unlabelled[w][l] &= ~region[w][l];
+
+		// Writing the group out to the per-point arrays is the one part that has to go lane by lane.
+		for (int l = 0; l < LANES; l++) {
+			if (not found[l])
+				continue;
+			PointStatesOfSize<SIZE>& states = boards.states[l];
+			Player owner = black_group[l] ? Player::BLACK : Player::WHITE;
+			uint8_t colour = owner == perspective[l] ? 1 : 2;
+			uint8_t clamped_liberties = std::min(counts[l], MAX_LIBERTIES_FEATURE);
+			int size = 0;
+			for (int w = 0; w < WORDS; w++) {
+				for (uint64_t bits = region[w][l]; bits != 0; bits &= bits - 1) {
+					int point = w * 64 + __builtin_ctzll(bits);
+					states.colour[point] = colour;
+					states.liberties[point] = clamped_liberties;
+					size++;
+				}
+			}
+			// Whoever doesn't own a group in atari captures it by playing on its last liberty.
+			if (counts[l] == 1) {
+				int point = first_point<SIZE, LANES>(liberties, l);
+				uint8_t* captures = colour == 2 ? states.p1_captures : states.p2_captures;
+				captures[point] = std::min(captures[point] + size, MAX_CAPTURES_FEATURE);
+			}
+		}
+	}
+}
+
+#define LOCKSTEP_KERNELS(NAME, TARGET) \
+	template <int SIZE, int LANES> TARGET \
+	static void play_##NAME(LockstepBoardsOfSize<SIZE, LANES>& boards, const typename LockstepBoardsOfSize<SIZE, LANES>::LaneMove* moves) { \
+		play_lanes<SIZE, LANES>(boards, moves); \
+	} \
+	template <int SIZE, int LANES> TARGET \
+	static void gather_##NAME(LockstepBoardsOfSize<SIZE, LANES>& boards, const Player* perspective) { \
+		gather_lanes<SIZE, LANES>(boards, perspective); \
+	}
+LOCKSTEP_KERNELS(scalar, )
+LOCKSTEP_KERNELS(avx2, __attribute__((target("avx2"))))
+LOCKSTEP_KERNELS(avx512, __attribute__((target("avx512f,avx512bw"))))
+#undef LOCKSTEP_KERNELS
+
+template <int SIZE, int LANES>
+LockstepBoardsOfSize<SIZE, LANES>::LockstepBoardsOfSize() {
+	for (int lane = 0; lane < LANES; lane++)
+		reset_lane(lane, {});
+}
+
+template <int SIZE, int LANES>
+void LockstepBoardsOfSize<SIZE, LANES>::reset_lane(int lane, const std::array<Cell, SIZE * SIZE>& cells) {
+	assert(0 <= lane and lane < LANES);
+	for (int w = 0; w < WORDS; w++)
+		stones[0][w][lane] = stones[1][w][lane] = 0;
+	for (int point = 0; point < SIZE * SIZE; point++) {
+		assert(cells[point] <= 2);
+		if (cells[point] != 0)
+			stones[cells[point] - 1][point / 64][lane] |= 1ull << (point % 64);
+	}
+	ko_point[lane] = -1;
+	extractors[lane].move_history.clear();
+}
+
+template <int SIZE, int LANES>
+std::array<Cell, SIZE * SIZE> LockstepBoardsOfSize<SIZE, LANES>::lane_cells(int lane) const {
+	std::array<Cell, SIZE * SIZE> cells = {};
+	for (int point = 0; point < SIZE * SIZE; point++) {
+		uint64_t bit = 1ull << (point % 64);
+		if (stones[0][point / 64][lane] & bit)
+			cells[point] = (Cell)Player::BLACK;
+		else if (stones[1][point / 64][lane] & bit)
+			cells[point] = (Cell)Player::WHITE;
+	}
+	return cells;
+}
+
+template <int SIZE, int LANES>
+void LockstepBoardsOfSize<SIZE, LANES>::play(const LaneMove* moves) {
+	switch (get_emission_kernel()) {
+	case EmissionKernel::AVX512: play_avx512<SIZE, LANES>(*this, moves); break;
+	case EmissionKernel::AVX2:   play_avx2<SIZE, LANES>(*this, moves);   break;
+	default:                     play_scalar<SIZE, LANES>(*this, moves); break;
+	}
+	for (int lane = 0; lane < LANES; lane++) {
+		int point = moves[lane].point;
+		if (point >= 0)
+			extractors[lane].add_move_to_history({point % SIZE, point / SIZE});
+		else if (point == PASS)
+			extractors[lane].add_move_to_history({-1, -1});
+	}
+}
+
+template <int SIZE, int LANES>
+void LockstepBoardsOfSize<SIZE, LANES>::fill_features(uint8_t* features, const Player* perspective) {
+	for (int lane = 0; lane < LANES; lane++) {
+		if (perspective[lane] == Player::NOBODY)
+			continue;
+		PointStates& s = states[lane];
+		std::fill(std::begin(s.colour), std::end(s.colour), 0);
+		std::fill(std::begin(s.liberties), std::end(s.liberties), 0);
+		std::fill(std::begin(s.p1_captures), std::end(s.p1_captures), 0);
+		std::fill(std::begin(s.p2_captures), std::end(s.p2_captures), 0);
+		std::fill(std::begin(s.ladder_captures), std::end(s.ladder_captures), 0);
+		std::fill(std::begin(s.ladder_escapes), std::end(s.ladder_escapes), 0);
+	}
+	switch (get_emission_kernel()) {
+	case EmissionKernel::AVX512: gather_avx512<SIZE, LANES>(*this, perspective); break;
+	case EmissionKernel::AVX2:   gather_avx2<SIZE, LANES>(*this, perspective);   break;
+	default:                     gather_scalar<SIZE, LANES>(*this, perspective); break;
+	}
+	for (int lane = 0; lane < LANES; lane++) {
+		if (perspective[lane] == Player::NOBODY)
+			continue;
+		PointStates& s = states[lane];
+		fill_ladder_points(ladder_reader, lane_cells(lane), s.colour, s.liberties, s.ladder_captures, s.ladder_escapes);
+		extractors[lane].fill_features_from_states(features + lane * total_features(SIZE), s);
+	}
+}
+
+#define INSTANTIATE_WIDTH(LANES, SIZE) \
+	template struct LockstepBoardsOfSize<SIZE, LANES>;
+#define INSTANTIATE(SIZE) \
+	INSTANTIATE_WIDTH(8, SIZE) INSTANTIATE_WIDTH(16, SIZE) INSTANTIATE_WIDTH(32, SIZE)
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
+#undef INSTANTIATE_WIDTH
@@ -0,0 +1,54 @@
+// Replaying many games at once in lockstep, one game per lane, so board updates vectorise across games.
+
+#ifndef _SNPGO_LOCKSTEP_H
+#define _SNPGO_LOCKSTEP_H
+
+#include <cstdint>
+#include <array>
+#include "go_utils.h"
+#include "feature_extraction.h"
+
+// LANES boards of one size, kept as bitboards stored word-major ([word][lane]), so the same word of every lane's board
+// is contiguous and each whole-board operation is a loop over lanes that compiles to full width vector operations.
+// Captures, suicide and liberties all come from flood fills run across every lane at once, each ending when no lane
+// changes; lanes with less to do (or nothing, with a pass or an idle step) just stop changing early.
+// Ladder reading and plane emission, which don't vectorise across games, still run lane by lane.
+// Kernels are picked the same way as for plane emission, so set_emission_kernel also applies here.
+// Instantiated for each of SNPGO_FOR_EACH_BOARD_SIZE with 8, 16 and 32 lanes.
+template <int SIZE, int LANES>
+struct LockstepBoardsOfSize {
+	constexpr static int WORDS = (SIZE * SIZE + 63) / 64;
+	typedef uint64_t Bitboards[WORDS][LANES];
+	typedef PointStatesOfSize<SIZE> PointStates;
+
+	// A lane's move for one step: a point (x + y * SIZE), PASS, or IDLE to leave the lane exactly as it is.
+	constexpr static int16_t PASS = -1;
+	constexpr static int16_t IDLE = -2;
+	struct LaneMove {
+		int16_t point;
+		Player who;
+	};
+
+	// Black's stones, then white's.
+	alignas(64) Bitboards stones[2];
+	// As GoBoard's ko_point, as a point index, or -1.
+	int16_t ko_point[LANES];
+	// Each lane's move history. Their ladder readers go unused in favour of the one shared reader, which keeps the working set small.
+	FeatureExtractorOfSize<SIZE> extractors[LANES];
+	LadderReaderOfSize<SIZE> ladder_reader;
+	// Scratch for fill_features.
+	PointStates states[LANES];
+
+	LockstepBoardsOfSize();
+	// Starts the lane over from the given position, with no ko point or history.
+	void reset_lane(int lane, const std::array<Cell, SIZE * SIZE>& cells);
+	std::array<Cell, SIZE * SIZE> lane_cells(int lane) const;
+	// Plays moves[lane] in every lane at once, capturing, removing suicides and setting the ko point as GoBoard::place_stone
+	// does, and adds each move (or pass) to its lane's history.
+	void play(const LaneMove* moves);
+	// For every lane whose perspective isn't NOBODY, writes the total_features(SIZE) bytes FeatureExtractorOfSize::fill_features
+	// would for that lane's position to features + lane * total_features(SIZE).
+	void fill_features(uint8_t* features, const Player* perspective);
+};
+
+#endif
@@ -0,0 +1,144 @@
+// Generate a deterministic synthetic corpus of SGF files, for benchmarking sgf_to_chunks without real game collections.
+
+#include "go_utils.h"
+#include "sgf.h"
+#include "scoring.h"
+#include "self_play.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cmath>
+#include <boost/filesystem.hpp>
+
+// Real games that aren't scored out mostly end in resignation.
+constexpr double RESIGNATION_FRACTION = 0.4;
+
+struct CorpusConfig {
+	int fan_out = 16;
+	int depth = 1;
+	int mean_moves = 220;
+	uint64_t seed = 12345;
+};
+
+// Plays game index: capture policy moves up to a length drawn around mean_moves, then a result from scoring the
+// position it stopped in, or a resignation by the loser. Everything follows from seed + index alone.
+static std::string make_game(const CorpusConfig& config, int index, MovePolicy& policy, int& move_count) {
+	std::mt19937_64 generator(config.seed + index);
+	SelfPlayConfig self_play_config;
+	self_play_config.komi = std::bernoulli_distribution(0.5)(generator) ? 6.5 : 7.5;
+	self_play_config.random_moves = 0;
+	int moves = std::lround(std::normal_distribution<double>(config.mean_moves, config.mean_moves / 4.0)(generator));
+	self_play_config.max_moves = std::max(10, std::min(moves, 2 * BOARD_SIZE * BOARD_SIZE));
+
+	Game game;
+	AreaScore final_score;
+	play_self_play_game(policy, self_play_config, generator, game, final_score);
+	move_count = game.moves.size();
+	if (game.who_won != Player::NOBODY and std::bernoulli_distribution(RESIGNATION_FRACTION)(generator))
+		game.result_string = game.who_won == Player::BLACK ? "B+R" : "W+R";
+	game.black_rank = std::uniform_int_distribution<int>(1, 9)(generator);
+	game.white_rank = std::max(1, std::min(9, game.black_rank + std::uniform_int_distribution<int>(-1, 1)(generator)));
+
+	// The root properties real servers add, so the files are a realistic size to read and parse.
+	char extra[256];
+	snprintf(extra, sizeof(extra), "CA[UTF-8]AP[make_sgf_corpus]PB[black%04i]PW[white%04i]DT[20%02i-%02i-%02i]RU[Japanese]TM[600]OT[3x30 byo-yomi]",
+		(int)(generator() % 10000), (int)(generator() % 10000), (int)(generator() % 20), (int)(1 + generator() % 12), (int)(1 + generator() % 28));
+	return format_sgf(game, extra);
+}
+
+// Game index goes in a leaf directory picked round robin, depth levels down with fan_out directories at each level.
+static std::string game_path(const std::string& root, const CorpusConfig& config, int index) {
+	int leaves = 1;
+	for (int level = 0; level < config.depth; level++)
+		leaves *= config.fan_out;
+	int leaf = index % leaves;
+	std::string path = root;
+	for (int level = 0; level < config.depth; level++) {
+		char name[16];
+		snprintf(name, sizeof(name), "/%03i", leaf % config.fan_out);
+		path += name;
+		leaf /= config.fan_out;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "/game%08i.sgf", index);
+	return path + name;
+}
+
+int main(int argc, char** argv) {
+	CorpusConfig config;
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	bool bad_options = argc < 3;
+	for (int i = 3; i < argc; i++) {
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--fan-out")
+			config.fan_out = std::stoi(argv[++i]);
+		else if (option == "--depth")
+			config.depth = std::stoi(argv[++i]);
+		else if (option == "--mean-moves")
+			config.mean_moves = std::stoi(argv[++i]);
+		else if (option == "--seed")
+			config.seed = std::stoull(argv[++i]);
+		else if (option == "--threads")
+			thread_count = std::stoi(argv[++i]);
+		else
+			bad_options = true;
+	}
+	if (bad_options or config.fan_out < 1 or config.depth < 0 or config.depth > 4 or config.mean_moves < 1 or thread_count < 1) {
+		std::cerr << "Usage: make_sgf_corpus output_directory game_count [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Writes game_count synthetic " << BOARD_SIZE << "x" << BOARD_SIZE << " SGF games under output_directory. The same options" << std::endl;
+		std::cerr << "always give the same files, whatever the thread count, so the corpus can be regenerated rather than shipped." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --fan-out n     Subdirectories per directory level (default 16)." << std::endl;
+		std::cerr << "  --depth d       Levels of subdirectories, from 0 for every file in output_directory up to 4 (default 1)." << std::endl;
+		std::cerr << "  --mean-moves m  Mean game length in moves (default 220)." << std::endl;
+		std::cerr << "  --seed n        Seed; game i is generated with seed + i (default 12345)." << std::endl;
+		std::cerr << "  --threads n     Threads generating games (default: one per core)." << std::endl;
+		return 1;
+	}
+	std::string root = argv[1];
+	int game_count = std::stoi(argv[2]);
+
+	std::atomic<int> next_game{0};
+	std::atomic<uint64_t> moves_played{0}, bytes_written{0};
+	std::atomic<bool> failed{false};
+	auto start = std::chrono::steady_clock::now();
+
+	auto worker = [&]() {
+		std::unique_ptr<MovePolicy> policy = make_move_policy("capture");
+		for (int index; not failed and (index = next_game++) < game_count;) {
+			int move_count;
+			std::string sgf = make_game(config, index, *policy, move_count);
+			std::string path = game_path(root, config, index);
+			boost::system::error_code error;
+			boost::filesystem::create_directories(boost::filesystem::path(path).parent_path(), error);
+			std::ofstream file(path, std::ios_base::out | std::ios_base::binary);
+			if (not file.write(sgf.data(), sgf.size())) {
+				std::cerr << "Couldn't write " << path << std::endl;
+				failed = true;
+				return;
+			}
+			moves_played += move_count;
+			bytes_written += sgf.size();
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++)
+		threads.emplace_back(worker);
+	for (std::thread& thread : threads)
+		thread.join();
+	if (failed)
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Wrote %i games (%llu moves, %.1f MB) in %.1fs.\n", game_count, (unsigned long long)moves_played.load(), bytes_written / 1e6, seconds);
+}
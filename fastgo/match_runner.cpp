@@ -0,0 +1,174 @@
+// Play two engine configurations against each other over many games at once, and report which is stronger.
+
+#include "go_utils.h"
+#include "sgf.h"
+#include "scoring.h"
+#include "self_play.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cmath>
+#include <boost/filesystem.hpp>
+
+// For 95% confidence intervals.
+constexpr double CONFIDENCE_Z = 1.96;
+
+struct MatchTally {
+	// Indexed by which engine played black: 0 for A, 1 for B.
+	int a_wins[2] = {}, b_wins[2] = {}, draws[2] = {};
+	uint64_t moves = 0;
+
+	int games() const { return a_wins[0] + a_wins[1] + b_wins[0] + b_wins[1] + draws[0] + draws[1]; }
+	// A's score, counting a draw as half a win.
+	double a_points() const { return a_wins[0] + a_wins[1] + 0.5 * (draws[0] + draws[1]); }
+};
+
+// The Wilson score interval for a proportion p observed over n trials.
+static void wilson_interval(double p, int n, double& low, double& high) {
+	double z2 = CONFIDENCE_Z * CONFIDENCE_Z;
+	double centre = (p + z2 / (2 * n)) / (1 + z2 / n);
+	double half_width = CONFIDENCE_Z * std::sqrt(p * (1 - p) / n + z2 / (4.0 * n * n)) / (1 + z2 / n);
+	low = std::max(0.0, centre - half_width);
+	high = std::min(1.0, centre + half_width);
+}
+
+// The Elo difference that predicts scoring p, clamped for the scores no finite difference gives.
+static double elo_difference(double p) {
+	p = std::max(1e-4, std::min(1 - 1e-4, p));
+	return 400 * std::log10(p / (1 - p));
+}
+
+static void report(const MatchTally& tally, const std::string& a, const std::string& b, double seconds) {
+	int n = tally.games();
+	if (n == 0)
+		return;
+	double p = tally.a_points() / n, low, high;
+	wilson_interval(p, n, low, high);
+	printf("%i games in %.1fs (%.0f games/minute, %.0f moves each): A (%s) %i wins, B (%s) %i wins, %i draws.\n",
+		n, seconds, n / (seconds / 60), (double)tally.moves / n, a.c_str(), tally.a_wins[0] + tally.a_wins[1],
+		b.c_str(), tally.b_wins[0] + tally.b_wins[1], tally.draws[0] + tally.draws[1]);
+	printf("  A scores %.1f%% (95%% CI %.1f%% to %.1f%%), Elo %+.0f (%+.0f to %+.0f).\n",
+		100 * p, 100 * low, 100 * high, elo_difference(p), elo_difference(low), elo_difference(high));
+	printf("  A as black: %i-%i-%i. A as white: %i-%i-%i (wins-losses-draws).\n",
+		tally.a_wins[0], tally.b_wins[0], tally.draws[0], tally.a_wins[1], tally.b_wins[1], tally.draws[1]);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	SelfPlayConfig config;
+	config.random_moves = config.random_move_horizon = 4;
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	uint64_t seed = 12345;
+	int report_every = 1000;
+	std::string sgf_directory;
+	bool bad_options = argc < 4;
+	for (int i = 4; i < argc; i++) {
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--opening-moves")
+			config.random_moves = config.random_move_horizon = std::stoi(argv[++i]);
+		else if (option == "--komi")
+			config.komi = std::stof(argv[++i]);
+		else if (option == "--max-moves")
+			config.max_moves = std::stoi(argv[++i]);
+		else if (option == "--scoring-playouts")
+			config.scoring_playouts = std::stoi(argv[++i]);
+		else if (option == "--threads")
+			thread_count = std::stoi(argv[++i]);
+		else if (option == "--seed")
+			seed = std::stoull(argv[++i]);
+		else if (option == "--report-every")
+			report_every = std::stoi(argv[++i]);
+		else if (option == "--sgf-directory")
+			sgf_directory = argv[++i];
+		else
+			bad_options = true;
+	}
+	if (bad_options or make_move_policy(argv[1]) == nullptr or make_move_policy(argv[2]) == nullptr or thread_count < 1
+		or config.random_moves < 0 or config.max_moves < 1 or report_every < 1) {
+		std::cerr << "Usage: match_runner engine_a engine_b game_count [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Plays game_count games between two engines (move policies: random or capture) on a shared pool of threads," << std::endl;
+		std::cerr << "and reports A's score with a 95% Wilson confidence interval, the matching Elo difference, and games per minute." << std::endl;
+		std::cerr << "Games come in pairs from the same random opening, A taking black in the first and white in the second, so" << std::endl;
+		std::cerr << "neither colour nor opening favours either engine." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --opening-moves n      Uniformly random moves opening each pair of games (default 4)." << std::endl;
+		std::cerr << "  --komi k               Komi (default 7.5)." << std::endl;
+		std::cerr << "  --max-moves n          Games are scored as they stand after this many moves (default " << config.max_moves << ")." << std::endl;
+		std::cerr << "  --scoring-playouts n   Random playouts for finding dead stones when scoring (default " << DEFAULT_SCORING_PLAYOUTS << ")." << std::endl;
+		std::cerr << "  --threads n            Threads playing games (default: one per core)." << std::endl;
+		std::cerr << "  --seed n               Seed; games 2i and 2i + 1 are played with seed + i (default 12345)." << std::endl;
+		std::cerr << "  --report-every n       Print the standings every n games (default 1000)." << std::endl;
+		std::cerr << "  --sgf-directory path   Also write each game as path/game<index>.sgf, with the engines' names in PB and PW." << std::endl;
+		return 1;
+	}
+	std::string engine_a = argv[1], engine_b = argv[2];
+	int game_count = std::stoi(argv[3]);
+	if (not sgf_directory.empty())
+		boost::filesystem::create_directories(sgf_directory);
+
+	// Workers claim games by index and only hold the lock to tally results.
+	std::mutex tally_mutex;
+	MatchTally tally;
+	std::atomic<int> next_game{0};
+	std::atomic<bool> failed{false};
+	auto start = std::chrono::steady_clock::now();
+
+	auto worker = [&]() {
+		// Each worker has its own instance of each engine, since policies may keep state.
+		std::unique_ptr<MovePolicy> policies[2] = {make_move_policy(engine_a), make_move_policy(engine_b)};
+		Game game;
+		AreaScore final_score;
+		for (int index; not failed and (index = next_game++) < game_count;) {
+			int a_colour = index % 2;
+			MovePolicy& black = *policies[a_colour];
+			MovePolicy& white = *policies[1 - a_colour];
+			std::mt19937_64 generator(seed + index / 2);
+			play_match_game(black, white, config, generator, game, final_score);
+
+			if (not sgf_directory.empty()) {
+				char name[32];
+				snprintf(name, sizeof(name), "/game%08i.sgf", index);
+				std::string path = sgf_directory + name;
+				std::string sgf = format_sgf(game, "PB[" + (a_colour == 0 ? engine_a : engine_b) + "]PW[" + (a_colour == 0 ? engine_b : engine_a) + "]");
+				std::ofstream file(path, std::ios_base::out | std::ios_base::binary);
+				if (not file.write(sgf.data(), sgf.size())) {
+					std::cerr << "Couldn't write " << path << std::endl;
+					failed = true;
+					return;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(tally_mutex);
+			Player a_player = a_colour == 0 ? Player::BLACK : Player::WHITE;
+			if (game.who_won == Player::NOBODY)
+				tally.draws[a_colour]++;
+			else if (game.who_won == a_player)
+				tally.a_wins[a_colour]++;
+			else
+				tally.b_wins[a_colour]++;
+			tally.moves += game.moves.size();
+			if (tally.games() % report_every == 0 and tally.games() < game_count)
+				report(tally, engine_a, engine_b, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++)
+		threads.emplace_back(worker);
+	for (std::thread& thread : threads)
+		thread.join();
+	if (failed)
+		return 1;
+	report(tally, engine_a, engine_b, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,117 @@
+// Vectorised emission of feature planes from per-point board state.
+
+#include "plane_emission.h"
+#include <cassert>
+#include <immintrin.h>
+
+template <int SIZE>
+static void emit_planes_scalar(const PlaneRule* rules, int plane_count, uint8_t* output) {
+	constexpr int POINT_COUNT = point_count(SIZE);
+	for (int k = 0; k < plane_count; k++) {
+		const uint8_t* source = rules[k].source;
+		uint8_t value = rules[k].value;
+		uint8_t* plane = output + k * POINT_COUNT;
+		for (int i = 0; i < POINT_COUNT; i++)
+			plane[i] = source[i] == value;
+	}
+}
+
+// Planes are contiguous and written in increasing order, so the tail of every plane but the
+// last may be written with a full vector store: the spill is overwritten by the following plane.
+template <int SIZE>
+__attribute__((target("avx2")))
+static void emit_planes_avx2(const PlaneRule* rules, int plane_count, uint8_t* output) {
+	constexpr int POINT_COUNT = point_count(SIZE);
+	constexpr int PADDED_POINT_COUNT = padded_point_count(SIZE);
+	constexpr int BODY = POINT_COUNT / 32 * 32;
+	const __m256i ones = _mm256_set1_epi8(1);
+	for (int k = 0; k < plane_count; k++) {
+		const uint8_t* source = rules[k].source;
+		const __m256i value = _mm256_set1_epi8(rules[k].value);
+		uint8_t* plane = output + k * POINT_COUNT;
+		int limit = k + 1 < plane_count ? PADDED_POINT_COUNT : BODY;
+		int i = 0;
+		#pragma GCC unroll 16
+		for (; i < POINT_COUNT and i < limit; i += 32) {
+			__m256i s = _mm256_load_si256(reinterpret_cast<const __m256i*>(source + i));
+			__m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(s, value), ones);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(plane + i), hit);
+		}
+		for (; i < POINT_COUNT; i++)
+			plane[i] = source[i] == rules[k].value;
+	}
+}
+
+template <int SIZE>
+__attribute__((target("avx512f,avx512bw")))
+static void emit_planes_avx512(const PlaneRule* rules, int plane_count, uint8_t* output) {
+	constexpr int POINT_COUNT = point_count(SIZE);
+	static_assert(padded_point_count(SIZE) % 64 == 0, "Sources must be padded to a whole number of 64 byte vectors.");
+	constexpr int BODY = POINT_COUNT / 64 * 64;
+	constexpr __mmask64 TAIL_MASK = (1ull << (POINT_COUNT - BODY)) - 1;
+	const __m512i ones = _mm512_set1_epi8(1);
+	for (int k = 0; k < plane_count; k++) {
+		const uint8_t* source = rules[k].source;
+		const __m512i value = _mm512_set1_epi8(rules[k].value);
+		uint8_t* plane = output + k * POINT_COUNT;
+		#pragma GCC unroll 8
+		for (int i = 0; i < BODY; i += 64) {
+			__mmask64 hit = _mm512_cmpeq_epi8_mask(_mm512_load_si512(source + i), value);
+			_mm512_storeu_si512(plane + i, _mm512_maskz_mov_epi8(hit, ones));
+		}
+		__mmask64 hit = _mm512_cmpeq_epi8_mask(_mm512_load_si512(source + BODY), value);
+		_mm512_mask_storeu_epi8(plane + BODY, TAIL_MASK, _mm512_maskz_mov_epi8(hit, ones));
+	}
+}
+
+const char* emission_kernel_name(EmissionKernel kernel) {
+	switch (kernel) {
+	case EmissionKernel::SCALAR: return "scalar";
+	case EmissionKernel::AVX2:   return "avx2";
+	case EmissionKernel::AVX512: return "avx512";
+	}
+	return "unknown";
+}
+
+bool emission_kernel_supported(EmissionKernel kernel) {
+	// We may be called during static initialization, before libgcc has probed the CPU itself.
+	__builtin_cpu_init();
+	switch (kernel) {
+	case EmissionKernel::SCALAR: return true;
+	case EmissionKernel::AVX2:   return __builtin_cpu_supports("avx2");
+	case EmissionKernel::AVX512: return __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw");
+	}
+	return false;
+}
+
+EmissionKernel best_emission_kernel() {
+	for (EmissionKernel kernel : {EmissionKernel::AVX512, EmissionKernel::AVX2})
+		if (emission_kernel_supported(kernel))
+			return kernel;
+	return EmissionKernel::SCALAR;
+}
+
+static EmissionKernel current_kernel = best_emission_kernel();
+
+void set_emission_kernel(EmissionKernel kernel) {
+	assert(emission_kernel_supported(kernel));
+	current_kernel = kernel;
+}
+
+EmissionKernel get_emission_kernel() {
+	return current_kernel;
+}
+
+template <int SIZE>
+void emit_planes(const PlaneRule* rules, int plane_count, uint8_t* output) {
+	switch (current_kernel) {
+	case EmissionKernel::AVX512: emit_planes_avx512<SIZE>(rules, plane_count, output); break;
+	case EmissionKernel::AVX2:   emit_planes_avx2<SIZE>(rules, plane_count, output);   break;
+	default:                     emit_planes_scalar<SIZE>(rules, plane_count, output); break;
+	}
+}
+
+#define INSTANTIATE(SIZE) \
+	template void emit_planes<SIZE>(const PlaneRule* rules, int plane_count, uint8_t* output);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,46 @@
+// Vectorised emission of feature planes from per-point board state.
+
+#ifndef _SNPGO_PLANE_EMISSION_H
+#define _SNPGO_PLANE_EMISSION_H
+
+#include <cstdint>
+#include "go_utils.h"
+
+// Per-point source arrays are padded out to a multiple of the widest vector so kernels can always do full loads.
+constexpr int point_count(int size) { return size * size; }
+constexpr int padded_point_count(int size) { return (size * size + 63) / 64 * 64; }
+constexpr int POINT_COUNT = point_count(BOARD_SIZE);
+constexpr int PADDED_POINT_COUNT = padded_point_count(BOARD_SIZE);
+
+// Each output plane k is filled with (rules[k].source[i] == rules[k].value) for every point i.
+struct PlaneRule {
+	const uint8_t* source;
+	uint8_t value;
+};
+
+enum class EmissionKernel {
+	SCALAR,
+	AVX2,
+	AVX512,
+};
+
+const char* emission_kernel_name(EmissionKernel kernel);
+bool emission_kernel_supported(EmissionKernel kernel);
+EmissionKernel best_emission_kernel();
+
+// By default the best kernel supported by the running CPU is used; this is mostly for benchmarking.
+void set_emission_kernel(EmissionKernel kernel);
+EmissionKernel get_emission_kernel();
+
+// Writes plane_count consecutive planes of point_count(SIZE) bytes to output.
+// Every source must be 64 byte aligned and point at padded_point_count(SIZE) readable bytes.
+// Each board size gets its own kernels, with every loop bound known at compile time.
+template <int SIZE>
+void emit_planes(const PlaneRule* rules, int plane_count, uint8_t* output);
+
+static inline void emit_planes(const PlaneRule* rules, int plane_count, uint8_t* output) {
+	emit_planes<BOARD_SIZE>(rules, plane_count, output);
+}
+
+#endif
+
@@ -0,0 +1,51 @@
+// Reusing the replayed positions and features of opening move sequences shared between games.
+
+#include "prefix_cache.h"
+#include <cstdio>
+
+uint64_t game_start_hash(const Game& game) {
+	// Setup stones are unordered, so combine them with a commutative sum of their hashes.
+	uint64_t setup = 0;
+	for (const Move& m : game.setup_stones)
+		setup += splitmix64((uint64_t)m.who_moved << 16 | (m.xy.first + (m.xy.second << 8)));
+	return splitmix64(setup ^ ((uint64_t)game.board_size << 32));
+}
+
+PrefixCache::PrefixCache(size_t max_bytes, int max_depth) : max_bytes(max_bytes), max_depth(max_depth) {}
+
+PrefixSnapshot* PrefixCache::find(uint64_t key) {
+	auto it = index.find(key);
+	if (it == index.end())
+		return nullptr;
+	entries.splice(entries.begin(), entries, it->second);
+	return &it->second->second;
+}
+
+void PrefixCache::insert(uint64_t key, PrefixSnapshot snapshot) {
+	auto it = index.find(key);
+	if (it != index.end()) {
+		bytes -= it->second->second.bytes();
+		entries.erase(it->second);
+		index.erase(it);
+	}
+	bytes += snapshot.bytes();
+	entries.emplace_front(key, std::move(snapshot));
+	index[key] = entries.begin();
+	while (bytes > max_bytes and not entries.empty()) {
+		bytes -= entries.back().second.bytes();
+		index.erase(entries.back().first);
+		entries.pop_back();
+	}
+}
+
+void PrefixCache::report(std::ostream& out) const {
+	uint64_t lookups = feature_hits + feature_misses;
+	double mean_seconds = feature_misses == 0 ? 0 : feature_seconds / feature_misses;
+	char line[256];
+	snprintf(line, sizeof(line), "Prefix cache: reused features for %llu of %llu positions (%.1f%%), saving about %.2fs of feature extraction; ",
+		(unsigned long long)feature_hits, (unsigned long long)lookups, lookups == 0 ? 0.0 : 100.0 * feature_hits / lookups, feature_hits * mean_seconds);
+	out << line;
+	snprintf(line, sizeof(line), "resumed %llu games, skipping %llu moves of replay; %zu entries in %.1f MiB.",
+		(unsigned long long)resumed_games, (unsigned long long)skipped_moves, entries.size(), bytes / (1024.0 * 1024.0));
+	out << line << std::endl;
+}
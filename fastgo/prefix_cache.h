@@ -0,0 +1,61 @@
+// Reusing the replayed positions and features of opening move sequences shared between games.
+
+#ifndef _SNPGO_PREFIX_CACHE_H
+#define _SNPGO_PREFIX_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+#include "go_utils.h"
+#include "sgf.h"
+
+// A hash of everything before the first move: the board size and the setup stones.
+uint64_t game_start_hash(const Game& game);
+// The hash of a move sequence one move longer.
+static inline uint64_t extend_prefix_hash(uint64_t hash, const Move& m) {
+	uint64_t point = m.pass ? 0xffff : m.xy.first + (m.xy.second << 8);
+	return splitmix64(hash ^ ((uint64_t)m.who_moved << 16 | point));
+}
+// Keys a position by the moves leading up to it together with the player about to move, whose perspective features take.
+static inline uint64_t prefix_position_key(uint64_t prefix_hash, Player to_move) {
+	return splitmix64(prefix_hash + (uint64_t)to_move);
+}
+
+// The position right before some move, with everything needed to carry on replaying from it.
+struct PrefixSnapshot {
+	std::vector<Cell> cells;
+	Coord ko_point;
+	std::list<Coord> move_history;
+	// The position's features from the perspective of the player about to move, or empty until they've been computed.
+	std::vector<uint8_t> features;
+
+	size_t bytes() const { return sizeof(PrefixSnapshot) + cells.size() + move_history.size() * sizeof(Coord) + features.size(); }
+};
+
+// An LRU cache of snapshots of the positions within the first few moves of games, keyed by prefix_position_key.
+// Not thread safe; each converter thread wants its own.
+class PrefixCache {
+	typedef std::list<std::pair<uint64_t, PrefixSnapshot>> EntryList;
+	size_t max_bytes, bytes = 0;
+	EntryList entries;
+	std::unordered_map<uint64_t, EntryList::iterator> index;
+
+public:
+	// Only positions before move max_depth are cached, as deeper ones are rarely shared.
+	const int max_depth;
+
+	uint64_t resumed_games = 0, skipped_moves = 0;
+	uint64_t feature_hits = 0, feature_misses = 0;
+	double feature_seconds = 0;
+
+	PrefixCache(size_t max_bytes, int max_depth);
+	// Returns null on a miss. The pointer is good until the next insert.
+	PrefixSnapshot* find(uint64_t key);
+	void insert(uint64_t key, PrefixSnapshot snapshot);
+	void report(std::ostream& out) const;
+};
+
+#endif
+
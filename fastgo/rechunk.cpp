@@ -0,0 +1,202 @@
+// Redistribute the samples of existing chunk sets into a different number or size of chunks, without reconverting any games.
+
+#include "chunk_io.h"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+// Samples are passed from the reader threads to the main thread in batches of about this many bytes.
+constexpr size_t READ_BATCH_BYTES = 1 << 20;
+// Batches each reader thread can get ahead by.
+constexpr size_t READ_QUEUE_BATCHES = 4;
+
+// Decompresses input chunk sets on several threads, each reading its own sets (input index modulo thread count) ahead
+// of time into a bounded queue, while the caller takes every sample strictly in input order.
+class ParallelChunkSetReader {
+	struct Batch {
+		std::vector<char> records;
+		// The last batch of an input set, possibly empty, and whether the set was unreadable or its streams misaligned.
+		bool last = false, failed = false;
+	};
+	struct ReaderThread {
+		std::mutex mutex;
+		std::condition_variable not_empty, not_full;
+		std::deque<Batch> queue;
+		bool stopping = false;
+		std::thread thread;
+	};
+
+	std::string features_base, targets_base, winners_base;
+	int in_count;
+	SampleLayout layout;
+	std::vector<std::unique_ptr<ReaderThread>> threads;
+	// Starts out as if just past the end of input -1.
+	int current_input = -1;
+	Batch current;
+	size_t position = 0;
+
+	void run(int first_input, ReaderThread& reader) {
+		for (int input = first_input; input < in_count; input += threads.size()) {
+			std::string suffix = "_" + std::to_string(input);
+			ChunkSetReader chunk_set(features_base + suffix, targets_base + suffix, winners_base + suffix, layout);
+			bool done = false;
+			while (not done) {
+				Batch batch;
+				batch.records.resize(READ_BATCH_BYTES / layout.record_bytes() * layout.record_bytes());
+				size_t filled = 0;
+				while (filled < batch.records.size()) {
+					if (not chunk_set.is_open() or not chunk_set.read_record(&batch.records[filled])) {
+						batch.last = done = true;
+						batch.failed = not chunk_set.is_open() or chunk_set.misaligned;
+						break;
+					}
+					filled += layout.record_bytes();
+				}
+				batch.records.resize(filled);
+
+				std::unique_lock<std::mutex> lock(reader.mutex);
+				reader.not_full.wait(lock, [&] { return reader.stopping or reader.queue.size() < READ_QUEUE_BATCHES; });
+				if (reader.stopping)
+					return;
+				reader.queue.push_back(std::move(batch));
+				lock.unlock();
+				reader.not_empty.notify_one();
+			}
+		}
+	}
+
+public:
+	// Set if next_record stopped because an input couldn't be read, rather than at the end of the last one.
+	int failed_input = -1;
+
+	ParallelChunkSetReader(std::string features_base, std::string targets_base, std::string winners_base, int in_count, SampleLayout layout, int thread_count)
+		: features_base(features_base), targets_base(targets_base), winners_base(winners_base), in_count(in_count), layout(layout)
+	{
+		current.last = true;
+		for (int t = 0; t < std::min(thread_count, in_count); t++)
+			threads.emplace_back(new ReaderThread);
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t]->thread = std::thread(&ParallelChunkSetReader::run, this, t, std::ref(*threads[t]));
+	}
+
+	~ParallelChunkSetReader() {
+		for (auto& reader : threads) {
+			{
+				std::lock_guard<std::mutex> lock(reader->mutex);
+				reader->stopping = true;
+			}
+			reader->not_full.notify_one();
+			reader->thread.join();
+		}
+	}
+
+	// Returns a pointer to the next sample's record_bytes() bytes, good until the next call, or null at the end.
+	const char* next_record() {
+		while (position == current.records.size()) {
+			if (current.failed) {
+				failed_input = current_input;
+				return nullptr;
+			}
+			if (current.last and ++current_input == in_count)
+				return nullptr;
+			ReaderThread& reader = *threads[current_input % threads.size()];
+			std::unique_lock<std::mutex> lock(reader.mutex);
+			reader.not_empty.wait(lock, [&] { return not reader.queue.empty(); });
+			current = std::move(reader.queue.front());
+			reader.queue.pop_front();
+			lock.unlock();
+			reader.not_full.notify_one();
+			position = 0;
+		}
+		const char* record = &current.records[position];
+		position += layout.record_bytes();
+		return record;
+	}
+};
+
+int main(int argc, char** argv) {
+	int planes = FEATURE_COUNT;
+	int thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+	uint64_t samples_per_chunk = 0;
+	bool drop_empty_targets = false;
+	bool bad_options = argc < 9;
+	for (int i = 9; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--drop-empty-targets")
+			drop_empty_targets = true;
+		else if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--samples-per-chunk")
+			samples_per_chunk = std::stoull(argv[++i]);
+		else if (option == "--threads")
+			thread_count = std::stoi(argv[++i]);
+		else if (option == "--planes")
+			planes = std::stoi(argv[++i]);
+		else
+			bad_options = true;
+	}
+	int in_count = bad_options ? 0 : std::stoi(argv[4]);
+	int out_count = bad_options ? 0 : std::stoi(argv[8]);
+	if (bad_options or in_count < 1 or thread_count < 1 or planes < 1 or (samples_per_chunk > 0) != (out_count == 0) or out_count < 0) {
+		std::cerr << "Usage: rechunk features_in targets_in winners_in in_count features_out targets_out winners_out out_count [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Reads the chunk sets features_in_0 ... features_in_{in_count-1} (and likewise for targets and winners) in order," << std::endl;
+		std::cerr << "and deals their samples, in that order, round robin over out_count new chunk sets. Chunks are streamed: no chunk" << std::endl;
+		std::cerr << "is ever held in memory whole." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --samples-per-chunk n  Instead fill the outputs in order, n samples each, for as many as it takes. Pass an" << std::endl;
+		std::cerr << "                         out_count of 0 with this." << std::endl;
+		std::cerr << "  --drop-empty-targets   Leave out samples whose target plane is all zero." << std::endl;
+		std::cerr << "  --threads n            Threads each for decompressing the inputs and compressing the outputs (default: one per core)." << std::endl;
+		std::cerr << "  --planes n             Feature planes per sample, for chunks made with another feature set (default " << FEATURE_COUNT << ")." << std::endl;
+		return 1;
+	}
+	std::string features_in = argv[1], targets_in = argv[2], winners_in = argv[3];
+	std::vector<std::string> outputs{argv[5], argv[6], argv[7]};
+
+	SampleLayout layout;
+	layout.features_bytes = planes * BOARD_SIZE * BOARD_SIZE;
+	std::unique_ptr<AsyncChunkSetWriter> writer;
+	if (samples_per_chunk > 0)
+		writer.reset(new AsyncChunkSetWriter(outputs, AsyncChunkSetWriter::SamplesPerFile{samples_per_chunk}, thread_count));
+	else
+		writer.reset(new AsyncChunkSetWriter(outputs, out_count, thread_count));
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t samples_read = 0, samples_dropped = 0;
+	const int parts[] = {layout.features_bytes, layout.targets_bytes, layout.winners_bytes};
+	ParallelChunkSetReader reader(features_in, targets_in, winners_in, in_count, layout, thread_count);
+	while (const char* record = reader.next_record()) {
+		samples_read++;
+		const char* target = record + layout.features_bytes;
+		if (drop_empty_targets and std::all_of(target, target + layout.targets_bytes, [](char c) { return c == 0; })) {
+			samples_dropped++;
+			continue;
+		}
+		for (int part = 0; part < 3; part++) {
+			writer->write(part, record, parts[part]);
+			record += parts[part];
+		}
+		writer->advance();
+	}
+	if (reader.failed_input >= 0) {
+		std::cerr << "Chunk set " << features_in << "_" << reader.failed_input << " is missing or has misaligned features, targets and winners." << std::endl;
+		return 1;
+	}
+	writer->close();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Rechunked %llu samples from %i chunk sets into %i in %.1fs (%.0f samples/s), dropping %llu with empty targets.\n",
+		(unsigned long long)samples_read, in_count, samples_per_chunk > 0 ? writer->index + (writer->samples_written % samples_per_chunk != 0) : out_count,
+		seconds, samples_read / seconds, (unsigned long long)samples_dropped);
+	writer->report(std::cout);
+}
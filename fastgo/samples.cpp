@@ -0,0 +1,177 @@
+// Turning games into training samples.
+
+#include "samples.h"
+#include "feature_extraction.h"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+std::vector<uint32_t> sample_part_bytes(int board_size, bool territory, bool eye_plane) {
+	int points = board_size * board_size;
+	std::vector<uint32_t> parts{(uint32_t)(total_features(board_size) + (eye_plane ? points : 0)), (uint32_t)points, 2};
+	if (territory)
+		parts.push_back(points + sizeof(int16_t));
+	return parts;
+}
+
+std::vector<std::string> sample_part_names(bool territory) {
+	std::vector<std::string> names{"features", "targets", "winners"};
+	if (territory)
+		names.push_back("territory");
+	return names;
+}
+
+template <int SIZE>
+void score_final_position(const Game& game, AreaScorerOfSize<SIZE>& scorer, AreaScoreOfSize<SIZE>& result) {
+	assert(game.board_size == SIZE);
+	GoBoardOfSize<SIZE> final_board = initial_board<SIZE>(game);
+	for (const Move& m : game.moves)
+		if (not m.pass)
+			final_board.place_stone(m.who_moved, m.xy);
+	Player to_move = game.moves.empty() ? Player::BLACK : opponent_of(game.moves.back().who_moved);
+	scorer.score(final_board.cells, to_move, game.komi, result);
+}
+
+template <int SIZE>
+static PrefixSnapshot take_snapshot(const GoBoardOfSize<SIZE>& board, const FeatureExtractorOfSize<SIZE>& feature_extractor, const uint8_t* features, int feature_bytes) {
+	PrefixSnapshot snapshot;
+	snapshot.cells.assign(board.cells.begin(), board.cells.end());
+	snapshot.ko_point = board.ko_point;
+	snapshot.move_history = feature_extractor.move_history;
+	if (features != nullptr)
+		snapshot.features.assign(features, features + feature_bytes);
+	return snapshot;
+}
+
+template <int SIZE>
+void write_all_samples(SampleSink& writer, const Game& game, const std::vector<bool>& selected, const AreaScoreOfSize<SIZE>* final_score, bool eye_plane, PrefixCache* cache) {
+	assert(game.board_size == SIZE);
+	const int feature_bytes = total_features(SIZE) + (eye_plane ? SIZE * SIZE : 0);
+	// Past the last selected move there's nothing left to write, so don't even replay the rest of the game.
+	int last_selected = -1;
+	for (int move_index = 0; move_index < (int)selected.size(); move_index++)
+		if (selected[move_index])
+			last_selected = move_index;
+	if (last_selected == -1)
+		return;
+
+	GoBoardOfSize<SIZE> board;
+	FeatureExtractorOfSize<SIZE> feature_extractor;
+	std::array<uint8_t, SIZE * SIZE> one_hot_winning_move = {};
+
+	// Key the positions within the cache's depth. Replay can pick up from the deepest position in an unbroken run of
+	// cached ones, as long as every sample before it has its features cached too.
+	std::vector<uint64_t> prefix_keys;
+	int start = 0;
+	if (cache != nullptr) {
+		uint64_t prefix_hash = game_start_hash(game);
+		for (int move_index = 0; move_index <= std::min(last_selected, cache->max_depth - 1); move_index++) {
+			prefix_keys.push_back(prefix_position_key(prefix_hash, game.moves[move_index].who_moved));
+			prefix_hash = extend_prefix_hash(prefix_hash, game.moves[move_index]);
+		}
+		const PrefixSnapshot* resume_from = nullptr;
+		for (int move_index = 0; move_index < (int)prefix_keys.size(); move_index++) {
+			const PrefixSnapshot* snapshot = cache->find(prefix_keys[move_index]);
+			if (snapshot == nullptr)
+				break;
+			resume_from = snapshot;
+			start = move_index;
+			if (selected[move_index] and not game.moves[move_index].pass and snapshot->features.empty())
+				break;
+		}
+		if (start > 0) {
+			std::array<Cell, SIZE * SIZE> cells;
+			std::copy(resume_from->cells.begin(), resume_from->cells.end(), cells.begin());
+			board = GoBoardOfSize<SIZE>::from_cells(cells);
+			board.ko_point = resume_from->ko_point;
+			feature_extractor.move_history = resume_from->move_history;
+			cache->resumed_games++;
+			cache->skipped_moves += start;
+		}
+	}
+	if (start == 0)
+		board = initial_board<SIZE>(game);
+
+	for (int move_index = 0; move_index <= last_selected; move_index++) {
+		const Move& m = game.moves[move_index];
+		bool sample = selected[move_index] and not m.pass;
+		// Before start, the board isn't being replayed, and every sample's features are in the cache.
+		bool replaying = move_index >= start;
+
+		// Get out features for the board right BEFORE the move, from the cache if we can.
+		uint8_t features_buffer[total_features(SIZE) + SIZE * SIZE];
+		bool cacheable = move_index < (int)prefix_keys.size();
+		const PrefixSnapshot* snapshot = cacheable ? cache->find(prefix_keys[move_index]) : nullptr;
+		bool cached_features = snapshot != nullptr and not snapshot->features.empty();
+		if (sample and cached_features) {
+			std::copy(snapshot->features.begin(), snapshot->features.end(), features_buffer);
+			cache->feature_hits++;
+		} else if (sample) {
+			assert(replaying);
+			auto start_time = std::chrono::steady_clock::now();
+			feature_extractor.fill_features(features_buffer, board, m.who_moved);
+			if (eye_plane)
+				feature_extractor.fill_eye_plane(features_buffer + total_features(SIZE), board, m.who_moved);
+			if (cacheable) {
+				cache->feature_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+				cache->feature_misses++;
+			}
+		}
+		if (cacheable and replaying and (snapshot == nullptr or (sample and not cached_features)))
+			cache->insert(prefix_keys[move_index], take_snapshot(board, feature_extractor, sample ? features_buffer : nullptr, feature_bytes));
+
+		// Currently we generate no samples on a pass.
+		if (m.pass) {
+			if (not replaying)
+				continue;
+			// Insert a dummy move to the history, so that the network can rely on
+			// particular positions in the history being moves by particular players.
+			feature_extractor.add_move_to_history({-1, -1});
+			continue;
+		}
+
+		if (sample) {
+			writer.write(FEATURES_STREAM, reinterpret_cast<const char*>(features_buffer), feature_bytes);
+
+			// Write the winning move out.
+			Cell& winning_move_cell = piece_at(one_hot_winning_move, m.xy);
+			winning_move_cell = 1;
+			writer.write(TARGETS_STREAM, reinterpret_cast<const char*>(&one_hot_winning_move[0]), SIZE * SIZE);
+			winning_move_cell = 0;
+
+			// Write the winner of the game out.
+			char game_winner[] = {0, 0};
+			if (game.who_won == m.who_moved)
+				game_winner[0] = 1;
+			if (game.who_won == opponent_of(m.who_moved))
+				game_winner[1] = 1;
+			writer.write(WINNERS_STREAM, game_winner, 2);
+
+			// Write the final ownership and margin out, from the perspective of the player to move.
+			if (final_score != nullptr) {
+				int8_t sign = m.who_moved == Player::BLACK ? 1 : -1;
+				int8_t ownership[SIZE * SIZE];
+				for (int i = 0; i < SIZE * SIZE; i++)
+					ownership[i] = sign * final_score->ownership[i];
+				int16_t half_point_margin = std::lround(2 * sign * final_score->margin);
+				writer.write(TERRITORY_STREAM, reinterpret_cast<const char*>(ownership), sizeof(ownership));
+				writer.write(TERRITORY_STREAM, reinterpret_cast<const char*>(&half_point_margin), sizeof(half_point_margin));
+			}
+
+			// Move every stream on to the next file together, so they remain synced up.
+			writer.advance();
+		}
+
+		// Update the board and feature extractor.
+		if (replaying) {
+			board.place_stone(m.who_moved, m.xy);
+			feature_extractor.add_move_to_history(m.xy);
+		}
+	}
+}
+
+#define INSTANTIATE(SIZE) \
+	template void score_final_position<SIZE>(const Game& game, AreaScorerOfSize<SIZE>& scorer, AreaScoreOfSize<SIZE>& result); \
+	template void write_all_samples<SIZE>(SampleSink& writer, const Game& game, const std::vector<bool>& selected, const AreaScoreOfSize<SIZE>* final_score, bool eye_plane, PrefixCache* cache);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
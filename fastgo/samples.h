@@ -0,0 +1,39 @@
+// Turning games into training samples.
+
+#ifndef _SNPGO_SAMPLES_H
+#define _SNPGO_SAMPLES_H
+
+#include <vector>
+#include <string>
+#include "go_utils.h"
+#include "sgf.h"
+#include "chunk_io.h"
+#include "scoring.h"
+#include "prefix_cache.h"
+
+// The streams of the output chunk set, in the order their paths are given to an AsyncChunkSetWriter.
+enum SampleStream {
+	FEATURES_STREAM,
+	TARGETS_STREAM,
+	WINNERS_STREAM,
+	TERRITORY_STREAM,
+};
+
+// The size in bytes of each stream's part of one sample, for writing them as records.
+std::vector<uint32_t> sample_part_bytes(int board_size, bool territory, bool eye_plane = false);
+// The name of each stream's part, for formats that label them.
+std::vector<std::string> sample_part_names(bool territory);
+
+// Replays the whole game and scores the position it ends in.
+template <int SIZE>
+void score_final_position(const Game& game, AreaScorerOfSize<SIZE>& scorer, AreaScoreOfSize<SIZE>& result);
+
+// Writes a sample for each selected move: the features of the position right before it, the move as a one-hot target,
+// who won from the mover's perspective, and, if final_score isn't null, the final ownership and margin from their perspective.
+// The game must be on a board of size SIZE. With a cache, replay starts from the deepest position another game has
+// already reached, and features of positions in the cache are copied rather than recomputed.
+// With eye_plane, each sample's features are followed by FeatureExtractorOfSize::fill_eye_plane's plane.
+template <int SIZE>
+void write_all_samples(SampleSink& writer, const Game& game, const std::vector<bool>& selected, const AreaScoreOfSize<SIZE>* final_score, bool eye_plane = false, PrefixCache* cache = nullptr);
+
+#endif
@@ -0,0 +1,78 @@
+// Choosing which positions of a game get written out as training samples.
+
+#include "sampling.h"
+#include <algorithm>
+
+bool SamplingPolicy::accepts_game(const Game& game) const {
+	return game.white_rank >= rank_threshold or game.black_rank >= rank_threshold;
+}
+
+// A partial Fisher-Yates that puts a uniform choice of keep candidates at the front.
+static void shuffle_front(std::vector<int>& candidates, size_t keep, std::mt19937_64& generator) {
+	for (size_t i = 0; i < keep and keep < candidates.size(); i++) {
+		std::uniform_int_distribution<size_t> choose(i, candidates.size() - 1);
+		std::swap(candidates[i], candidates[choose(generator)]);
+	}
+}
+
+void SamplingPolicy::select(const Game& game, std::mt19937_64& generator, std::vector<bool>& selected) const {
+	selected.assign(game.moves.size(), false);
+	std::vector<int> eligible;
+	for (int move_index = 0; move_index < (int)game.moves.size(); move_index++) {
+		const Move& m = game.moves[move_index];
+		if (m.pass)
+			continue;
+		int rank = m.who_moved == Player::BLACK ? game.black_rank : game.white_rank;
+		if (rank < rank_threshold)
+			continue;
+		if (after_random_moves_only and not (move_index > 0 and game.moves[move_index - 1].is_random_self_play_move))
+			continue;
+		eligible.push_back(move_index);
+	}
+
+	size_t keep = eligible.size();
+	if (moves_per_game > 0)
+		keep = std::min<size_t>(keep, moves_per_game);
+	shuffle_front(eligible, keep, generator);
+	for (size_t i = 0; i < keep; i++)
+		selected[eligible[i]] = true;
+}
+
+void SamplingPolicy::cap(std::mt19937_64& generator, std::vector<bool>& selected) const {
+	if (max_per_game <= 0)
+		return;
+	std::vector<int> survivors;
+	for (int move_index = 0; move_index < (int)selected.size(); move_index++)
+		if (selected[move_index])
+			survivors.push_back(move_index);
+	if (survivors.size() <= (size_t)max_per_game)
+		return;
+	shuffle_front(survivors, max_per_game, generator);
+	for (size_t i = max_per_game; i < survivors.size(); i++)
+		selected[survivors[i]] = false;
+}
+
+bool parse_sampling_option(int argc, char** argv, int& i, SamplingPolicy& policy) {
+	std::string option = argv[i];
+	if (option == "--after-random-moves") {
+		policy.after_random_moves_only = true;
+		return true;
+	}
+	if (i + 1 >= argc)
+		return false;
+	if (option == "--moves-per-game")
+		policy.moves_per_game = std::stoi(argv[++i]);
+	else if (option == "--max-per-game")
+		policy.max_per_game = std::stoi(argv[++i]);
+	else if (option == "--rank-threshold")
+		policy.rank_threshold = std::stoi(argv[++i]);
+	else
+		return false;
+	return true;
+}
+
+const char* SAMPLING_OPTIONS_USAGE =
+	"  --moves-per-game k     Write k uniformly chosen positions per game instead of all of them.\n"
+	"  --max-per-game n       Never write more than n positions from one game, applied after every other filter.\n"
+	"  --rank-threshold r     Skip moves by players ranked below r (default -100).\n"
+	"  --after-random-moves   Only write replies to moves flagged as random self-play moves.\n";
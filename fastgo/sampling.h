@@ -0,0 +1,35 @@
+// Choosing which positions of a game get written out as training samples.
+
+#ifndef _SNPGO_SAMPLING_H
+#define _SNPGO_SAMPLING_H
+
+#include <vector>
+#include <random>
+#include <string>
+#include "sgf.h"
+
+// Consecutive positions of one game are highly correlated, so we usually only want a few of them.
+// Moves are filtered first (passes are never sampled), and then the survivors are subsampled.
+struct SamplingPolicy {
+	// Keep at most this many uniformly chosen moves per game, or every move if zero.
+	int moves_per_game = 0;
+	// A hard cap on the samples from any one game, applied by cap() once any other filtering is done, or no cap if zero.
+	int max_per_game = 0;
+	// Moves by players ranked below this are never sampled, and games where both are below it are skipped.
+	int rank_threshold = -100;
+	// Only sample the reply to a move flagged as a random self-play move.
+	bool after_random_moves_only = false;
+
+	bool accepts_game(const Game& game) const;
+	// Sets selected[i] for each move index that should be written, before the cap.
+	void select(const Game& game, std::mt19937_64& generator, std::vector<bool>& selected) const;
+	// Clears all but max_per_game uniformly chosen entries of selected. Call it last, after select and any deduplication.
+	void cap(std::mt19937_64& generator, std::vector<bool>& selected) const;
+};
+
+// Parses the option at argv[i] (advancing i past its argument) into policy, returning false if it isn't a sampling option.
+bool parse_sampling_option(int argc, char** argv, int& i, SamplingPolicy& policy);
+extern const char* SAMPLING_OPTIONS_USAGE;
+
+#endif
+
@@ -1,6 +1,9 @@
 // Convert SGF files into trainable features and chunks.
 
 #include "go_utils.h"
+#include "sgf.h"
+#include "sampling.h"
+#include "scoring.h"
 
 using namespace std;
 #include <iostream>
@@ -22,236 +25,12 @@ using namespace std;
 
 #include <random>
 std::random_device rd;     // only used once to initialise (seed) engine
-std::mt19937 rng(rd());    // random-number engine used (Mersenne-Twister in this case)
+std::mt19937_64 rng(rd()); // random-number engine used (Mersenne-Twister in this case)
 
 using boost::iostreams::filtering_ostream;
 
 #define HISTORY_LENGTH 3
-//#define SELECT_JUST_ONE_MOVE false
-#define SELECT_JUST_ONE_MOVE true
 //#define SCORING
-//#define RANK_THRESHOLD 4
-#define RANK_THRESHOLD -100
-#define SELF_PLAY
-
-struct Move {
-	Player who_moved;
-	Coord xy;
-	bool pass;
-
-#ifdef SELF_PLAY
-	bool is_random_self_play_move = false;
-#endif
-};
-
-struct Game {
-	string result_string = "???";
-	Player who_won = Player::NOBODY;
-	vector<Move> moves;
-	int white_rank = -99;
-	int black_rank = -99;
-	float komi = 7.5;
-};
-
-std::unordered_map<string, int> rank_string_table{
-	{"1d", 1}, {"2d", 2}, {"3d", 3},
-	{"4d", 4}, {"5d", 5}, {"6d", 6},
-	{"7d", 7}, {"8d", 8}, {"9d", 9},
-};
-
-//			cerr << "Unexpected EOF in " << path << endl; \
-
-#define NOT_EOF(x) \
-	do { \
-		if ((x) == EOF) { \
-			return false; \
-		} \
-	} while (0)
-
-static void fill_in_move(Move& m, string& location) {
-	if (location.size() == 0) {
-		m.pass = true;
-		return;
-	}
-	int x = ((int)location[0]) - 'a';
-	int y = ((int)location[1]) - 'a';
-	if (not ((0 <= x and x < 19 and 0 <= y and y < 19) or (x == 20 and y == 20))) {
-		// A move at [tt] (or (19, 19), right off the corner) is considered a pass.
-		if (x == 19 and y == 19) {
-			m.pass = true;
-			m.xy = {-1, -1};
-			return;
-		}
-		cout << "Weird coordinates: " << x << " " << y << endl;
-		assert(false);
-	}
-	m.xy = {x, y};
-}
-
-string slurp_file(string path) {
-	ifstream in(path, ios_base::in | ios_base::binary);
-	std::ostringstream ss{};
-	ss << in.rdbuf();
-	return ss.str();
-//	FILE* fp = fopen(path.c_str(), "rb");
-//	char buf[4096];
-//	size_t total_read = fread(buf, 4095, 1, fp);
-//	fclose(fp);
-//	return string(buf, total_read);
-}
-
-static bool parse_sgf(string path, Game& game) {
-	string file_contents = slurp_file(path);
-	//std::ifstream f(path);
-	std::stringstream f{file_contents};
-
-	// Move up to the first open paren.
-	f >> std::ws;
-	if (f.get() != '(') {
-		cerr << "Expected '(' in " << path << endl;
-		return false;
-	}
-	// Begin consuming nodes.
-	while (1) {
-		f >> std::ws;
-		// End parsing if we've hit the end of file or ')'
-		int c = f.get();
-		if (c == EOF or c == ')')
-			break;
-		// Begin the first node.
-		if (c != ';') {
-			cerr << "Expected ';' in " << path << endl;
-			return false;
-		}
-		// Parse the Properties for the master header node.
-		while (1) {
-			f >> std::ws;
-			int next = f.peek();
-			NOT_EOF(next);
-			// If we hit a ; then we're starting the moves.
-			if (next == ';')
-				break;
-			// Parse an entry in the header node.
-			string property_name, property_first_contents;
-			std::getline(f, property_name, '[');
-			std::getline(f, property_first_contents, ']');
-			if (property_name == "SZ") {
-				if (property_first_contents != "19") {
-//					cerr << "Bad size: " << property_first_contents << " in " << path << endl;
-					return false;
-				}
-			} else if (property_name == "HA") {
-				if (property_first_contents != "0") {
-//					cerr << "Bad handicap: " << property_first_contents << " in " << path << endl;
-					return false;
-				}
-			} else if (property_name == "AW" or property_name == "AB") {
-//				cerr << "Contains AW/BW, which is currently not supported." << endl;
-				return false;
-			} /* else if (property_name == "TM") { // or property_name == "OT") {
-				int value = 0;
-				try {
-					value = std::stoi(property_first_contents);
-				} catch (exception& e) {
-					cout << "Bad integer attempt in: " << path << " with " << e.what() << " at value: " << property_first_contents << " -- skipping!" << endl;
-					return false;
-				}
-				if (value < 600)
-					return false;
-//				cerr << "Contains TM/OT, which we currently drop: " << property_name << " = " << property_first_contents << endl;
-//				return false;
-			} */ else if (property_name == "RE") {
-				game.result_string = property_first_contents;
-			} else if (property_name == "WR") {
-				if (rank_string_table.count(property_first_contents) > 0)
-					game.white_rank = rank_string_table[property_first_contents];
-//				else
-//					cerr << "Weird white rank: " << property_first_contents << endl;
-			} else if (property_name == "BR") {
-				if (rank_string_table.count(property_first_contents) > 0)
-					game.black_rank = rank_string_table[property_first_contents];
-//				else
-//					cerr << "Weird black rank: " << property_first_contents << endl;
-			} else if (property_name == "KM") {
-				try {
-					game.komi = std::stof(property_first_contents);
-				} catch (exception& e) {
-					cerr << "Bad komi: " << property_first_contents << endl;
-					return false;
-				}
-				if (game.komi >= 8.5 or game.komi <= -0.5) {
-//					cerr << "Bizarre komi: " << game.komi << " in " << path << endl;
-					return false;
-				}
-//				assert(-6 < game.komi);
-//				assert(game.komi < 12);
-			}
-		}
-		// Parse the sequence of move nodes.
-		while (1) {
-			f >> std::ws;
-			int c = f.get();
-			NOT_EOF(c);
-			// Check if we're done with all of the moves.
-			if (c == ')')
-				break;
-			// If not, then there better be a move here.
-			if (c != ';') {
-				cerr << "Expected move ';' in " << path << endl;
-				return false;
-			}
-			game.moves.push_back({Player::NOBODY, {0, 0}, false});
-			Move& m = game.moves.back();
-
-			// Parse all of the properties inside of the move node.
-			while (1) {
-				f >> std::ws;
-				int next = f.peek();
-				NOT_EOF(next);
-				// If we hit a ; then we're done with this move.
-				if (next == ';' or next == ')')
-					break;
-				string property_name, property_first_contents;
-				std::getline(f, property_name, '[');
-				std::getline(f, property_first_contents, ']');
-				if (property_name == "B" or property_name == "W") {
-					m.who_moved = property_name == "B" ? Player::BLACK : Player::WHITE;
-					fill_in_move(m, property_first_contents);
-				} else if (property_name == "AW" or property_name == "BW") {
-					cerr << "Contains move AW/BW, which is currently not supported." << endl;
-					return false;
-				}
-#ifdef SELF_PLAY
-				else if (property_name == "C" and property_first_contents == "rand") {
-					m.is_random_self_play_move = true;
-				}
-#endif
-			}
-			if (m.who_moved == Player::NOBODY) {
-				cerr << "Bad empty move in:" << path << endl;
-				game.moves.pop_back();
-			}
-		}
-	}
-
-	// Parse who won.
-	if (boost::starts_with(game.result_string, "B+")) {
-		game.who_won = Player::BLACK;
-	} else if (boost::starts_with(game.result_string, "W+")) {
-		game.who_won = Player::WHITE;
-	} else {
-		game.who_won = Player::NOBODY;
-//		cout << "                                                      Unknown result: " << game.result_string << endl;
-	}
-
-	if (game.who_won == Player::NOBODY)
-		return false;
-
-	if (game.komi != 6.5)
-		return false;
-
-	return true;
-}
 
 enum FeatureKind {
 	FEAT_ONES_PLANE,
@@ -344,17 +123,16 @@ void write_features(filtering_ostream& features_out, GoBoard& board, Player pers
 
 extern "C" uint8_t* fastgo_extract_features(uint8_t* raw_board, int* output_length, int perspective_player) {
 	assert(perspective_player == 1 or perspective_player == 2);
-	// Copy all of the moves into a board.
-	GoBoard board;
-	for (int y = 0; y < BOARD_SIZE; y++) {
-		for (int x = 0; x < BOARD_SIZE; x++) {
-//			uint8_t piece = piece_at(*reinterpret_cast<std::array<Cell, BOARD_SIZE * BOARD_SIZE>*>(raw_board), {x, y});
-			uint8_t piece = raw_board[x + y * BOARD_SIZE];
-			assert(piece == 0 or piece == 1 or piece == 2);
-			if (piece == 1 or piece == 2)
-				board.place_stone((Player)piece, {x, y});
-		}
-	}
+	// Build a board from all of the stones at once.
+	std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+	std::copy(raw_board, raw_board + BOARD_SIZE * BOARD_SIZE, cells.begin());
+	// from_cells captures nothing, so take off any group without liberties rather than crash extracting its features.
+	BoardAnalysis analysis;
+	analysis.analyse(cells);
+	for (int point = 0; point < BOARD_SIZE * BOARD_SIZE; point++)
+		if (analysis.group_size[point] > 0 and analysis.liberties[point] == 0)
+			cells[point] = 0;
+	GoBoard board = GoBoard::from_cells(cells);
 	// Get features out.
 	string main_feature_block;
 	filtering_ostream features_out(std::back_inserter(main_feature_block));
@@ -377,36 +155,37 @@ void write_all_samples(
 	filtering_ostream& targets_out,
 	filtering_ostream& winners_out,
 	filtering_ostream& territory_out,
-	string path
+	string path,
+	const SamplingPolicy& policy
 ) {
 #else
-void write_all_samples(filtering_ostream& features_out, filtering_ostream& targets_out, filtering_ostream& winners_out, string path) {
+void write_all_samples(filtering_ostream& features_out, filtering_ostream& targets_out, filtering_ostream& winners_out, string path, const SamplingPolicy& policy) {
 #endif
 	// Read in the SGF file.
 	Game game;
-	if (not parse_sgf(path, game))
+	if (not parse_sgf(path, game) or game.board_size != BOARD_SIZE)
+		return;
+	if (game.komi != 6.5)
 		return;
 
 	// If both players are too low rank then skip.
-	if (game.white_rank < RANK_THRESHOLD and game.black_rank < RANK_THRESHOLD) {
-//		cerr << "Both players too low rank: " << game.white_rank << " " << game.black_rank << endl;
+	if (not policy.accepts_game(game))
 		return;
-	}
-
-	// If just one player is too low rank then print a warning.
-//	if (game.white_rank < RANK_THRESHOLD)
-//		cerr << "White too low rank: " << game.white_rank << " " << game.black_rank << endl;
-//	if (game.black_rank < RANK_THRESHOLD)
-//		cerr << "Black too low rank: " << game.white_rank << " " << game.black_rank << endl;
 
 #ifdef SCORING
-	string final_territory_black = slurp_file(path + "-FINAL");
-	assert(final_territory_black.size() == 361);
-
-	string final_territory_white = final_territory_black;
-	std::replace(final_territory_white.begin(), final_territory_white.end(), '\1', 'x');
-	std::replace(final_territory_white.begin(), final_territory_white.end(), '\xff', '\1');
-	std::replace(final_territory_white.begin(), final_territory_white.end(), 'x', '\xff');
+	// Score the final position ourselves, with Black's area as 1 and White's as 0xff.
+	GoBoard final_board = initial_board<BOARD_SIZE>(game);
+	for (const Move& m : game.moves)
+		if (not m.pass)
+			final_board.place_stone(m.who_moved, m.xy);
+	AreaScorer scorer(DEFAULT_SCORING_PLAYOUTS, rng());
+	AreaScore final_score;
+	scorer.score(final_board.cells, game.moves.empty() ? Player::BLACK : opponent_of(game.moves.back().who_moved), game.komi, final_score);
+	string final_territory_black(BOARD_SIZE * BOARD_SIZE, '\0'), final_territory_white(BOARD_SIZE * BOARD_SIZE, '\0');
+	for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
+		final_territory_black[i] = final_score.ownership[i];
+		final_territory_white[i] = -final_score.ownership[i];
+	}
 #endif
 
 	// Keep move histories in a pair of circular buffers.
@@ -420,29 +199,17 @@ void write_all_samples(filtering_ostream& features_out, filtering_ostream& targe
 		}
 	}
 
-	GoBoard board;
+	GoBoard board = initial_board<BOARD_SIZE>(game);
 	std::array<uint8_t, BOARD_SIZE * BOARD_SIZE> one_hot_winning_move = {};
 
-	std::uniform_int_distribution<int> uni(0, game.moves.size() - 1);
-	int random_integer1 = uni(rng);
-	int random_integer2 = uni(rng);
+	vector<bool> selected;
+	policy.select(game, rng, selected);
+	policy.cap(rng, selected);
 
 	for (int move_index = 0; move_index < game.moves.size(); move_index++) {
 		Move& m = game.moves[move_index];
 
-		bool do_write_this_move = true;
-#ifdef SELECT_JUST_ONE_MOVE
-		do_write_this_move = (move_index == random_integer1) or (move_index == random_integer2);
-#endif
-#ifdef SELF_PLAY
-		do_write_this_move = (move_index > 0) and game.moves[move_index - 1].is_random_self_play_move;
-#endif
-
-		// Disable writing this move if the player is too low rank.
-		if (m.who_moved == Player::BLACK and game.black_rank < RANK_THRESHOLD)
-			do_write_this_move = false;
-		if (m.who_moved == Player::WHITE and game.white_rank < RANK_THRESHOLD)
-			do_write_this_move = false;
+		bool do_write_this_move = selected[move_index];
 
 		// Currently we generate no samples on a pass.
 		if (m.pass)
@@ -488,12 +255,9 @@ void write_all_samples(filtering_ostream& features_out, filtering_ostream& targe
 #ifdef SCORING
 		// Write a copy of this game's final territory out.
 //		territory_out.write(final_territory, final_territory.size());
-		if (m.who_moved == Player::BLACK) {
-			territory_out << final_territory_black;
-		} else if (m.who_moved == Player::WHITE) {
-			territory_out << final_territory_white;
-		} else {
-			assert(false);
+		if (do_write_this_move) {
+			assert(m.who_moved == Player::BLACK or m.who_moved == Player::WHITE);
+			territory_out << (m.who_moved == Player::BLACK ? final_territory_black : final_territory_white);
 		}
 #endif
 
@@ -511,10 +275,19 @@ void write_all_samples(filtering_ostream& features_out, filtering_ostream& targe
 }
 
 int main(int argc, char** argv) {
-	if (argc != 7) {
-		cerr << "Usage: sgf_to_chunks root_directory features_chunk.z targets_chunk.z winners_chunk.z start_index stop_index" << endl;
+	// By default write the replies to random self-play moves, as for training on scored self-play games.
+	SamplingPolicy policy;
+	policy.after_random_moves_only = true;
+	bool bad_options = argc < 7;
+	for (int i = 7; i < argc; i++)
+		if (not parse_sampling_option(argc, argv, i, policy))
+			bad_options = true;
+	if (bad_options) {
+		cerr << "Usage: sgf_to_chunks root_directory features_chunk.z targets_chunk.z winners_chunk.z start_index stop_index [options]" << endl;
 		cerr << endl;
 		cerr << "Finds all SGF files under the root directory, sorts them asciibetically processes those in [start_index, stop_index), and outputs to the chunk files." << endl;
+		cerr << endl;
+		cerr << SAMPLING_OPTIONS_USAGE;
 		return 1;
 	}
 
@@ -555,14 +328,8 @@ int main(int argc, char** argv) {
 	boost::filesystem::recursive_directory_iterator dir(root_directory_path);
 	for (auto entry : dir) {
 		if (boost::filesystem::extension(entry) == ".sgf") {
-#ifdef SCORING
-			if (!boost::filesystem::exists(entry.path().string() + "-FINAL"))
+			if (policy.after_random_moves_only and entry.path().string().find("-scored") == std::string::npos)
 				continue;
-#endif
-#ifdef SELF_PLAY
-			if (entry.path().string().find("-scored") == std::string::npos)
-				continue;
-#endif
 			paths.push_back(entry.path().string());
 		}
 	}
@@ -607,9 +374,9 @@ int main(int argc, char** argv) {
 			printf("Processing %5i [%5i/%5i] %s\n", index, (index - start_index + 1), (stop_index - start_index), path.c_str());
 //		cout << path << endl;
 #ifdef SCORING
-		write_all_samples(features_out, targets_out, winners_out, territory_out, path);
+		write_all_samples(features_out, targets_out, winners_out, territory_out, path, policy);
 #else
-		write_all_samples(features_out, targets_out, winners_out, path);
+		write_all_samples(features_out, targets_out, winners_out, path, policy);
 #endif
 	}
 }
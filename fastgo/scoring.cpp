@@ -0,0 +1,219 @@
+// Area scoring of finished games, with dead stones found by random playouts.
+
+#include "scoring.h"
+#include <algorithm>
+
+template <int SIZE>
+AreaScorerOfSize<SIZE>::AreaScorerOfSize(int playouts, uint64_t seed) : playouts(playouts), generator(seed) {}
+
+template <int SIZE>
+void AreaScorerOfSize<SIZE>::tromp_taylor(const Cells& cells, float komi, AreaScore& result) {
+	std::array<uint8_t, point_count(SIZE)> visited = {};
+	std::array<int16_t, point_count(SIZE)> region;
+	int area[3] = {0, 0, 0};
+	for (int point = 0; point < point_count(SIZE); point++) {
+		if (cells[point] != 0) {
+			result.ownership[point] = cells[point] == 1 ? 1 : -1;
+			area[cells[point]]++;
+			continue;
+		}
+		if (visited[point])
+			continue;
+		// Flood fill this empty region, noting which colours it touches.
+		int region_size = 0, scanned = 0;
+		bool touches[3] = {false, false, false};
+		region[region_size++] = point;
+		visited[point] = 1;
+		while (scanned < region_size) {
+			int here = region[scanned++];
+			for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+				if (neighbor < 0)
+					continue;
+				if (cells[neighbor] != 0) {
+					touches[cells[neighbor]] = true;
+				} else if (not visited[neighbor]) {
+					visited[neighbor] = 1;
+					region[region_size++] = neighbor;
+				}
+			}
+		}
+		int8_t owner = touches[1] == touches[2] ? 0 : touches[1] ? 1 : -1;
+		for (int i = 0; i < region_size; i++)
+			result.ownership[region[i]] = owner;
+		if (owner != 0)
+			area[owner == 1 ? 1 : 2] += region_size;
+	}
+	result.margin = area[1] - area[2] - komi;
+}
+
+template <int SIZE>
+void AreaScorerOfSize<SIZE>::next_generation() {
+	// On wraparound stale marks would collide with the new generation, so clear them.
+	if (++generation == 0) {
+		marks.fill(0);
+		generation = 1;
+	}
+}
+
+// Counts the liberties of the group at point on the playout board, stopping early once there are limit of them.
+template <int SIZE>
+int AreaScorerOfSize<SIZE>::count_liberties(int point, int limit) {
+	Cell colour = board[point];
+	next_generation();
+	int count = 0, stack_size = 0;
+	stack[stack_size++] = point;
+	marks[point] = generation;
+	while (stack_size > 0) {
+		int here = stack[--stack_size];
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+			if (neighbor < 0 or marks[neighbor] == generation)
+				continue;
+			marks[neighbor] = generation;
+			if (board[neighbor] == 0) {
+				if (++count >= limit)
+					return count;
+			} else if (board[neighbor] == colour) {
+				stack[stack_size++] = neighbor;
+			}
+		}
+	}
+	return count;
+}
+
+// Returns the number of stones removed.
+template <int SIZE>
+int AreaScorerOfSize<SIZE>::remove_group(int point) {
+	Cell colour = board[point];
+	int removed = 0, stack_size = 0;
+	stack[stack_size++] = point;
+	board[point] = 0;
+	while (stack_size > 0) {
+		int here = stack[--stack_size];
+		empty_index[here] = empty_count;
+		empty_points[empty_count++] = here;
+		removed++;
+		for (int neighbor : POINT_NEIGHBORS<SIZE>[here]) {
+			if (neighbor >= 0 and board[neighbor] == colour) {
+				board[neighbor] = 0;
+				stack[stack_size++] = neighbor;
+			}
+		}
+	}
+	return removed;
+}
+
+template <int SIZE>
+bool is_playout_eye(const std::array<Cell, point_count(SIZE)>& board, int point, Cell colour) {
+	for (int neighbor : POINT_NEIGHBORS<SIZE>[point])
+		if (neighbor >= 0 and board[neighbor] != colour)
+			return false;
+	int x = point % SIZE, y = point / SIZE;
+	int opponent_diagonals = 0, off_board_diagonals = 0;
+	for (int dy : {-1, 1}) {
+		for (int dx : {-1, 1}) {
+			if (not coord_in_bounds<SIZE>({x + dx, y + dy}))
+				off_board_diagonals++;
+			else if (board[(x + dx) + (y + dy) * SIZE] == 3 - colour)
+				opponent_diagonals++;
+		}
+	}
+	return opponent_diagonals < (off_board_diagonals > 0 ? 1 : 2);
+}
+
+// Plays the move if it's legal, updating the simple ko point, and returns whether it was played.
+template <int SIZE>
+bool AreaScorerOfSize<SIZE>::try_play(int point, Cell colour, int& ko_point) {
+	assert(board[point] == 0);
+	bool legal = false;
+	for (int neighbor : POINT_NEIGHBORS<SIZE>[point]) {
+		if (neighbor < 0)
+			continue;
+		// Legal if there's an adjacent liberty, a friendly group with a spare liberty, or a capture.
+		if (board[neighbor] == 0 or
+			(board[neighbor] == colour and count_liberties(neighbor, 2) >= 2) or
+			(board[neighbor] != colour and count_liberties(neighbor, 2) == 1)) {
+			legal = true;
+			break;
+		}
+	}
+	if (not legal)
+		return false;
+
+	board[point] = colour;
+	int last = empty_points[--empty_count];
+	empty_points[empty_index[point]] = last;
+	empty_index[last] = empty_index[point];
+
+	int captured = 0, captured_point = -1;
+	bool friendly_neighbor = false;
+	for (int neighbor : POINT_NEIGHBORS<SIZE>[point]) {
+		if (neighbor < 0)
+			continue;
+		if (board[neighbor] == colour)
+			friendly_neighbor = true;
+		else if (board[neighbor] == 3 - colour and count_liberties(neighbor, 1) == 0) {
+			captured += remove_group(neighbor);
+			captured_point = neighbor;
+		}
+	}
+	ko_point = captured == 1 and not friendly_neighbor and count_liberties(point, 2) == 1 ? captured_point : -1;
+	return true;
+}
+
+template <int SIZE>
+void AreaScorerOfSize<SIZE>::playout(const Cells& cells, Player to_move) {
+	board = cells;
+	empty_count = 0;
+	for (int point = 0; point < point_count(SIZE); point++) {
+		if (board[point] == 0) {
+			empty_index[point] = empty_count;
+			empty_points[empty_count++] = point;
+		}
+	}
+
+	Cell colour = (Cell)to_move;
+	int ko_point = -1, passes = 0;
+	for (int move = 0; move < MAX_PLAYOUT_MOVES_PER_POINT * point_count(SIZE) and passes < 2; move++) {
+		// Try the empty points in order from a random start, passing if none of them are playable.
+		bool played = false;
+		int start = empty_count == 0 ? 0 : std::uniform_int_distribution<int>(0, empty_count - 1)(generator);
+		for (int i = 0; i < empty_count and not played; i++) {
+			int point = empty_points[(start + i) % empty_count];
+			if (point == ko_point or is_playout_eye<SIZE>(board, point, colour))
+				continue;
+			played = try_play(point, colour, ko_point);
+		}
+		if (not played)
+			ko_point = -1;
+		passes = played ? 0 : passes + 1;
+		colour = 3 - colour;
+	}
+}
+
+template <int SIZE>
+void AreaScorerOfSize<SIZE>::score(const Cells& cells, Player to_move, float komi, AreaScore& result) {
+	if (to_move == Player::NOBODY)
+		to_move = Player::BLACK;
+	std::array<int, point_count(SIZE)> lost = {};
+	AreaScore playout_score;
+	for (int p = 0; p < playouts; p++) {
+		playout(cells, to_move);
+		tromp_taylor(board, 0, playout_score);
+		for (int point = 0; point < point_count(SIZE); point++)
+			if (cells[point] != 0 and playout_score.ownership[point] != (cells[point] == 1 ? 1 : -1))
+				lost[point]++;
+	}
+
+	// Remove every stone that ended up outside its owner's area in most playouts.
+	Cells alive = cells;
+	for (int point = 0; point < point_count(SIZE); point++)
+		if (2 * lost[point] > playouts)
+			alive[point] = 0;
+	tromp_taylor(alive, komi, result);
+}
+
+#define INSTANTIATE(SIZE) \
+	template class AreaScorerOfSize<SIZE>; \
+	template bool is_playout_eye<SIZE>(const std::array<Cell, point_count(SIZE)>& board, int point, Cell colour);
+SNPGO_FOR_EACH_BOARD_SIZE(INSTANTIATE)
+#undef INSTANTIATE
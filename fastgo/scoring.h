@@ -0,0 +1,70 @@
+// Area scoring of finished games, with dead stones found by random playouts.
+
+#ifndef _SNPGO_SCORING_H
+#define _SNPGO_SCORING_H
+
+#include <array>
+#include <random>
+#include "go_utils.h"
+#include "plane_emission.h"
+
+constexpr int DEFAULT_SCORING_PLAYOUTS = 16;
+// Playouts normally end after two passes, or after this many moves per point to guard against long capture cycles.
+constexpr int MAX_PLAYOUT_MOVES_PER_POINT = 3;
+
+template <int SIZE>
+struct AreaScoreOfSize {
+	// +1 for points in Black's area, -1 for White's, and 0 for neutral points.
+	std::array<int8_t, point_count(SIZE)> ownership;
+	// Black's area minus White's area minus komi.
+	float margin;
+
+	Player winner() const { return margin > 0 ? Player::BLACK : margin < 0 ? Player::WHITE : Player::NOBODY; }
+};
+
+typedef AreaScoreOfSize<BOARD_SIZE> AreaScore;
+
+// The usual playout rule for a point not to fill: surrounded by colour's stones, with too few of its diagonals held by the opponent to make it a false eye.
+template <int SIZE>
+bool is_playout_eye(const std::array<Cell, point_count(SIZE)>& cells, int point, Cell colour);
+
+// Scores final positions. Games usually end with dead stones still on the board, so each stone that belongs to
+// the other player's area at the end of most of a batch of random playouts is removed before Tromp-Taylor scoring.
+template <int SIZE>
+class AreaScorerOfSize {
+public:
+	typedef std::array<Cell, point_count(SIZE)> Cells;
+	typedef AreaScoreOfSize<SIZE> AreaScore;
+
+	// With zero playouts every stone counts as alive.
+	AreaScorerOfSize(int playouts, uint64_t seed);
+	void score(const Cells& cells, Player to_move, float komi, AreaScore& result);
+	// Stones count for their owner, and empty regions for whichever player alone borders them.
+	static void tromp_taylor(const Cells& cells, float komi, AreaScore& result);
+
+private:
+	int playouts;
+	std::mt19937_64 generator;
+
+	// The playout board, with an unordered list of its empty points for picking random moves.
+	Cells board;
+	std::array<int16_t, point_count(SIZE)> empty_points;
+	std::array<int16_t, point_count(SIZE)> empty_index;
+	int empty_count;
+
+	// Scratch for flood fills, reset by bumping the generation rather than clearing.
+	std::array<uint32_t, point_count(SIZE)> marks = {};
+	uint32_t generation = 0;
+	std::array<int16_t, point_count(SIZE)> stack;
+
+	void next_generation();
+	int count_liberties(int point, int limit);
+	int remove_group(int point);
+	bool try_play(int point, Cell colour, int& ko_point);
+	void playout(const Cells& cells, Player to_move);
+};
+
+typedef AreaScorerOfSize<BOARD_SIZE> AreaScorer;
+
+#endif
+
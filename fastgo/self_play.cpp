@@ -0,0 +1,113 @@
+// Playing self-play games for training data.
+
+#include "self_play.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+constexpr Coord PASS_MOVE = {-1, -1};
+
+void sensible_moves(GoBoard& board, Player who, std::vector<Coord>& moves) {
+	moves.clear();
+	for (int y = 0; y < BOARD_SIZE; y++) {
+		for (int x = 0; x < BOARD_SIZE; x++) {
+			if (piece_at(board, {x, y}) == 0 and board.is_legal(who, {x, y}) and not pattern_is_eye(board.pattern_at({x, y}), (Cell)who))
+				moves.push_back({x, y});
+		}
+	}
+}
+
+static Coord choose_uniformly(const std::vector<Coord>& moves, std::mt19937_64& generator) {
+	if (moves.empty())
+		return PASS_MOVE;
+	return moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(generator)];
+}
+
+Coord RandomMovePolicy::choose_move(GoBoard& board, Player who, std::mt19937_64& generator) {
+	sensible_moves(board, who, moves);
+	return choose_uniformly(moves, generator);
+}
+
+Coord CaptureMovePolicy::choose_move(GoBoard& board, Player who, std::mt19937_64& generator) {
+	sensible_moves(board, who, moves);
+	captures.clear();
+	escapes.clear();
+	for (Coord xy : moves) {
+		for (Coord neighbor : NEIGHBORS_INIT_LIST(xy)) {
+			if (not coord_in_bounds(neighbor) or piece_at(board, neighbor) == 0 or board.liberty_count(neighbor) != 1)
+				continue;
+			if (piece_at(board, neighbor) == (int)who)
+				escapes.push_back(xy);
+			else
+				captures.push_back(xy);
+		}
+	}
+	if (not captures.empty())
+		return choose_uniformly(captures, generator);
+	if (not escapes.empty())
+		return choose_uniformly(escapes, generator);
+	return choose_uniformly(moves, generator);
+}
+
+std::unique_ptr<MovePolicy> make_move_policy(std::string name) {
+	if (name == "random")
+		return std::unique_ptr<MovePolicy>(new RandomMovePolicy);
+	if (name == "capture")
+		return std::unique_ptr<MovePolicy>(new CaptureMovePolicy);
+	return nullptr;
+}
+
+void play_self_play_game(MovePolicy& policy, const SelfPlayConfig& config, std::mt19937_64& generator, Game& game, AreaScore& final_score) {
+	play_match_game(policy, policy, config, generator, game, final_score);
+}
+
+void play_match_game(MovePolicy& black, MovePolicy& white, const SelfPlayConfig& config, std::mt19937_64& generator, Game& game, AreaScore& final_score) {
+	game = Game();
+	game.komi = config.komi;
+
+	// Pick which move numbers get a random move.
+	std::vector<int> random_move_numbers(config.random_move_horizon);
+	for (int i = 0; i < config.random_move_horizon; i++)
+		random_move_numbers[i] = i;
+	std::shuffle(random_move_numbers.begin(), random_move_numbers.end(), generator);
+	random_move_numbers.resize(std::min(config.random_moves, config.random_move_horizon));
+
+	GoBoard board;
+	std::vector<Coord> moves;
+	Player who = Player::BLACK;
+	int passes = 0;
+	for (int move_number = 0; move_number < config.max_moves and passes < 2; move_number++) {
+		bool random = std::find(random_move_numbers.begin(), random_move_numbers.end(), move_number) != random_move_numbers.end();
+		Coord xy;
+		if (random) {
+			sensible_moves(board, who, moves);
+			xy = choose_uniformly(moves, generator);
+		} else {
+			xy = (who == Player::BLACK ? black : white).choose_move(board, who, generator);
+		}
+
+		Move m;
+		m.who_moved = who;
+		m.xy = xy;
+		m.pass = xy == PASS_MOVE;
+		m.is_random_self_play_move = random and not m.pass;
+		game.moves.push_back(m);
+		if (m.pass) {
+			board.pass();
+			passes++;
+		} else {
+			assert(board.is_legal(who, xy));
+			board.place_stone(who, xy);
+			passes = 0;
+		}
+		who = opponent_of(who);
+	}
+
+	AreaScorer scorer(config.scoring_playouts, generator());
+	scorer.score(board.cells, who, config.komi, final_score);
+	game.who_won = final_score.winner();
+	char result[32] = "0";
+	if (game.who_won != Player::NOBODY)
+		snprintf(result, sizeof(result), "%c+%g", game.who_won == Player::BLACK ? 'B' : 'W', std::fabs(final_score.margin));
+	game.result_string = result;
+}
@@ -0,0 +1,62 @@
+// Playing self-play games for training data.
+
+#ifndef _SNPGO_SELF_PLAY_H
+#define _SNPGO_SELF_PLAY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include "go_utils.h"
+#include "sgf.h"
+#include "scoring.h"
+
+// Chooses the moves of self-play games. Each worker thread gets its own instance, so implementations may keep state.
+class MovePolicy {
+public:
+	virtual ~MovePolicy() {}
+	// Returns a legal move for who, or (-1, -1) to pass.
+	virtual Coord choose_move(GoBoard& board, Player who, std::mt19937_64& generator) = 0;
+};
+
+// Uniformly random legal moves that don't fill the player's own eyes, passing once there are none.
+class RandomMovePolicy : public MovePolicy {
+	std::vector<Coord> moves;
+
+public:
+	Coord choose_move(GoBoard& board, Player who, std::mt19937_64& generator) override;
+};
+
+// Captures when it can, otherwise extends groups out of atari when it can, and otherwise plays randomly.
+class CaptureMovePolicy : public MovePolicy {
+	std::vector<Coord> moves, captures, escapes;
+
+public:
+	Coord choose_move(GoBoard& board, Player who, std::mt19937_64& generator) override;
+};
+
+// Returns null for an unknown policy name.
+std::unique_ptr<MovePolicy> make_move_policy(std::string name);
+
+// Fills moves with every legal move for who that doesn't fill one of their own eyes.
+void sensible_moves(GoBoard& board, Player who, std::vector<Coord>& moves);
+
+struct SelfPlayConfig {
+	float komi = 7.5;
+	// Games normally end after two passes; this only guards against long capture cycles.
+	int max_moves = 2 * BOARD_SIZE * BOARD_SIZE;
+	// This many distinct move numbers below random_move_horizon are played uniformly at random rather than by the
+	// policy, and flagged as random self-play moves, exactly as C[rand] comments mark them in self-play SGFs.
+	int random_moves = 1;
+	int random_move_horizon = 250;
+	int scoring_playouts = DEFAULT_SCORING_PLAYOUTS;
+};
+
+// Plays a whole game, filling in game (including who_won and result_string) and its final score.
+void play_self_play_game(MovePolicy& policy, const SelfPlayConfig& config, std::mt19937_64& generator, Game& game, AreaScore& final_score);
+// The same with a different policy for each player, which may be the same object. Giving random_moves and
+// random_move_horizon the same value makes that many opening moves random, and two games seeded alike open alike.
+void play_match_game(MovePolicy& black, MovePolicy& white, const SelfPlayConfig& config, std::mt19937_64& generator, Game& game, AreaScore& final_score);
+
+#endif
+
@@ -0,0 +1,343 @@
+// SGF parsing.
+
+#include "sgf.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cassert>
+#include <cstdio>
+#include <cctype>
+#include <exception>
+#include <boost/algorithm/string/predicate.hpp>
+
+std::unordered_map<std::string, int> rank_string_table{
+	{"1d", 1}, {"2d", 2}, {"3d", 3},
+	{"4d", 4}, {"5d", 5}, {"6d", 6},
+	{"7d", 7}, {"8d", 8}, {"9d", 9},
+	{"1p",  9}, {"2p",  9}, {"3p",  9},
+	{"4p", 10}, {"5p", 11}, {"6p", 12},
+	{"7p", 13}, {"8p", 14}, {"9p", 15},
+
+	// For Fox Go Server data.
+	{"1段", 1}, {"2段", 2}, {"3段", 3},
+	{"4段", 4}, {"5段", 5}, {"6段", 6},
+	{"7段", 7}, {"8段", 8}, {"9段", 9},
+	{"P1段",  9}, {"P2段",  9}, {"P3段",  9},
+	{"P4段", 10}, {"P5段", 11}, {"P6段", 12},
+	{"P7段", 13}, {"P8段", 14}, {"P9段", 15},
+};
+
+#define NOT_EOF(x) \
+	do { \
+		if ((x) == EOF) { \
+			return false; \
+		} \
+	} while (0)
+
+// Returns false for coordinates that are neither on the board nor a pass.
+static bool fill_in_move(Move& m, std::string& location, int board_size) {
+	if (location.size() == 0) {
+		m.pass = true;
+		return true;
+	}
+	int x = ((int)location[0]) - 'a';
+	int y = ((int)location[1]) - 'a';
+	if (not (0 <= x and x < board_size and 0 <= y and y < board_size)) {
+		// A move at [tt] (or (19, 19), right off the corner on a 19x19 board) is considered a pass.
+		if (x == 19 and y == 19) {
+			m.pass = true;
+			m.xy = {-1, -1};
+			return true;
+		}
+		std::cerr << "Weird coordinates: " << x << " " << y << std::endl;
+		return false;
+	}
+	m.xy = {x, y};
+	return true;
+}
+
+// Adds the stones of one AB or AW value, which is either a point or a compressed rectangle of points like "aa:cc".
+static bool add_setup_stones(Game& game, Player who, const std::string& contents) {
+	if (not (contents.size() == 2 or (contents.size() == 5 and contents[2] == ':')))
+		return false;
+	int x0 = contents[0] - 'a', y0 = contents[1] - 'a';
+	int x1 = contents[contents.size() - 2] - 'a', y1 = contents.back() - 'a';
+	if (not (0 <= x0 and x0 <= x1 and x1 < game.board_size and 0 <= y0 and y0 <= y1 and y1 < game.board_size))
+		return false;
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			game.setup_stones.push_back({who, {x, y}, false});
+	return true;
+}
+
+std::string slurp_file(std::string path) {
+	std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+	std::ostringstream ss{};
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+// Setup stones with no liberties would be left on the board, as from_cells captures nothing, and break replaying the game.
+template <int SIZE>
+static bool setup_stones_have_liberties(const Game& game) {
+	BoardAnalysisOfSize<SIZE> analysis;
+	analysis.analyse(initial_board<SIZE>(game).cells);
+	return not analysis.has_group_without_liberties();
+}
+
+// Parses the properties of a root node, up to the first move node, then applies the checks that only need the root.
+static bool parse_root_node(std::istream& f, Game& game) {
+	std::string previous_property_name;
+	while (1) {
+		f >> std::ws;
+		int next = f.peek();
+		NOT_EOF(next);
+		// If we hit a ; then we're starting the moves, and a ) means there aren't any.
+		if (next == ';' or next == ')')
+			break;
+		// Parse an entry in the header node.
+		std::string property_name, property_first_contents;
+		std::getline(f, property_name, '[');
+		std::getline(f, property_first_contents, ']');
+		// Further values of a property, as in AB[aa][bb], come through with no name.
+		if (property_name.empty())
+			property_name = previous_property_name;
+		previous_property_name = property_name;
+		if (property_name == "SZ") {
+			// Only the sizes the pipeline is instantiated for.
+#define SIZE_MATCHES(SIZE) property_first_contents == #SIZE or
+			if (not (SNPGO_FOR_EACH_BOARD_SIZE(SIZE_MATCHES) false)) {
+//				std::cerr << "Bad size: " << property_first_contents << " in " << path << std::endl;
+				return false;
+			}
+#undef SIZE_MATCHES
+			game.board_size = std::stoi(property_first_contents);
+		} else if (property_name == "HA") {
+			try {
+				game.handicap = std::stoi(property_first_contents);
+			} catch (std::exception& e) {
+//				std::cerr << "Bad handicap: " << property_first_contents << " in " << path << std::endl;
+				return false;
+			}
+		} else if (property_name == "AW" or property_name == "AB") {
+			if (not add_setup_stones(game, property_name == "AB" ? Player::BLACK : Player::WHITE, property_first_contents)) {
+//				std::cerr << "Bad setup stones: " << property_first_contents << " in " << path << std::endl;
+				return false;
+			}
+		} /* else if (property_name == "TM") { // or property_name == "OT") {
+			int value = 0;
+			try {
+				value = std::stoi(property_first_contents);
+			} catch (std::exception& e) {
+				std::cout << "Bad integer attempt in: " << path << " with " << e.what() << " at value: " << property_first_contents << " -- skipping!" << std::endl;
+				return false;
+			}
+			if (value < 600)
+				return false;
+//			std::cerr << "Contains TM/OT, which we currently drop: " << property_name << " = " << property_first_contents << std::endl;
+//			return false;
+		} */ else if (property_name == "RE") {
+			game.result_string = property_first_contents;
+		} else if (property_name == "WR") {
+			if (rank_string_table.count(property_first_contents) > 0)
+				game.white_rank = rank_string_table[property_first_contents];
+//			else
+//				std::cerr << "Weird white rank: " << property_first_contents << std::endl;
+		} else if (property_name == "BR") {
+			if (rank_string_table.count(property_first_contents) > 0)
+				game.black_rank = rank_string_table[property_first_contents];
+//			else
+//				std::cerr << "Weird black rank: " << property_first_contents << std::endl;
+		} else if (property_name == "KM") {
+			try {
+				game.komi = std::stof(property_first_contents);
+			} catch (std::exception& e) {
+//				std::cerr << "Bad komi: " << property_first_contents << std::endl;
+//				return false;
+			}
+			if (game.komi >= 8.5 or game.komi <= -0.5) {
+//				std::cerr << "Bizarre komi: " << game.komi << " in " << path << std::endl;
+				return false;
+			}
+//			assert(-6 < game.komi);
+//			assert(game.komi < 12);
+		}
+	}
+	// Handicap stones have to be given as setup stones, or we'd be training on a position that isn't on the board.
+	if (game.handicap > 1 and (int)game.setup_stones.size() < game.handicap) {
+//		std::cerr << "Handicap without setup stones in " << path << std::endl;
+		return false;
+	}
+	// SZ may come after the setup stones, so only now can they all be checked against the board size.
+	for (const Move& m : game.setup_stones)
+		if (not (m.xy.first < game.board_size and m.xy.second < game.board_size))
+			return false;
+	if (not game.setup_stones.empty()) {
+		switch (game.board_size) {
+#define CASE(SIZE) case SIZE: if (not setup_stones_have_liberties<SIZE>(game)) return false; break;
+		SNPGO_FOR_EACH_BOARD_SIZE(CASE)
+#undef CASE
+		}
+	}
+	// Parse who won.
+	if (boost::starts_with(game.result_string, "B+")) {
+		game.who_won = Player::BLACK;
+	} else if (boost::starts_with(game.result_string, "W+")) {
+		game.who_won = Player::WHITE;
+	} else {
+		game.who_won = Player::NOBODY;
+//	std::cout << "                                                      Unknown result: " << game.result_string << std::endl;
+	}
+	return true;
+}
+
+// Everything parse_sgf does except insisting on a result. path only appears in error messages.
+static bool parse_sgf_text(const std::string& contents, const std::string& path, Game& game) {
+	std::stringstream f{contents};
+
+	// Move up to the first open paren.
+	f >> std::ws;
+	if (f.get() != '(') {
+		std::cerr << "Expected '(' in " << path << std::endl;
+		return false;
+	}
+	// Begin consuming nodes.
+	while (1) {
+		f >> std::ws;
+		// End parsing if we've hit the end of file or ')'
+		int c = f.get();
+		if (c == EOF or c == ')')
+			break;
+		// Begin the first node.
+		if (c != ';') {
+			std::cerr << "Expected ';' in " << path << std::endl;
+			return false;
+		}
+		// Parse the Properties for the master header node.
+		if (not parse_root_node(f, game))
+			return false;
+		// Parse the sequence of move nodes.
+		while (1) {
+			f >> std::ws;
+			int c = f.get();
+			NOT_EOF(c);
+			// Check if we're done with all of the moves.
+			if (c == ')')
+				break;
+			// If not, then there better be a move here.
+			if (c != ';') {
+				std::cerr << "Expected move ';' in " << path << std::endl;
+				return false;
+			}
+			game.moves.push_back({Player::NOBODY, {0, 0}, false});
+			Move& m = game.moves.back();
+
+			// Parse all of the properties inside of the move node.
+			while (1) {
+				f >> std::ws;
+				int next = f.peek();
+				NOT_EOF(next);
+				// If we hit a ; then we're done with this move.
+				if (next == ';' or next == ')')
+					break;
+				std::string property_name, property_first_contents;
+				std::getline(f, property_name, '[');
+				std::getline(f, property_first_contents, ']');
+				if (property_name == "B" or property_name == "W") {
+					m.who_moved = property_name == "B" ? Player::BLACK : Player::WHITE;
+					if (not fill_in_move(m, property_first_contents, game.board_size))
+						return false;
+				} else if (property_name == "C" and property_first_contents == "rand") {
+					m.is_random_self_play_move = true;
+				} else if (property_name == "AW" or property_name == "AB" or property_name == "AE") {
+//					std::cerr << "Contains move AW/BW/AE, which is currently not supported: " << path << std::endl;
+					return false;
+				} else if (property_name == "HA") {
+//					std::cerr << "Contains unsupported handicap encoded in move: " << path << std::endl;
+					return false;
+				}
+			}
+			if (m.who_moved == Player::NOBODY) {
+//				std::cerr << "Bad empty move in:" << path << std::endl;
+				game.moves.pop_back();
+			}
+		}
+	}
+
+	return true;
+}
+
+bool parse_sgf(std::string path, Game& game) {
+	if (not parse_sgf_text(slurp_file(path), path, game))
+		return false;
+	return game.who_won != Player::NOBODY;
+}
+
+bool parse_sgf_string(const std::string& contents, Game& game) {
+	return parse_sgf_text(contents, "SGF text", game);
+}
+
+// The inverse of rank_string_table, picking dan ranks over the equivalent professional ones.
+static std::string rank_string(int rank) {
+	if (1 <= rank and rank <= 9)
+		return std::to_string(rank) + "d";
+	return std::to_string(rank - 6) + "p";
+}
+
+std::string format_sgf(const Game& game, const std::string& extra_root_properties) {
+	auto point = [](Coord xy) {
+		return std::string{(char)('a' + xy.first), (char)('a' + xy.second)};
+	};
+	std::ostringstream out;
+	out << "(;GM[1]FF[4]SZ[" << game.board_size << "]KM[" << game.komi << "]";
+	if (game.handicap > 0)
+		out << "HA[" << game.handicap << "]";
+	for (Player who : {Player::BLACK, Player::WHITE}) {
+		bool first = true;
+		for (const Move& m : game.setup_stones) {
+			if (m.who_moved != who)
+				continue;
+			out << (first ? (who == Player::BLACK ? "AB" : "AW") : "") << "[" << point(m.xy) << "]";
+			first = false;
+		}
+	}
+	if (game.black_rank >= 1)
+		out << "BR[" << rank_string(game.black_rank) << "]";
+	if (game.white_rank >= 1)
+		out << "WR[" << rank_string(game.white_rank) << "]";
+	out << "RE[" << game.result_string << "]" << extra_root_properties << "\n";
+	for (size_t i = 0; i < game.moves.size(); i++) {
+		const Move& m = game.moves[i];
+		out << ";" << (m.who_moved == Player::BLACK ? "B" : "W") << "[" << (m.pass ? "" : point(m.xy)) << "]";
+		if (m.is_random_self_play_move)
+			out << "C[rand]";
+		if (i % 16 == 15)
+			out << "\n";
+	}
+	out << ")\n";
+	return out.str();
+}
+
+bool parse_sgf_root(std::string path, Game& game, int& move_count) {
+	std::string file_contents = slurp_file(path);
+	std::stringstream f{file_contents};
+	f >> std::ws;
+	if (f.get() != '(')
+		return false;
+	f >> std::ws;
+	if (f.get() != ';' or not parse_root_node(f, game) or game.who_won == Player::NOBODY)
+		return false;
+	// Count the move nodes without parsing them: a ';' then (after any whitespace) B[ or W[.
+	move_count = 0;
+	for (size_t i = f.tellg(); i < file_contents.size(); i++) {
+		if (file_contents[i] != ';')
+			continue;
+		size_t j = i + 1;
+		while (j < file_contents.size() and std::isspace((unsigned char)file_contents[j]))
+			j++;
+		if (j + 1 < file_contents.size() and (file_contents[j] == 'B' or file_contents[j] == 'W') and file_contents[j + 1] == '[')
+			move_count++;
+	}
+	return true;
+}
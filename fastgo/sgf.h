@@ -0,0 +1,58 @@
+// SGF parsing.
+
+#ifndef _SNPGO_SGF_H
+#define _SNPGO_SGF_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "go_utils.h"
+
+struct Move {
+	Player who_moved;
+	Coord xy;
+	bool pass;
+	// Set for moves carrying a C[rand] comment, which self-play uses to flag randomly chosen moves.
+	bool is_random_self_play_move = false;
+};
+
+struct Game {
+	std::string result_string = "???";
+	Player who_won = Player::NOBODY;
+	std::vector<Move> moves;
+	int white_rank = -99;
+	int black_rank = -99;
+	float komi = 7.5;
+	// One of SNPGO_FOR_EACH_BOARD_SIZE.
+	int board_size = BOARD_SIZE;
+	// From HA, which only counts if the handicap stones are among the setup stones.
+	int handicap = 0;
+	// Stones placed by AB and AW in the root node, handicap stones among them. Each is stored as a move that is never played.
+	std::vector<Move> setup_stones;
+};
+
+extern std::unordered_map<std::string, int> rank_string_table;
+
+std::string slurp_file(std::string path);
+// Returns false for unreadable games and for games we don't train on (unsupported sizes, setup stones after the root node, unknown results).
+bool parse_sgf(std::string path, Game& game);
+// Parses SGF text, such as a game still being played, the same way except that any result (or none) is accepted.
+bool parse_sgf_string(const std::string& contents, Game& game);
+// Parses only the root node, filling in everything but the moves, and counts the move nodes without parsing them.
+// Returns false for the games parse_sgf would reject on their root node alone.
+bool parse_sgf_root(std::string path, Game& game, int& move_count);
+// Writes the game out as an SGF that parse_sgf reads back the same, marking random self-play moves with C[rand].
+// extra_root_properties, such as PB[name], go into the root node as they are.
+std::string format_sgf(const Game& game, const std::string& extra_root_properties = "");
+
+// The position before the first move: empty apart from the game's setup stones.
+template <int SIZE>
+GoBoardOfSize<SIZE> initial_board(const Game& game) {
+	assert(game.board_size == SIZE);
+	std::array<Cell, SIZE * SIZE> cells = {};
+	for (const Move& m : game.setup_stones)
+		piece_at(cells, m.xy) = (Cell)m.who_moved;
+	return GoBoardOfSize<SIZE>::from_cells(cells);
+}
+
+#endif
@@ -0,0 +1,125 @@
+// A columnar index of SGF root node metadata, for choosing games without opening their files.
+
+#include "sgf_index.h"
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+void SgfIndex::resize(size_t count) {
+	accepted.resize(count);
+	board_sizes.resize(count);
+	handicaps.resize(count);
+	half_point_komis.resize(count);
+	winners.resize(count);
+	black_ranks.resize(count);
+	white_ranks.resize(count);
+	move_counts.resize(count);
+	paths.resize(count);
+}
+
+void SgfIndex::index_file(const std::string& root_directory, size_t index) {
+	Game game;
+	int move_count = 0;
+	bool ok = parse_sgf_root(root_directory + "/" + paths[index], game, move_count);
+	accepted[index]         = ok;
+	board_sizes[index]      = ok ? game.board_size : 0;
+	handicaps[index]        = ok ? std::min(game.handicap, 255) : 0;
+	half_point_komis[index] = ok ? std::lround(game.komi * 2) : 0;
+	winners[index]          = ok ? (uint8_t)game.who_won : 0;
+	black_ranks[index]      = ok ? std::max(-128, game.black_rank) : 0;
+	white_ranks[index]      = ok ? std::max(-128, game.white_rank) : 0;
+	move_counts[index]      = ok ? std::min(move_count, (int)UINT16_MAX) : 0;
+}
+
+void SgfIndex::fill_in_header(size_t index, Game& game) const {
+	game = Game();
+	game.board_size = board_sizes.at(index);
+	game.handicap = handicaps[index];
+	game.komi = half_point_komis[index] / 2.0f;
+	game.who_won = (Player)winners[index];
+	game.black_rank = black_ranks[index];
+	game.white_rank = white_ranks[index];
+}
+
+template <typename T>
+static void write_column(std::ofstream& out, const std::vector<T>& column) {
+	out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+template <typename T>
+static bool read_column(const std::vector<char>& data, size_t& offset, size_t count, std::vector<T>& column) {
+	// The caller has checked that count is at most data.size(), so this can't overflow, and offset never passes the end.
+	if (count * sizeof(T) > data.size() - offset)
+		return false;
+	column.resize(count);
+	std::memcpy(column.data(), &data[offset], count * sizeof(T));
+	offset += count * sizeof(T);
+	return true;
+}
+
+bool SgfIndex::save(std::string path) const {
+	std::ofstream out(path, std::ios_base::out | std::ios_base::binary);
+	uint64_t count = size();
+	out.write(SGF_INDEX_MAGIC, sizeof(SGF_INDEX_MAGIC));
+	out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	write_column(out, accepted);
+	write_column(out, board_sizes);
+	write_column(out, handicaps);
+	write_column(out, half_point_komis);
+	write_column(out, winners);
+	write_column(out, black_ranks);
+	write_column(out, white_ranks);
+	write_column(out, move_counts);
+	std::vector<uint32_t> path_ends;
+	uint32_t end = 0;
+	for (const std::string& p : paths)
+		path_ends.push_back(end += p.size());
+	write_column(out, path_ends);
+	for (const std::string& p : paths)
+		out.write(p.data(), p.size());
+	return bool(out);
+}
+
+bool SgfIndex::load(std::string path) {
+	std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+	if (not in)
+		return false;
+	std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	uint64_t count;
+	size_t offset = sizeof(SGF_INDEX_MAGIC) + sizeof(count);
+	if (data.size() < offset or std::memcmp(data.data(), SGF_INDEX_MAGIC, sizeof(SGF_INDEX_MAGIC)) != 0) {
+		std::cerr << "Not an SGF index: " << path << std::endl;
+		return false;
+	}
+	std::memcpy(&count, &data[sizeof(SGF_INDEX_MAGIC)], sizeof(count));
+
+	// Every entry takes at least one byte, so a larger count is garbage. Path ends must not go backwards, so that each
+	// path lies inside the path bytes, which the last end must exactly cover.
+	std::vector<uint32_t> path_ends;
+	bool ok = count <= data.size()
+		and read_column(data, offset, count, accepted)
+		and read_column(data, offset, count, board_sizes)
+		and read_column(data, offset, count, handicaps)
+		and read_column(data, offset, count, half_point_komis)
+		and read_column(data, offset, count, winners)
+		and read_column(data, offset, count, black_ranks)
+		and read_column(data, offset, count, white_ranks)
+		and read_column(data, offset, count, move_counts)
+		and read_column(data, offset, count, path_ends)
+		and std::is_sorted(path_ends.begin(), path_ends.end())
+		and offset + (count == 0 ? 0 : path_ends.back()) == data.size();
+	if (not ok) {
+		std::cerr << "Truncated SGF index: " << path << std::endl;
+		return false;
+	}
+	paths.clear();
+	uint32_t start = 0;
+	for (uint32_t end : path_ends) {
+		paths.emplace_back(&data[offset + start], end - start);
+		start = end;
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+// A columnar index of SGF root node metadata, for choosing games without opening their files.
+
+#ifndef _SNPGO_SGF_INDEX_H
+#define _SNPGO_SGF_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sgf.h"
+
+// File layout (all little-endian):
+//   "SNPGIDX1" magic, then a uint64 entry count n.
+//   Then one column after another, each n entries long: uint8 accepted, uint8 board size, uint8 handicap,
+//   int16 komi in half points, uint8 winner (a Player), int8 black rank, int8 white rank, uint16 move count,
+//   and uint32 path end offsets, followed by all of the paths (relative to the indexed directory) back to back.
+// Every SGF file under the directory gets an entry, in asciibetical order, so the converter's start and stop
+// indices mean the same games with or without the index. Entries whose root node parse_sgf would reject are
+// kept but not accepted, and their other columns are zero.
+constexpr char SGF_INDEX_MAGIC[8] = {'S', 'N', 'P', 'G', 'I', 'D', 'X', '1'};
+
+struct SgfIndex {
+	std::vector<uint8_t> accepted;
+	std::vector<uint8_t> board_sizes;
+	std::vector<uint8_t> handicaps;
+	std::vector<int16_t> half_point_komis;
+	std::vector<uint8_t> winners;
+	std::vector<int8_t> black_ranks;
+	std::vector<int8_t> white_ranks;
+	std::vector<uint16_t> move_counts;
+	std::vector<std::string> paths;
+
+	size_t size() const { return paths.size(); }
+	void resize(size_t count);
+	// Parses the root node of the SGF at root_directory/paths[index] into entry index.
+	void index_file(const std::string& root_directory, size_t index);
+	// A Game with the entry's metadata filled in but no moves or setup stones, for filtering with the usual checks.
+	void fill_in_header(size_t index, Game& game) const;
+
+	bool save(std::string path) const;
+	bool load(std::string path);
+};
+
+#endif
+
@@ -2,18 +2,30 @@
 
 #include "go_utils.h"
 #include "feature_extraction.h"
+#include "sgf.h"
+#include "game_records.h"
+#include "chunk_io.h"
+#include "sampling.h"
+#include "scoring.h"
+#include "samples.h"
+#include "dedup.h"
+#include "sgf_index.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <memory>
 #include <string>
 #include <array>
+#include <map>
+#include <numeric>
 #include <cassert>
 #include <cstdio>
 #include <random>
 #include <iterator>
 #include <exception>
+#include <chrono>
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
@@ -21,342 +33,119 @@
 #include <boost/algorithm/string/replace.hpp>
 using boost::iostreams::filtering_ostream;
 
-constexpr int RANK_THRESHOLD = -100;
-
-class RoundRobinWriter {
-	// Here we use lists instead of vectors because filtering_ostream deletes copy.
-	std::list<std::ofstream> files;
-	std::list<filtering_ostream> streams;
-	std::list<filtering_ostream>::iterator here;
-
-	int count;
-public:
-
-	int index = 0;
-	RoundRobinWriter(std::string base_path, int count) : count(count) {
-		for (int i = 0; i < count; i++) {
-			files.emplace_back(base_path + "_" + std::to_string(i), std::ios_base::out | std::ios_base::binary);
-			streams.emplace_back();
-			streams.back().push(boost::iostreams::zlib_compressor());
-			streams.back().push(files.back());
-		}
-		here = streams.begin();
-	}
-
-	void advance() {
-		here++;
-		if (here == streams.end())
-			here = streams.begin();
-		index++;
-		index %= count;
-	}
-
-	filtering_ostream& get_filtering_ostream() {
-		return *here;
-	}
-
-	void write(const char* data, std::streamsize length) {
-		get_filtering_ostream().write(data, length);
-	}
-};
-
-struct Move {
-	Player who_moved;
-	Coord xy;
-	bool pass;
-};
-
-struct Game {
-	std::string result_string = "???";
-	Player who_won = Player::NOBODY;
-	std::vector<Move> moves;
-	int white_rank = -99;
-	int black_rank = -99;
-	float komi = 7.5;
-};
-
-std::unordered_map<std::string, int> rank_string_table{
-	{"1d", 1}, {"2d", 2}, {"3d", 3},
-	{"4d", 4}, {"5d", 5}, {"6d", 6},
-	{"7d", 7}, {"8d", 8}, {"9d", 9},
-	{"1p",  9}, {"2p",  9}, {"3p",  9},
-	{"4p", 10}, {"5p", 11}, {"6p", 12},
-	{"7p", 13}, {"8p", 14}, {"9p", 15},
-
-	// For Fox Go Server data.
-	{"1段", 1}, {"2段", 2}, {"3段", 3},
-	{"4段", 4}, {"5段", 5}, {"6段", 6},
-	{"7段", 7}, {"8段", 8}, {"9段", 9},
-	{"P1段",  9}, {"P2段",  9}, {"P3段",  9},
-	{"P4段", 10}, {"P5段", 11}, {"P6段", 12},
-	{"P7段", 13}, {"P8段", 14}, {"P9段", 15},
-};
-
-#define NOT_EOF(x) \
-	do { \
-		if ((x) == EOF) { \
-			return false; \
-		} \
-	} while (0)
-
-static void fill_in_move(Move& m, std::string& location) {
-	if (location.size() == 0) {
-		m.pass = true;
-		return;
-	}
-	int x = ((int)location[0]) - 'a';
-	int y = ((int)location[1]) - 'a';
-	if (not ((0 <= x and x < 19 and 0 <= y and y < 19) or (x == 20 and y == 20))) {
-		// A move at [tt] (or (19, 19), right off the corner) is considered a pass.
-		if (x == 19 and y == 19) {
-			m.pass = true;
-			m.xy = {-1, -1};
-			return;
-		}
-		std::cout << "Weird coordinates: " << x << " " << y << std::endl;
-		assert(false);
-	}
-	m.xy = {x, y};
-}
-
-std::string slurp_file(std::string path) {
-	std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
-	std::ostringstream ss{};
-	ss << in.rdbuf();
-	return ss.str();
-}
-
-static bool parse_sgf(std::string path, Game& game) {
-	std::string file_contents = slurp_file(path);
-	std::stringstream f{file_contents};
-
-	// Move up to the first open paren.
-	f >> std::ws;
-	if (f.get() != '(') {
-		std::cerr << "Expected '(' in " << path << std::endl;
-		return false;
-	}
-	// Begin consuming nodes.
-	while (1) {
-		f >> std::ws;
-		// End parsing if we've hit the end of file or ')'
-		int c = f.get();
-		if (c == EOF or c == ')')
-			break;
-		// Begin the first node.
-		if (c != ';') {
-			std::cerr << "Expected ';' in " << path << std::endl;
-			return false;
-		}
-		// Parse the Properties for the master header node.
-		while (1) {
-			f >> std::ws;
-			int next = f.peek();
-			NOT_EOF(next);
-			// If we hit a ; then we're starting the moves.
-			if (next == ';')
-				break;
-			// Parse an entry in the header node.
-			std::string property_name, property_first_contents;
-			std::getline(f, property_name, '[');
-			std::getline(f, property_first_contents, ']');
-			if (property_name == "SZ") {
-				if (property_first_contents != "19") {
-//					std::cerr << "Bad size: " << property_first_contents << " in " << path << std::endl;
-					return false;
-				}
-			} else if (property_name == "HA") {
-				if (property_first_contents != "0") {
-//					std::cerr << "Bad handicap: " << property_first_contents << " in " << path << std::endl;
-					return false;
-				}
-			} else if (property_name == "AW" or property_name == "AB") {
-//				std::cerr << "Contains AW/BW, which is currently not supported." << std::endl;
-				return false;
-			} /* else if (property_name == "TM") { // or property_name == "OT") {
-				int value = 0;
-				try {
-					value = std::stoi(property_first_contents);
-				} catch (std::exception& e) {
-					std::cout << "Bad integer attempt in: " << path << " with " << e.what() << " at value: " << property_first_contents << " -- skipping!" << std::endl;
-					return false;
-				}
-				if (value < 600)
-					return false;
-//				std::cerr << "Contains TM/OT, which we currently drop: " << property_name << " = " << property_first_contents << std::endl;
-//				return false;
-			} */ else if (property_name == "RE") {
-				game.result_string = property_first_contents;
-			} else if (property_name == "WR") {
-				if (rank_string_table.count(property_first_contents) > 0)
-					game.white_rank = rank_string_table[property_first_contents];
-//				else
-//					std::cerr << "Weird white rank: " << property_first_contents << std::endl;
-			} else if (property_name == "BR") {
-				if (rank_string_table.count(property_first_contents) > 0)
-					game.black_rank = rank_string_table[property_first_contents];
-//				else
-//					std::cerr << "Weird black rank: " << property_first_contents << std::endl;
-			} else if (property_name == "KM") {
-				try {
-					game.komi = std::stof(property_first_contents);
-				} catch (std::exception& e) {
-//					std::cerr << "Bad komi: " << property_first_contents << std::endl;
-//					return false;
-				}
-				if (game.komi >= 8.5 or game.komi <= -0.5) {
-//					std::cerr << "Bizarre komi: " << game.komi << " in " << path << std::endl;
-					return false;
-				}
-//				assert(-6 < game.komi);
-//				assert(game.komi < 12);
-			}
-		}
-		// Parse the sequence of move nodes.
-		while (1) {
-			f >> std::ws;
-			int c = f.get();
-			NOT_EOF(c);
-			// Check if we're done with all of the moves.
-			if (c == ')')
-				break;
-			// If not, then there better be a move here.
-			if (c != ';') {
-				std::cerr << "Expected move ';' in " << path << std::endl;
-				return false;
-			}
-			game.moves.push_back({Player::NOBODY, {0, 0}, false});
-			Move& m = game.moves.back();
-
-			// Parse all of the properties inside of the move node.
-			while (1) {
-				f >> std::ws;
-				int next = f.peek();
-				NOT_EOF(next);
-				// If we hit a ; then we're done with this move.
-				if (next == ';' or next == ')')
-					break;
-				std::string property_name, property_first_contents;
-				std::getline(f, property_name, '[');
-				std::getline(f, property_first_contents, ']');
-				if (property_name == "B" or property_name == "W") {
-					m.who_moved = property_name == "B" ? Player::BLACK : Player::WHITE;
-					fill_in_move(m, property_first_contents);
-				} else if (property_name == "AW" or property_name == "AB" or property_name == "AE") {
-//					std::cerr << "Contains move AW/BW/AE, which is currently not supported: " << path << std::endl;
-					return false;
-				} else if (property_name == "HA") {
-//					std::cerr << "Contains unsupported handicap encoded in move: " << path << std::endl;
-					return false;
-				}
-			}
-			if (m.who_moved == Player::NOBODY) {
-//				std::cerr << "Bad empty move in:" << path << std::endl;
-				game.moves.pop_back();
-			}
-		}
-	}
-
-	// Parse who won.
-	if (boost::starts_with(game.result_string, "B+")) {
-		game.who_won = Player::BLACK;
-	} else if (boost::starts_with(game.result_string, "W+")) {
-		game.who_won = Player::WHITE;
-	} else {
-		game.who_won = Player::NOBODY;
-//		std::cout << "                                                      Unknown result: " << game.result_string << std::endl;
-	}
-
-	if (game.who_won == Player::NOBODY)
-		return false;
-
-	return true;
-}
-
-void write_all_samples(RoundRobinWriter& features_writer, RoundRobinWriter& targets_writer, RoundRobinWriter& winners_writer, std::string path) {
+static bool read_game(std::string path, const SamplingPolicy& policy, Game& game) {
 	// Read in the SGF file.
-	Game game;
 	if (not parse_sgf(path, game))
-		return;
+		return false;
 
 	// If both players are too low rank then skip.
-	if (game.white_rank < RANK_THRESHOLD and game.black_rank < RANK_THRESHOLD) {
-//		std::cerr << "Both players too low rank: " << game.white_rank << " " << game.black_rank << std::endl;
-		return;
-	}
-
-	// If just one player is too low rank then print a warning.
-//	if (game.white_rank < RANK_THRESHOLD)
-//		std::cerr << "White too low rank: " << game.white_rank << " " << game.black_rank << std::endl;
-//	if (game.black_rank < RANK_THRESHOLD)
-//		std::cerr << "Black too low rank: " << game.white_rank << " " << game.black_rank << std::endl;
-
-	GoBoard board;
-	FeatureExtractor feature_extractor;
-	std::array<uint8_t, BOARD_SIZE * BOARD_SIZE> one_hot_winning_move = {};
-
-	for (int move_index = 0; move_index < game.moves.size(); move_index++) {
-		Move& m = game.moves[move_index];
-
-		bool do_write_this_move = true;
-
-		// Disable writing this move if the player is too low rank.
-		if (m.who_moved == Player::BLACK and game.black_rank < RANK_THRESHOLD)
-			do_write_this_move = false;
-		if (m.who_moved == Player::WHITE and game.white_rank < RANK_THRESHOLD)
-			do_write_this_move = false;
-
-		// Currently we generate no samples on a pass.
-		if (m.pass) {
-			// Insert a dummy move to the history, so that the network can rely on
-			// particular positions in the history being moves by particular players.
-			feature_extractor.add_move_to_history({-1, -1});
-			continue;
-		}
-
-		// Get out features for the board right BEFORE the move.
-		if (do_write_this_move) {
-			uint8_t features_buffer[TOTAL_FEATURES];
-			feature_extractor.fill_features(features_buffer, board, m.who_moved);
-			features_writer.write(reinterpret_cast<const char*>(features_buffer), TOTAL_FEATURES);
-		}
-
-		// Write the winning move out.
-		Cell& winning_move_cell = piece_at(one_hot_winning_move, m.xy);
-		winning_move_cell = 1;
-		if (do_write_this_move)
-			targets_writer.write(reinterpret_cast<const char*>(&one_hot_winning_move[0]), BOARD_SIZE * BOARD_SIZE);
-		winning_move_cell = 0;
+	return policy.accepts_game(game);
+}
 
-		// Write the winner of the game out.
-		int our_komi = std::round(game.komi * 2);
-		if (m.who_moved == Player::BLACK)
-			our_komi = -our_komi;
-		char game_winner[] = {0, 0};
-		if (game.who_won == m.who_moved) //Player::BLACK)
-			game_winner[0] = 1;
-		if (game.who_won == opponent_of(m.who_moved))//Player::WHITE)
-			game_winner[1] = 1;
-		if (do_write_this_move)
-			winners_writer.write(game_winner, 2);
+static bool is_supported_board_size(int size) {
+#define SIZE_MATCHES(SIZE) size == SIZE or
+	return SNPGO_FOR_EACH_BOARD_SIZE(SIZE_MATCHES) false;
+#undef SIZE_MATCHES
+}
 
-		// Update the board and feature extractor.
-		board.place_stone(m.who_moved, m.xy);
-		feature_extractor.add_move_to_history(m.xy);
+// Outputs for a board size other than the default get the size spliced into their names, as in features_9x9_0.
+static std::string path_for_board_size(std::string base_path, int size) {
+	return size == BOARD_SIZE ? base_path : base_path + "_" + std::to_string(size) + "x" + std::to_string(size);
+}
 
-		// Advance each RoundRobinWriter. It is CRITICAL that we advance all of them together so they remain synced up!
-		assert(features_writer.index == targets_writer.index and targets_writer.index == winners_writer.index);
-		features_writer.advance();
-		targets_writer.advance();
-		winners_writer.advance();
+template <int SIZE>
+static void convert_game(AsyncChunkSetWriter& writer, const Game& game, const std::vector<bool>& selected, bool write_territory, bool eye_plane, int scoring_playouts, uint64_t seed, PrefixCache* cache) {
+	// Territory targets need the final position scored, which means replaying the whole game up front.
+	AreaScoreOfSize<SIZE> final_score;
+	write_territory = write_territory and std::find(selected.begin(), selected.end(), true) != selected.end();
+	if (write_territory) {
+		AreaScorerOfSize<SIZE> scorer(scoring_playouts, seed);
+		score_final_position(game, scorer, final_score);
 	}
+	write_all_samples<SIZE>(writer, game, selected, write_territory ? &final_score : nullptr, eye_plane, cache);
 }
 
 int main(int argc, char** argv) {
-	if (argc != 8) {
-		std::cerr << "Usage: sgf_to_chunks root_directory features_chunk.z targets_chunk.z winners_chunk.z start_index stop_index round_robin_count" << std::endl;
+	std::string game_records_path;
+	bool records_only = false, eye_plane = false;
+	SamplingPolicy policy;
+	DedupConfig dedup_config;
+	uint64_t seed = 12345;
+	std::string territory_chunk_path, index_path, record_chunk_path, tfrecord_path;
+	int scoring_playouts = DEFAULT_SCORING_PLAYOUTS;
+	int writer_threads = 1;
+	int prefix_cache_mib = 0, prefix_cache_depth = 30;
+	std::vector<int> board_sizes{BOARD_SIZE};
+	bool bad_options = argc < 8;
+	for (int i = 8; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--game-records" and i + 1 < argc)
+			game_records_path = argv[++i];
+		else if (option == "--records-only")
+			records_only = true;
+		else if (option == "--seed" and i + 1 < argc)
+			seed = std::stoull(argv[++i]);
+		else if (option == "--index" and i + 1 < argc)
+			index_path = argv[++i];
+		else if (option == "--territory" and i + 1 < argc)
+			territory_chunk_path = argv[++i];
+		else if (option == "--eye-plane")
+			eye_plane = true;
+		else if (option == "--record-chunks" and i + 1 < argc)
+			record_chunk_path = argv[++i];
+		else if (option == "--tfrecords" and i + 1 < argc)
+			tfrecord_path = argv[++i];
+		else if (option == "--scoring-playouts" and i + 1 < argc)
+			scoring_playouts = std::stoi(argv[++i]);
+		else if (option == "--writer-threads" and i + 1 < argc)
+			writer_threads = std::stoi(argv[++i]);
+		else if (option == "--prefix-cache-mib" and i + 1 < argc)
+			prefix_cache_mib = std::stoi(argv[++i]);
+		else if (option == "--prefix-cache-depth" and i + 1 < argc)
+			prefix_cache_depth = std::stoi(argv[++i]);
+		else if (option == "--board-sizes" and i + 1 < argc) {
+			board_sizes.clear();
+			std::stringstream sizes(argv[++i]);
+			for (std::string size; std::getline(sizes, size, ',');) {
+				board_sizes.push_back(std::stoi(size));
+				bad_options |= not is_supported_board_size(board_sizes.back());
+			}
+		}
+		else if (not parse_sampling_option(argc, argv, i, policy) and not parse_dedup_option(argc, argv, i, dedup_config))
+			bad_options = true;
+	}
+	if (bad_options or (records_only and game_records_path.empty()) or writer_threads < 1 or not (record_chunk_path.empty() or tfrecord_path.empty())) {
+		std::cerr << "Usage: sgf_to_chunks root_directory features_chunk.z targets_chunk.z winners_chunk.z start_index stop_index round_robin_count [options]" << std::endl;
 		std::cerr << std::endl;
 		std::cerr << "Finds all SGF files under the root directory, sorts them asciibetically processes those in [start_index, stop_index), and outputs to the chunk files." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --game-records path    Also write every accepted game to a compact game records file." << std::endl;
+		std::cerr << "  --records-only         Only write the game records file, skipping feature extraction and chunks." << std::endl;
+		std::cerr << "  --index path           Take the SGF list from an index_sgfs index of root_directory, and skip games whose" << std::endl;
+		std::cerr << "                         indexed size, result or ranks rule them out without opening them." << std::endl;
+		std::cerr << SAMPLING_OPTIONS_USAGE;
+		std::cerr << DEDUP_OPTIONS_USAGE;
+		std::cerr << "  --seed n               Seed for choosing which positions to write (default 12345)." << std::endl;
+		std::cerr << "  --territory path       Also write territory chunks: the final area ownership of each point (+1 ours, -1 theirs," << std::endl;
+		std::cerr << "                         0 neutral) as int8s, then the final margin in half points as an int16, for the player to move." << std::endl;
+		std::cerr << "  --eye-plane            Follow each sample's features with one more plane: 1 at the empty points that are eyes for" << std::endl;
+		std::cerr << "                         the player to move by the playout rule. Shuffle with --planes " << FEATURE_COUNT + 1 << "." << std::endl;
+		std::cerr << "  --record-chunks base   Write each sample as one record in checksummed record chunks base_0, base_1, ..." << std::endl;
+		std::cerr << "                         instead of the parallel chunk sets, whose paths are then unused. With --territory," << std::endl;
+		std::cerr << "                         records include the territory part, and its path is unused too." << std::endl;
+		std::cerr << "  --tfrecords base       Write ZLIB-compressed TFRecord files base_0, base_1, ... instead, again in place of the" << std::endl;
+		std::cerr << "                         chunk sets, each record a tf.train.Example with the raw bytes features (uint8 planes)," << std::endl;
+		std::cerr << "                         targets (uint8 one-hot), winners (2 uint8s) and with --territory, territory (int8 ownership" << std::endl;
+		std::cerr << "                         then an int16 margin). Read them with tf.data.TFRecordDataset(paths, compression_type=\"ZLIB\")" << std::endl;
+		std::cerr << "                         and tf.io.FixedLenFeature([], tf.string) for each part." << std::endl;
+		std::cerr << "  --scoring-playouts n   Random playouts for finding dead stones when scoring (default " << DEFAULT_SCORING_PLAYOUTS << ")." << std::endl;
+		std::cerr << "  --writer-threads n     Background threads compressing and writing chunks (default 1)." << std::endl;
+		std::cerr << "  --prefix-cache-mib m   Keep up to m MiB of positions and features from the first moves of games, so games" << std::endl;
+		std::cerr << "                         sharing an opening reuse them instead of replaying and featurising it again (default 0, off)." << std::endl;
+		std::cerr << "  --prefix-cache-depth d Only cache positions before move d (default 30)." << std::endl;
+		std::cerr << "  --board-sizes a,b,...  Convert games of these sizes (of 9, 13 and 19; default " << BOARD_SIZE << ") into separate chunk sets." << std::endl;
+		std::cerr << "                         Sizes other than " << BOARD_SIZE << " get _NxN added to each output name, as in features.z_9x9_0." << std::endl;
+		std::cerr << "                         Game records only ever hold " << BOARD_SIZE << "x" << BOARD_SIZE << " games without setup stones." << std::endl;
 		return 1;
 	}
 
@@ -368,34 +157,129 @@ int main(int argc, char** argv) {
 	int stop_index        = std::stoi(argv[6]);
 	int round_robin_count = std::stoi(argv[7]);
 
+	auto start_time = std::chrono::steady_clock::now();
 	std::vector<std::string> paths;
+	SgfIndex sgf_index;
 
-	boost::filesystem::recursive_directory_iterator dir(root_directory_path);
-	for (auto entry : dir) {
-		if (boost::filesystem::extension(entry) == ".sgf") {
-			paths.push_back(entry.path().string());
+	if (index_path.empty()) {
+		boost::filesystem::recursive_directory_iterator dir(root_directory_path);
+		for (auto entry : dir) {
+			if (boost::filesystem::extension(entry) == ".sgf") {
+				paths.push_back(entry.path().string());
+			}
 		}
+		std::sort(paths.begin(), paths.end());
+	} else {
+		// The index holds the same files in the same sorted order, so the shuffle below picks the same games.
+		if (not sgf_index.load(index_path))
+			return 1;
+		for (const std::string& path : sgf_index.paths)
+			paths.push_back(root_directory_path + "/" + path);
 	}
 
 	// Put the data in a deterministic but shuffled order.
-	std::sort(paths.begin(), paths.end());
 	std::minstd_rand0 generator(12345);
-	std::shuffle(paths.begin(), paths.end(), generator);
+	std::vector<size_t> order(paths.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), generator);
 
 	stop_index = std::min(stop_index, (int)paths.size());
 
 	std::cout << "Found " << paths.size() << " SGF files." << std::endl;
 
-	// Open the output files for writing.
-	RoundRobinWriter features_writer(features_chunk_path, round_robin_count);
-	RoundRobinWriter targets_writer (targets_chunk_path,  round_robin_count);
-	RoundRobinWriter winners_writer (winners_chunk_path,  round_robin_count);
-
+	// Open the output files for writing, one chunk set per board size.
+	std::map<int, std::unique_ptr<AsyncChunkSetWriter>> writers;
+	for (int size : board_sizes) {
+		if (records_only or writers.count(size))
+			continue;
+		if (not record_chunk_path.empty()) {
+			std::vector<uint32_t> part_bytes = sample_part_bytes(size, not territory_chunk_path.empty(), eye_plane);
+			writers[size].reset(new AsyncChunkSetWriter(path_for_board_size(record_chunk_path, size), part_bytes, round_robin_count, writer_threads));
+			continue;
+		}
+		if (not tfrecord_path.empty()) {
+			std::vector<uint32_t> part_bytes = sample_part_bytes(size, not territory_chunk_path.empty(), eye_plane);
+			std::vector<std::string> part_names = sample_part_names(not territory_chunk_path.empty());
+			writers[size].reset(new AsyncChunkSetWriter(path_for_board_size(tfrecord_path, size), part_names, part_bytes, round_robin_count, writer_threads));
+			continue;
+		}
+		std::vector<std::string> base_paths{features_chunk_path, targets_chunk_path, winners_chunk_path};
+		if (not territory_chunk_path.empty())
+			base_paths.push_back(territory_chunk_path);
+		for (std::string& base_path : base_paths)
+			base_path = path_for_board_size(base_path, size);
+		writers[size].reset(new AsyncChunkSetWriter(base_paths, round_robin_count, writer_threads));
+	}
+	std::unique_ptr<GameRecordWriter> records_writer;
+	if (not game_records_path.empty())
+		records_writer.reset(new GameRecordWriter(game_records_path));
+	CorpusDeduplicator deduplicator(dedup_config);
+	std::unique_ptr<PrefixCache> prefix_cache;
+	if (prefix_cache_mib > 0)
+		prefix_cache.reset(new PrefixCache((size_t)prefix_cache_mib << 20, prefix_cache_depth));
+
+	uint64_t skipped_unopened = 0, games_read = 0, games_converted = 0, input_bytes = 0;
 	for (int index = start_index; index < stop_index; index++) {
-		std::string& path = paths[index];
+		size_t entry = order[index];
+		std::string& path = paths[entry];
 		if ((index + 1) % 10000 == 0)
 			printf("Processing %5i [%5i/%5i] %s\n", index, (index - start_index + 1), (stop_index - start_index), path.c_str());
-		write_all_samples(features_writer, targets_writer, winners_writer, path);
+		Game game;
+		if (not index_path.empty()) {
+			sgf_index.fill_in_header(entry, game);
+			if (not sgf_index.accepted[entry] or not policy.accepts_game(game) or std::find(board_sizes.begin(), board_sizes.end(), game.board_size) == board_sizes.end()) {
+				skipped_unopened++;
+				continue;
+			}
+			game = Game();
+		}
+		games_read++;
+		input_bytes += boost::filesystem::file_size(path);
+		if (not read_game(path, policy, game) or std::find(board_sizes.begin(), board_sizes.end(), game.board_size) == board_sizes.end())
+			continue;
+		if (not deduplicator.admit_game(game))
+			continue;
+		games_converted++;
+		if (records_writer and game.board_size == BOARD_SIZE and game.setup_stones.empty())
+			records_writer->write(game);
+		if (not records_only) {
+			// Seed per game, so a game's samples don't depend on how the files were split into ranges.
+			std::mt19937_64 game_generator(seed + index);
+			std::vector<bool> selected;
+			policy.select(game, game_generator, selected);
+			deduplicator.filter_positions(game, selected);
+			policy.cap(game_generator, selected);
+			AsyncChunkSetWriter& writer = *writers.at(game.board_size);
+			bool write_territory = not territory_chunk_path.empty();
+			switch (game.board_size) {
+#define CONVERT(SIZE) case SIZE: convert_game<SIZE>(writer, game, selected, write_territory, eye_plane, scoring_playouts, seed + index, prefix_cache.get()); break;
+			SNPGO_FOR_EACH_BOARD_SIZE(CONVERT)
+#undef CONVERT
+			}
+		}
+	}
+	if (not index_path.empty())
+		std::cout << "Skipped " << skipped_unopened << " games from the index without opening them." << std::endl;
+	deduplicator.report(std::cout);
+	if (prefix_cache)
+		prefix_cache->report(std::cout);
+	uint64_t samples = 0, output_bytes = 0;
+	for (auto& size_and_writer : writers) {
+		size_and_writer.second->close();
+		samples += size_and_writer.second->samples_written;
+		output_bytes += size_and_writer.second->file_bytes();
+	}
+	// Finish the game records file too, so that it's timed.
+	records_writer.reset();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	for (auto& size_and_writer : writers) {
+		std::cout << size_and_writer.first << "x" << size_and_writer.first << " ";
+		size_and_writer.second->report(std::cout);
 	}
+	// End to end, from listing the files to the last chunk closing, so regressions in parsing, replay or writing all show here.
+	printf("Converted %llu of %llu games read (%.1f MB of SGF) into %llu samples (%.1f MB of chunks) in %.2fs.\n",
+		(unsigned long long)games_converted, (unsigned long long)games_read, input_bytes / 1e6, (unsigned long long)samples, output_bytes / 1e6, seconds);
+	printf("Throughput: %.0f games/s, %.0f samples/s, %.2f MB/s in, %.2f MB/s out.\n",
+		games_converted / seconds, samples / seconds, input_bytes / 1e6 / seconds, output_bytes / 1e6 / seconds);
 }
 
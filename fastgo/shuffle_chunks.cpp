@@ -0,0 +1,254 @@
+// Uniformly shuffle every sample across a whole chunk set, using bounded memory.
+
+#include "chunk_io.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <boost/filesystem.hpp>
+
+// Temporary buckets are only read back once, so favour speed over ratio.
+static const int BUCKET_COMPRESSION_LEVEL = boost::iostreams::zlib::best_speed;
+
+struct Bucket {
+	std::string path;
+	uint64_t sample_count = 0;
+};
+
+struct Shuffler {
+	int record_bytes;
+	// How each record is split between the output's streams.
+	std::vector<int> output_parts;
+	uint64_t memory_bytes;
+	int fan_out;
+	std::string temp_directory;
+	std::mt19937_64 generator;
+	SampleSink& output;
+
+	int next_bucket_id = 0;
+	int deepest_pass = 0;
+	uint64_t samples_written = 0;
+
+	// Deal every record from next_record into bucket_count temporary buckets, chosen uniformly at random.
+	std::vector<Bucket> scatter(std::function<bool(char*)> next_record, int bucket_count, int pass) {
+		deepest_pass = std::max(deepest_pass, pass);
+		std::vector<Bucket> buckets(bucket_count);
+		std::vector<std::unique_ptr<ChunkWriter>> writers;
+		for (Bucket& bucket : buckets) {
+			bucket.path = (boost::filesystem::path(temp_directory) / ("shuffle_bucket_" + std::to_string(next_bucket_id++) + ".z")).string();
+			writers.emplace_back(new ChunkWriter(bucket.path, BUCKET_COMPRESSION_LEVEL));
+		}
+		std::uniform_int_distribution<int> choose_bucket(0, bucket_count - 1);
+		std::vector<char> record(record_bytes);
+		while (next_record(record.data())) {
+			int b = choose_bucket(generator);
+			writers[b]->write(record.data(), record.size());
+			buckets[b].sample_count++;
+		}
+		return buckets;
+	}
+
+	// Buckets that fit in memory are shuffled and written out; larger ones get scattered again, one pass deeper.
+	void drain(const Bucket& bucket, int pass) {
+		uint64_t bucket_bytes = bucket.sample_count * record_bytes;
+		if (bucket_bytes > memory_bytes and bucket.sample_count > 1) {
+			int bucket_count = std::min<uint64_t>(fan_out, std::max<uint64_t>(2, 2 * bucket_bytes / memory_bytes + 1));
+			std::vector<Bucket> children;
+			{
+				ChunkReader reader(bucket.path);
+				children = scatter([&](char* record) { return reader.read(record, record_bytes); }, bucket_count, pass + 1);
+			}
+			boost::filesystem::remove(bucket.path);
+			for (const Bucket& child : children)
+				drain(child, pass + 1);
+			return;
+		}
+
+		std::vector<char> records(bucket_bytes);
+		{
+			ChunkReader reader(bucket.path);
+			for (uint64_t i = 0; i < bucket.sample_count; i++) {
+				if (not reader.read(&records[i * record_bytes], record_bytes)) {
+					std::cerr << "Temporary bucket " << bucket.path << " is shorter than expected." << std::endl;
+					exit(1);
+				}
+			}
+		}
+		boost::filesystem::remove(bucket.path);
+
+		// Fisher-Yates over an index, then write the records in that order.
+		std::vector<uint32_t> order(bucket.sample_count);
+		for (uint64_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), generator);
+		for (uint32_t i : order) {
+			const char* record = &records[(uint64_t)i * record_bytes];
+			for (size_t part = 0; part < output_parts.size(); part++) {
+				output.write(part, record, output_parts[part]);
+				record += output_parts[part];
+			}
+			output.advance();
+			samples_written++;
+		}
+	}
+};
+
+// Drains the top level buckets into the output and checks that nothing went missing.
+static int finish(Shuffler& shuffler, const std::vector<Bucket>& buckets, AsyncChunkSetWriter& writer, uint64_t samples_read,
+	int in_count, int out_count, std::chrono::steady_clock::time_point start)
+{
+	for (const Bucket& bucket : buckets)
+		shuffler.drain(bucket, 1);
+	writer.close();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Shuffled %llu samples from %i chunk sets into %i in %.1fs using %i scatter pass(es).\n",
+		(unsigned long long)samples_read, in_count, out_count, seconds, shuffler.deepest_pass);
+	if (shuffler.samples_written != samples_read) {
+		std::cerr << "Wrote " << shuffler.samples_written << " samples but read " << samples_read << "!" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int shuffle_records(char** argv, int memory_mb, int fan_out, uint64_t seed) {
+	std::string records_in = argv[2];
+	int in_count = std::stoi(argv[3]);
+	std::string records_out = argv[4];
+	int out_count = std::stoi(argv[5]);
+	std::string temp_directory = argv[6];
+	boost::filesystem::create_directories(temp_directory);
+
+	// Every input has to share the first one's layout, which the output then keeps.
+	std::unique_ptr<RecordChunkReader> reader(new RecordChunkReader(records_in + "_0"));
+	if (not reader->is_open()) {
+		std::cerr << "Couldn't open record chunk " << records_in + "_0" << std::endl;
+		return 1;
+	}
+	std::vector<uint32_t> part_bytes = reader->part_bytes();
+	int record_bytes = reader->payload_bytes();
+
+	AsyncChunkSetWriter writer(records_out, part_bytes, out_count, 1);
+	Shuffler shuffler{record_bytes, {record_bytes}, (uint64_t)memory_mb << 20, fan_out, temp_directory, std::mt19937_64(seed), writer};
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t samples_read = 0;
+	int current_input = 0;
+	std::vector<Bucket> buckets = shuffler.scatter([&](char* record) {
+		while (true) {
+			if (reader and reader->read_record(record)) {
+				samples_read++;
+				return true;
+			}
+			if (reader and reader->corrupt) {
+				std::cerr << "Record chunk " << current_input << " is corrupt or truncated." << std::endl;
+				exit(1);
+			}
+			if (++current_input == in_count)
+				return false;
+			std::string path = records_in + "_" + std::to_string(current_input);
+			reader.reset(new RecordChunkReader(path));
+			if (not reader->is_open() or reader->part_bytes() != part_bytes) {
+				std::cerr << "Couldn't open record chunk " << path << " with the same layout as the first." << std::endl;
+				exit(1);
+			}
+		}
+	}, fan_out, 1);
+	reader.reset();
+
+	return finish(shuffler, buckets, writer, samples_read, in_count, out_count, start);
+}
+
+int main(int argc, char** argv) {
+	int memory_mb = 4096, fan_out = 64, planes = FEATURE_COUNT;
+	uint64_t seed = 12345;
+	// Record chunks take one path per chunk set rather than three.
+	bool records = argc > 1 and std::string(argv[1]) == "--records";
+	int positional = records ? 7 : 10;
+	bool bad_options = argc < positional;
+	for (int i = positional; i < argc; i++) {
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			bad_options = true;
+		else if (option == "--memory-mb")
+			memory_mb = std::stoi(argv[++i]);
+		else if (option == "--fan-out")
+			fan_out = std::stoi(argv[++i]);
+		else if (option == "--seed")
+			seed = std::stoull(argv[++i]);
+		else if (option == "--planes")
+			planes = std::stoi(argv[++i]);
+		else
+			bad_options = true;
+	}
+	if (bad_options or memory_mb < 1 or fan_out < 2) {
+		std::cerr << "Usage: shuffle_chunks features_in targets_in winners_in in_count features_out targets_out winners_out out_count temp_directory [options]" << std::endl;
+		std::cerr << "       shuffle_chunks --records records_in in_count records_out out_count temp_directory [options]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Reads the chunk set written by sgf_to_chunks as features_in_0 ... features_in_{in_count-1} (and likewise for" << std::endl;
+		std::cerr << "targets and winners), and writes a uniform shuffle of all samples round robin over out_count output files." << std::endl;
+		std::cerr << "Samples are dealt into temporary buckets under temp_directory, scattering again until each bucket fits in memory." << std::endl;
+		std::cerr << "With --records, the input and output are record chunks as written by sgf_to_chunks --record-chunks, whose" << std::endl;
+		std::cerr << "headers give the sample layout, and every part of each record, territory included, is kept." << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "  --memory-mb n   Largest bucket to shuffle in memory (default 4096)." << std::endl;
+		std::cerr << "  --fan-out n     Most buckets to scatter into per pass (default 64)." << std::endl;
+		std::cerr << "  --seed n        Seed for the shuffle (default 12345)." << std::endl;
+		std::cerr << "  --planes n      Feature planes per sample, for chunks made with another feature set (default " << FEATURE_COUNT << ")." << std::endl;
+		std::cerr << "                  Record chunks don't need this." << std::endl;
+		return 1;
+	}
+	if (records)
+		return shuffle_records(argv, memory_mb, fan_out, seed);
+
+	std::string features_in = argv[1], targets_in = argv[2], winners_in = argv[3];
+	int in_count = std::stoi(argv[4]);
+	std::string features_out = argv[5], targets_out = argv[6], winners_out = argv[7];
+	int out_count = std::stoi(argv[8]);
+	std::string temp_directory = argv[9];
+	boost::filesystem::create_directories(temp_directory);
+
+	SampleLayout layout;
+	layout.features_bytes = planes * BOARD_SIZE * BOARD_SIZE;
+
+	AsyncChunkSetWriter writer({features_out, targets_out, winners_out}, out_count, 1);
+	std::vector<int> output_parts{layout.features_bytes, layout.targets_bytes, layout.winners_bytes};
+	Shuffler shuffler{layout.record_bytes(), output_parts, (uint64_t)memory_mb << 20, fan_out, temp_directory, std::mt19937_64(seed), writer};
+
+	auto start = std::chrono::steady_clock::now();
+
+	// First pass: read every input chunk set in turn, dealing its samples into the top level buckets.
+	uint64_t samples_read = 0;
+	int current_input = -1;
+	std::unique_ptr<ChunkSetReader> reader;
+	std::vector<Bucket> buckets = shuffler.scatter([&](char* record) {
+		while (true) {
+			if (reader and reader->read_record(record)) {
+				samples_read++;
+				return true;
+			}
+			if (reader and reader->misaligned) {
+				std::cerr << "Chunk set " << current_input << " has misaligned features, targets and winners." << std::endl;
+				exit(1);
+			}
+			if (++current_input == in_count)
+				return false;
+			std::string suffix = "_" + std::to_string(current_input);
+			reader.reset(new ChunkSetReader(features_in + suffix, targets_in + suffix, winners_in + suffix, layout));
+			if (not reader->is_open()) {
+				std::cerr << "Couldn't open chunk set " << features_in + suffix << std::endl;
+				exit(1);
+			}
+		}
+	}, fan_out, 1);
+	reader.reset();
+
+	return finish(shuffler, buckets, writer, samples_read, in_count, out_count, start);
+}